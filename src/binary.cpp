@@ -2,6 +2,13 @@
 #include "./binary.h"
 #include "./processor.h"
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 
 namespace phil
 {
@@ -120,6 +127,17 @@ bool _interpret_option(
     int opt, const std::string &arg, phillip_main_t *phillip,
     execution_configure_t *option, inputs_t *inputs);
 
+/** Solves observations in a request of serve mode on phillip
+ *  and returns the XML of the response. */
+std::string _respond(phillip_main_t *phillip, const std::string &request);
+
+/** Returns the XML of the response to a request which failed. */
+std::string _respond_error(const std::string &message);
+
+/** Returns whether the request read from stdin in serve mode is complete,
+ *  that is, whether it has a closed root expression. */
+bool _is_complete_request(const std::string &request);
+
 
 execution_configure_t::execution_configure_t()
     : mode(EXE_MODE_UNDERSPECIFIED), kb_name("kb.cdb")
@@ -160,10 +178,13 @@ void execute(
     /* COMPILING KNOWLEDGE-BASE */
     if (do_compile)
     {
-        proc::processor_t processor;
+        proc::processor_t processor(phillip->param_int("parse_thread_num", 1));
         util::print_console("Compiling knowledge-base ...");
 
-        kb::kb()->prepare_compile();
+        if (phillip->flag("append_kb"))
+            kb::kb()->prepare_append();
+        else
+            kb::kb()->prepare_compile();
 
         processor.add_component(new proc::compile_kb_t());
         processor.process(inputs);
@@ -173,117 +194,950 @@ void execute(
         util::print_console("Completed to compile knowledge-base.");
     }
 
-    auto proc = [&](const lf::input_t &ipt)
+    /* COMPILING OBSERVATIONS */
+    if (config.mode == bin::EXE_MODE_COMPILE_OBS)
     {
-        if (config.mode == bin::EXE_MODE_INFERENCE)
-            return phillip->infer(ipt);
-        else
-            return phillip->learn(ipt);
-    };
+        std::string path = phillip->param("path_out");
+        if (path.empty())
+            throw phillip_exception_t(
+            "The path of compiled observations is not specified: use -o <PATH>", true);
+
+        proc::processor_t processor(phillip->param_int("parse_thread_num", 1));
+        util::print_console("Compiling observations ...");
+
+        processor.add_component(new proc::compile_obs_t(path));
+        processor.process(inputs);
+
+        util::print_console("Completed to compile observations.");
+        return;
+    }
+
+    /* SERVING */
+    if (config.mode == bin::EXE_MODE_SERVE)
+    {
+        phillip->load_tuned_parameters();
+        phillip->load_dynamic_weight_parameters();
+
+        kb::kb()->prepare_query();
+        phillip->check_validity();
+
+        serve(phillip);
+        return;
+    }
 
     /* INFERENCE */
     if (config.mode == bin::EXE_MODE_INFERENCE or
         config.mode == bin::EXE_MODE_LEARNING)
     {
-        std::vector<lf::input_t> parsed_inputs;
-        proc::processor_t processor;
+        int parse_thread_num = phillip->param_int("parse_thread_num", 1);
+        int infer_thread_num = (config.mode == bin::EXE_MODE_INFERENCE) ?
+            std::max(phillip->param_int("infer_thread_num", 1), 1) : 1;
         bool flag_printing(false);
+        int infer_correct = 0;
 
         phillip->load_tuned_parameters();
         phillip->load_dynamic_weight_parameters();
+        phillip->set_output_buffering(true);
 
-        util::print_console("Loading observations ...");
+        inputs_t targets(inputs.empty() ? inputs_t(1, "-") : inputs);
 
-        processor.add_component(new proc::parse_obs_t(&parsed_inputs));
-        processor.process(inputs);
+        auto get_obs_name = [](const std::string &name) -> std::string
+        {
+            return (name.rfind("::") != std::string::npos) ?
+                name.substr(name.rfind("::") + 2) : name;
+        };
 
-        util::print_console("Completed to load observations.");
-        util::print_console_fmt("    # of observations: %d", parsed_inputs.size());
+        auto is_solved = [&](const std::string &name) -> bool
+        {
+            std::string obs_name = get_obs_name(name);
+            return phillip->is_target(obs_name) and not phillip->is_excluded(obs_name);
+        };
 
-        std::srand(unsigned(phillip->param_int("rnd_seed", 20160511)));
+        /** A result of an observation,
+         *  which is kept until results of all previous observations are written. */
+        struct result_t
+        {
+            result_t() : is_solved(false), is_correct(true), learn_updates(0) {}
 
-        kb::kb()->prepare_query();
-        phillip->check_validity();
+            bool is_solved, is_correct;
+            int learn_updates;
+            std::string out; /**< Solutions to be printed to stdout. */
+            hash_map<std::string, std::string> files; /**< Outputs to each file. */
+        };
+
+        /* SOLVES OR LEARNS THE i-TH OBSERVATION ON ph.
+         * ONLY THE NAME OF ipt IS REFERRED TO IF IT IS NOT TO BE SOLVED. */
+        auto run = [&](phillip_main_t *ph, int i, const lf::input_t &ipt, result_t *r)
+        {
+            r->is_solved = is_solved(ipt.name);
+            if (not r->is_solved) return;
 
-        // SOLVE OR LEARN EACH OBSERVATION
-        int max_iter = config.mode == bin::EXE_MODE_INFERENCE ? 1 : phillip->param_int("learn_iter", 5);
+            util::print_console_fmt("Observation #%d: %s", i, ipt.name.c_str());
 
-        int infer_correct = 0;
+    #ifdef _DEBUG
+            /* DO NOT HANDLE EXCEPTIONS TO LET THE DEBUGGER CATCH AN EXCEPTION. */
+            r->learn_updates =
+                (config.mode == bin::EXE_MODE_INFERENCE) ? ph->infer(ipt) : ph->learn(ipt);
+    #else
+            try
+            {
+                r->learn_updates =
+                    (config.mode == bin::EXE_MODE_INFERENCE) ? ph->infer(ipt) : ph->learn(ipt);
+            }
+            catch (const std::exception &e)
+            {
+                util::print_warning_fmt(
+                    "Some exception was caught and then the observation \"%s\" was skipped.",
+                    get_obs_name(ipt.name).c_str());
+                util::print_warning_fmt("  -> what(): %s", e.what());
+                r->is_correct = false;
+                ph->take_buffered_outputs(&r->files);
+                return;
+            }
+    #endif
 
-        for (int iter = 0; iter < max_iter; iter++) {
-            int learn_updates = 0;
+            std::ostringstream oss;
+            auto sols = ph->get_solutions();
 
-            if(config.mode == bin::EXE_MODE_LEARNING) {
-                util::print_console_fmt("%d-th learning iteration.", 1+iter);
-                std::random_shuffle(parsed_inputs.begin(), parsed_inputs.end());
+            for (auto sol = sols.begin(); sol != sols.end(); ++sol) {
+                r->is_correct &= sol->contains(ph->get_latent_hypotheses_set()->requirements());
+                sol->print_graph(&oss);
             }
 
-            for (int i = 0; i < parsed_inputs.size(); ++i)
+            r->out = oss.str();
+            ph->take_buffered_outputs(&r->files);
+        };
+
+        /* WRITES THE RESULT OF THE NEXT OBSERVATION. */
+        auto emit = [&](const result_t &r)
+        {
+            if (r.is_solved and not flag_printing)
             {
-                const lf::input_t &ipt = parsed_inputs.at(i);
+                phillip->write_header();
+                flag_printing = true;
+            }
+
+            phillip_main_t::write_buffered_outputs(r.files);
+            std::cout << r.out << std::flush;
 
-                std::string obs_name = ipt.name;
-                if (obs_name.rfind("::") != std::string::npos)
-                    obs_name = obs_name.substr(obs_name.rfind("::") + 2);
+            if (r.is_correct) infer_correct++;
+        };
+
+        auto solve = [&](int i, const lf::input_t &ipt) -> int
+        {
+            result_t r;
+            run(phillip, i, ipt, &r);
+            emit(r);
+            return r.learn_updates;
+        };
+
+        /* SOLVES OBSERVATIONS ON DUPLICATES OF phillip IN PARALLEL
+         * AND RETURNS THE NUMBER OF OBSERVATIONS.
+         * next() GIVES THE i-TH OBSERVATION, OR RETURNS FALSE AT THE END, UNDER A LOCK.
+         * load() COMPLETES IT ON EACH THREAD WITHOUT THE LOCK, IF GIVEN.
+         * EACH THREAD TAKES THE NEXT OBSERVATION AS SOON AS IT BECOMES FREE,
+         * AND RESULTS ARE WRITTEN IN THE ORDER OF OBSERVATIONS. */
+        auto solve_in_parallel = [&](
+            const std::function<bool(int, lf::input_t*)> &next,
+            const std::function<void(int, lf::input_t*)> &load) -> int
+        {
+            int window = std::max(
+                phillip->param_int("reorder_buffer_size", 64 * infer_thread_num),
+                infer_thread_num);
+
+            std::vector<std::unique_ptr<phillip_main_t> > workers;
+            std::vector<phillip_main_t::worker_stat_t> stats(infer_thread_num);
+            std::vector<std::thread> threads;
+
+            std::mutex mutex_next, mutex_result;
+            std::condition_variable cond;
+            std::map<int, result_t> results;
+            int num_taken(0), num_written(0), num_pending(0), num_running(infer_thread_num);
+            bool is_aborted(false);
+            std::exception_ptr error;
+
+            for (int k = 0; k < infer_thread_num; ++k)
+            {
+                workers.emplace_back(phillip->duplicate());
+                workers.back()->set_output_buffering(true);
+                stats[k] = { 0, 0.0f, 0.0f, 0.0f, 0.0f };
+            }
 
-                if (phillip->is_target(obs_name) and
-                    not phillip->is_excluded(obs_name))
+            for (int k = 0; k < infer_thread_num; ++k)
+            {
+                threads.emplace_back([&, k]()
                 {
-                    if (not flag_printing)
+                    phillip_main_t *ph = workers.at(k).get();
+
+                    try
+                    {
+                        while (true)
+                        {
+                            // WAIT WHILE THE REORDER BUFFER IS FULL.
+                            {
+                                std::unique_lock<std::mutex> lock(mutex_result);
+                                cond.wait(lock, [&]() { return is_aborted or num_pending < window; });
+                                if (is_aborted) break;
+                                ++num_pending;
+                            }
+
+                            lf::input_t ipt;
+                            int i;
+                            {
+                                std::lock_guard<std::mutex> lock(mutex_next);
+                                if (not next(num_taken, &ipt)) break;
+                                i = num_taken++;
+                            }
+                            if (load) load(i, &ipt);
+
+                            result_t r;
+                            run(ph, i, ipt, &r);
+
+                            if (r.is_solved)
+                            {
+                                stats[k].num_observations += 1;
+                                stats[k].time_lhs += ph->get_time_for_lhs();
+                                stats[k].time_ilp += ph->get_time_for_ilp();
+                                stats[k].time_sol += ph->get_time_for_sol();
+                                stats[k].time_infer += ph->get_time_for_infer();
+                            }
+
+                            std::lock_guard<std::mutex> lock(mutex_result);
+                            results[i] = std::move(r);
+                            cond.notify_all();
+                        }
+                    }
+                    catch (...)
                     {
-                        phillip->write_header();
-                        flag_printing = true;
+                        std::lock_guard<std::mutex> lock(mutex_result);
+                        if (not error) error = std::current_exception();
+                        is_aborted = true;
                     }
 
-                    util::print_console_fmt("Observation #%d: %s", i, ipt.name.c_str());
-                    kb::kb()->clear_distance_cache();
+                    std::lock_guard<std::mutex> lock(mutex_result);
+                    --num_running;
+                    cond.notify_all();
+                });
+            }
 
-    #ifdef _DEBUG
-                    /* DO NOT HANDLE EXCEPTIONS TO LET THE DEBUGGER CATCH AN EXCEPTION. */
-                    learn_updates += proc(ipt);
-    #else
-                    try
+            while (true)
+            {
+                result_t r;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_result);
+                    cond.wait(lock, [&]()
+                    { return results.count(num_written) > 0 or num_running == 0; });
+
+                    auto it = results.find(num_written);
+                    if (it == results.end()) break;
+
+                    r = std::move(it->second);
+                    results.erase(it);
+                    ++num_written;
+                    --num_pending;
+                    cond.notify_all();
+                }
+                emit(r);
+            }
+
+            for (auto &th : threads)
+                th.join();
+            for (auto &st : stats)
+                phillip->add_worker_stat(st);
+            for (auto &w : workers)
+                phillip->merge_metrics(*w);
+
+            if (error)
+                std::rethrow_exception(error);
+
+            return num_written;
+        };
+
+        /* SOLVES OBSERVATIONS GIVEN BY next() AND load() IN A PIPELINE
+         * AND RETURNS THE NUMBER OF OBSERVATIONS.
+         * ENUMERATION, CONVERSION AND OPTIMIZATION RUN ON THEIR OWN THREADS,
+         * SO THAT AN INPUT IS ENUMERATED WHILE PREVIOUS ONES ARE BEING SOLVED.
+         * EACH INPUT IN THE PIPELINE HAS A DUPLICATE OF phillip,
+         * WHICH IS HANDED FROM STAGE TO STAGE THROUGH BOUNDED QUEUES. */
+        auto solve_in_pipeline = [&](
+            const std::function<bool(int, lf::input_t*)> &next,
+            const std::function<void(int, lf::input_t*)> &load) -> int
+        {
+            int num_lhs = std::max(phillip->param_int("lhs_thread_num", 1), 1);
+            int num_ilp = std::max(phillip->param_int("ilp_thread_num", 1), 1);
+            int num_sol = std::max(phillip->param_int("sol_thread_num", 1), 1);
+            int queue_size = std::max(phillip->param_int("pipeline_queue_size", 2), 1);
+            int num_contexts = num_lhs + num_ilp + num_sol + 2 * queue_size;
+
+            /** An input made from an observation by phillip_main_t::apply_choices(),
+             *  or an observation not to be solved. */
+            struct task_t
+            {
+                int order; /**< The order in which the result is written. */
+                int index; /**< The index of the observation. */
+                std::string name;
+                bool is_last, is_failed;
+                std::string error;
+                phillip_main_t *ph; /**< NULL if the observation is not solved. */
+            };
+
+            std::vector<std::unique_ptr<phillip_main_t> > contexts;
+            util::blocking_queue_t<phillip_main_t*> pool(num_contexts);
+            util::blocking_queue_t<task_t*> q_lhs(queue_size), q_ilp(queue_size), q_sol(queue_size);
+            std::atomic<int> num_lhs_running(num_lhs), num_ilp_running(num_ilp), num_sol_running(num_sol);
+            std::vector<std::thread> threads;
+
+            std::mutex mutex_result;
+            std::condition_variable cond;
+            std::map<int, task_t*> finished;
+            int num_tasks(0), num_written(0), num_obs(0);
+            bool is_fed(false);
+            std::exception_ptr error;
+
+            for (int k = 0; k < num_contexts; ++k)
+            {
+                contexts.emplace_back(phillip->duplicate());
+                contexts.back()->set_output_buffering(true);
+                pool.push(contexts.back().get());
+            }
+
+            auto finish = [&](task_t *t)
+            {
+                std::lock_guard<std::mutex> lock(mutex_result);
+                finished[t->order] = t;
+                cond.notify_all();
+            };
+
+            // FEEDS INPUTS OF EACH OBSERVATION INTO THE PIPELINE IN ORDER.
+            threads.emplace_back([&]()
+            {
+                int order = 0;
+
+                try
+                {
+                    lf::input_t ipt;
+                    for (int i = 0; next(i, &ipt); ++i, ipt = lf::input_t())
                     {
-                        learn_updates += proc(ipt);
+                        if (load) load(i, &ipt);
+
+                        std::vector<lf::input_t> inputs;
+                        if (is_solved(ipt.name))
+                        {
+                            util::print_console_fmt("Observation #%d: %s", i, ipt.name.c_str());
+                            phillip_main_t::apply_choices(ipt, &inputs);
+                        }
+
+                        if (inputs.empty())
+                        {
+                            finish(new task_t{ order++, i, ipt.name, true, false, "", NULL });
+                            continue;
+                        }
+
+                        for (size_t j = 0; j < inputs.size(); ++j)
+                        {
+                            phillip_main_t *ph;
+                            if (not pool.pop(&ph)) break;
+
+                            ph->begin_inference(inputs.at(j));
+                            task_t *t = new task_t{
+                                order++, i, ipt.name, (j + 1 == inputs.size()), false, "", ph };
+                            if (not q_lhs.push(std::move(t))) break;
+                        }
                     }
-                    catch (const std::exception &e)
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+
+                q_lhs.close();
+
+                std::lock_guard<std::mutex> lock(mutex_result);
+                num_tasks = order;
+                is_fed = true;
+                cond.notify_all();
+            });
+
+            // RUNS A STAGE ON EACH TASK FROM in AND PASSES IT TO out, OR FINISHES IT.
+            auto run_stage = [&](
+                util::blocking_queue_t<task_t*> *in, util::blocking_queue_t<task_t*> *out,
+                std::atomic<int> *num_running, std::function<void(phillip_main_t*)> stage)
+            {
+                task_t *t;
+                while (in->pop(&t))
+                {
+                    if (not t->is_failed)
                     {
-                        util::print_warning_fmt(
-                            "Some exception was caught and then the observation \"%s\" was skipped.", obs_name.c_str());
-                        util::print_warning_fmt("  -> what(): %s", e.what());
-                        continue;
+                        try
+                        {
+                            stage(t->ph);
+                        }
+                        catch (const std::exception &e)
+                        {
+                            t->is_failed = true;
+                            t->error = e.what();
+                        }
                     }
-    #endif
+
+                    if (out == NULL)
+                        finish(t);
+                    else
+                        out->push(std::move(t));
+                }
+
+                if (--(*num_running) == 0 and out != NULL)
+                    out->close();
+            };
+
+            for (int k = 0; k < num_lhs; ++k)
+                threads.emplace_back(run_stage, &q_lhs, &q_ilp, &num_lhs_running,
+                [](phillip_main_t *ph) { ph->execute_enumerator(); });
+            for (int k = 0; k < num_ilp; ++k)
+                threads.emplace_back(run_stage, &q_ilp, &q_sol, &num_ilp_running,
+                [](phillip_main_t *ph) { ph->execute_convertor(); });
+            for (int k = 0; k < num_sol; ++k)
+                threads.emplace_back(run_stage, &q_sol, nullptr, &num_sol_running,
+                [](phillip_main_t *ph) { ph->execute_solver(); ph->end_inference(); });
+
+            // WRITES RESULTS IN ORDER, GATHERING INPUTS OF EACH OBSERVATION.
+            result_t r;
+            bool is_failed(false);
+
+            while (true)
+            {
+                task_t *t;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_result);
+                    cond.wait(lock, [&]()
+                    { return finished.count(num_written) > 0 or (is_fed and num_written == num_tasks); });
+
+                    auto it = finished.find(num_written);
+                    if (it == finished.end()) break;
+
+                    t = it->second;
+                    finished.erase(it);
+                    ++num_written;
                 }
 
-                auto sols = phillip->get_solutions();
-                bool fCorrect(true);
+                if (t->ph != NULL)
+                {
+                    hash_map<std::string, std::string> files;
+
+                    r.is_solved = true;
+                    if (t->is_failed)
+                    {
+                        if (not is_failed)
+                        {
+                            util::print_warning_fmt(
+                                "Some exception was caught and then the observation \"%s\" was skipped.",
+                                get_obs_name(t->name).c_str());
+                            util::print_warning_fmt("  -> what(): %s", t->error.c_str());
+                        }
+                        is_failed = true;
+                    }
+
+                    t->ph->take_buffered_outputs(&files);
+                    for (auto it = files.begin(); it != files.end(); ++it)
+                        r.files[it->first] += it->second;
 
-                for (auto sol = sols.begin(); sol != sols.end(); ++sol) {
-                    fCorrect &= sol->contains(phillip->get_latent_hypotheses_set()->requirements());
-                    sol->print_graph();
+                    if (t->is_last)
+                    {
+                        if (is_failed)
+                            r.is_correct = false;
+                        else
+                        {
+                            std::ostringstream oss;
+                            auto sols = t->ph->get_solutions();
+
+                            for (auto sol = sols.begin(); sol != sols.end(); ++sol) {
+                                r.is_correct &= sol->contains(t->ph->get_latent_hypotheses_set()->requirements());
+                                sol->print_graph(&oss);
+                            }
+                            r.out = oss.str();
+                        }
+                    }
+
+                    // A POOLED CONTEXT KEEPS NO SOLUTION OF PAST OBSERVATIONS.
+                    t->ph->clear_all_solutions();
+                    pool.push(std::move(t->ph));
                 }
 
-                if(fCorrect) infer_correct++;
+                if (t->is_last)
+                {
+                    emit(r);
+                    r = result_t();
+                    is_failed = false;
+                    ++num_obs;
+                }
+
+                delete t;
             }
 
-            if(config.mode == bin::EXE_MODE_LEARNING) {
-                util::print_console_fmt("Updates: %d", learn_updates);
+            for (auto &th : threads)
+                th.join();
+            for (auto &c : contexts)
+                phillip->merge_metrics(*c);
+
+            if (error)
+                std::rethrow_exception(error);
+
+            return num_obs;
+        };
+
+        /* SOLVES OBSERVATIONS ON MULTIPLE THREADS. */
+        auto solve_concurrently = [&](
+            const std::function<bool(int, lf::input_t*)> &next,
+            const std::function<void(int, lf::input_t*)> &load) -> int
+        {
+            return phillip->flag("pipeline") ?
+                solve_in_pipeline(next, load) : solve_in_parallel(next, load);
+        };
+        bool do_solve_concurrently =
+            (config.mode == bin::EXE_MODE_INFERENCE) and
+            (infer_thread_num > 1 or phillip->flag("pipeline"));
+
+        if (config.mode == bin::EXE_MODE_INFERENCE and phillip->flag("stream_obs"))
+        {
+            /* STREAMING INFERENCE:
+             * A PRODUCER THREAD PARSES OBSERVATIONS INTO A BOUNDED QUEUE
+             * AND THEY ARE SOLVED IN ORDER AS SOON AS THEY ARRIVE. */
+            util::blocking_queue_t<lf::input_t> queue(
+                phillip->param_int("stream_queue_size", 64));
+            std::exception_ptr error;
+
+            kb::kb()->prepare_query();
+            phillip->check_validity();
+
+            util::print_console("Streaming observations ...");
+
+            std::thread producer([&]()
+            {
+                try
+                {
+                    proc::processor_t processor(parse_thread_num);
+                    inputs_t sources;
+                    processor.add_component(new proc::parse_obs_t(&queue));
+
+                    for (auto it = targets.begin(); it != targets.end(); ++it)
+                    {
+                        if ((*it) != "-" and proc::corpus_t::is_corpus(*it))
+                        {
+                            if (not sources.empty())
+                                processor.process(sources);
+                            sources.clear();
+
+                            proc::corpus_t corpus(*it);
+                            for (size_t i = 0; i < corpus.size(); ++i)
+                            {
+                                lf::input_t ipt;
+                                ipt.name = corpus.name(i);
+                                if (is_solved(ipt.name))
+                                    corpus.get(i, &ipt);
+                                if (not queue.push(std::move(ipt)))
+                                    break;
+                            }
+                        }
+                        else
+                            sources.push_back(*it);
+                    }
+
+                    if (not sources.empty())
+                        processor.process(sources);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                queue.close();
+            });
+
+            int num_obs = 0;
 
-                if(learn_updates == 0) {
-                    util::print_console("Converged.");
-                    break;
+            try
+            {
+                if (do_solve_concurrently)
+                    num_obs = solve_concurrently(
+                    [&](int i, lf::input_t *out) { return queue.pop(out); }, nullptr);
+                else
+                {
+                    lf::input_t ipt;
+                    while (queue.pop(&ipt))
+                        solve(num_obs++, ipt);
                 }
             }
+            catch (...)
+            {
+                queue.close();
+                producer.join();
+                throw;
+            }
+
+            producer.join();
+            if (error)
+                std::rethrow_exception(error);
+
+            util::print_console("Completed to stream observations.");
+            util::print_console_fmt("    # of observations: %d", num_obs);
+
+            phillip->write_accuracy(infer_correct, num_obs);
         }
+        else
+        {
+            std::vector<lf::input_t> parsed_inputs;
+            std::vector<std::unique_ptr<proc::corpus_t> > corpora;
+            proc::processor_t processor(parse_thread_num);
+
+            /** Pairs of the index of corpora (or -1 for parsed_inputs)
+             *  and the index of the observation in it. */
+            std::vector<std::pair<int, size_t> > observations;
+
+            util::print_console("Loading observations ...");
+
+            processor.add_component(new proc::parse_obs_t(&parsed_inputs));
 
-        if(config.mode == bin::EXE_MODE_INFERENCE)
-            phillip->write_accuracy(infer_correct, parsed_inputs.size());
+            // COMPILED OBSERVATIONS ARE DECODED ONLY WHEN THEY ARE SOLVED.
+            inputs_t sources;
+            auto parse_sources = [&]()
+            {
+                size_t begin = parsed_inputs.size();
+                if (not sources.empty())
+                    processor.process(sources);
+                for (size_t i = begin; i < parsed_inputs.size(); ++i)
+                    observations.push_back(std::make_pair(-1, i));
+                sources.clear();
+            };
+
+            for (auto it = targets.begin(); it != targets.end(); ++it)
+            {
+                if ((*it) != "-" and proc::corpus_t::is_corpus(*it))
+                {
+                    parse_sources();
+                    corpora.emplace_back(new proc::corpus_t(*it));
+                    for (size_t i = 0; i < corpora.back()->size(); ++i)
+                        observations.push_back(std::make_pair(corpora.size() - 1, i));
+                }
+                else
+                    sources.push_back(*it);
+            }
+            parse_sources();
+
+            util::print_console("Completed to load observations.");
+            util::print_console_fmt("    # of observations: %d", observations.size());
+
+            std::srand(unsigned(phillip->param_int("rnd_seed", 20160511)));
+
+            kb::kb()->prepare_query();
+            phillip->check_validity();
+
+            /* GIVES THE i-TH OBSERVATION, WHERE ONLY THE NAME IS SET IF IT IS COMPILED. */
+            auto get_observation = [&](int i, lf::input_t *out) -> bool
+            {
+                if (static_cast<size_t>(i) >= observations.size()) return false;
+
+                const std::pair<int, size_t> &o = observations.at(i);
+                if (o.first < 0)
+                    (*out) = parsed_inputs.at(o.second);
+                else
+                    out->name = corpora.at(o.first)->name(o.second);
+                return true;
+            };
+
+            // COMPILED OBSERVATIONS ARE DECODED ONLY WHEN THEY ARE SOLVED.
+            auto decode_observation = [&](int i, lf::input_t *out)
+            {
+                const std::pair<int, size_t> &o = observations.at(i);
+                if (o.first >= 0 and is_solved(out->name))
+                    corpora.at(o.first)->get(o.second, out);
+            };
+
+            if (do_solve_concurrently)
+                solve_concurrently(get_observation, decode_observation);
+            else
+            {
+                // SOLVE OR LEARN EACH OBSERVATION
+                int max_iter = config.mode == bin::EXE_MODE_INFERENCE ? 1 : phillip->param_int("learn_iter", 5);
+
+                for (int iter = 0; iter < max_iter; iter++) {
+                    int learn_updates = 0;
+
+                    if(config.mode == bin::EXE_MODE_LEARNING) {
+                        util::print_console_fmt("%d-th learning iteration.", 1+iter);
+                        std::random_shuffle(observations.begin(), observations.end());
+                    }
+
+                    for (int i = 0; i < observations.size(); ++i)
+                    {
+                        const std::pair<int, size_t> &o = observations.at(i);
+
+                        if (o.first < 0)
+                            learn_updates += solve(i, parsed_inputs.at(o.second));
+                        else
+                        {
+                            lf::input_t decoded;
+                            get_observation(i, &decoded);
+                            decode_observation(i, &decoded);
+                            learn_updates += solve(i, decoded);
+                        }
+                    }
+
+                    if(config.mode == bin::EXE_MODE_LEARNING) {
+                        util::print_console_fmt("Updates: %d", learn_updates);
+
+                        if(learn_updates == 0) {
+                            util::print_console("Converged.");
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if(config.mode == bin::EXE_MODE_INFERENCE)
+                phillip->write_accuracy(infer_correct, observations.size());
+        }
 
         phillip->write_tuned_parameters();
 
         if (flag_printing)
+        {
             phillip->write_footer();
+            phillip->write_total_metrics();
+        }
+
+        IF_VERBOSE_2(util::format(
+            "Distance cache: %llu hits, %llu misses",
+            phillip->get_num_distance_cache_hits(),
+            phillip->get_num_distance_cache_misses()));
+        IF_VERBOSE_2(util::format(
+            "Axiom cache: %llu hits, %llu misses",
+            phillip->get_num_axiom_cache_hits(),
+            phillip->get_num_axiom_cache_misses()));
+    }
+}
+
+
+void serve(phillip_main_t *phillip)
+{
+    const std::string &path = phillip->param("serve_socket");
+
+    if (path.empty())
+    {
+        /* EACH REQUEST FROM STDIN ENDS WITH A ROOT EXPRESSION
+         * AND ITS RESPONSE IS WRITTEN TO STDOUT. */
+        std::unique_ptr<phillip_main_t> ph(phillip->duplicate());
+        std::string request, line;
+
+        ph->set_output_buffering(true);
+        util::print_console("Serving on stdin ...");
+
+        while (std::getline(std::cin, line))
+        {
+            request += line + "\n";
+
+            if (_is_complete_request(request))
+            {
+                std::cout << _respond(ph.get(), request) << std::flush;
+                request.clear();
+            }
+        }
+        return;
+    }
+
+#ifdef _WIN32
+    throw phillip_exception_t("Unix domain sockets are not supported on Windows.");
+#else
+    /* EACH CONNECTION IS A REQUEST, WHICH ENDS WHEN THE CLIENT SHUTS DOWN WRITING,
+     * AND ITS RESPONSE IS SENT BACK BEFORE THE CONNECTION IS CLOSED.
+     * A CLIENT WHICH DOES NOT FINISH ITS REQUEST IN TIME GETS AN ERROR. */
+    int thread_num = phillip->param_int(
+        "infer_thread_num", std::max<int>(std::thread::hardware_concurrency(), 1));
+    int timeout = phillip->param_int("serve_timeout", 60);
+    util::blocking_queue_t<int> connections(thread_num);
+    std::vector<std::thread> workers;
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(addr.sun_path))
+        throw phillip_exception_t("The path of the socket is too long: " + path);
+    std::strcpy(addr.sun_path, path.c_str());
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw phillip_exception_t("Cannot create a socket.");
+
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 or
+        ::listen(fd, SOMAXCONN) < 0)
+    {
+        ::close(fd);
+        throw phillip_exception_t("Cannot listen on the socket: " + path);
+    }
+
+    for (int i = 0; i < thread_num; ++i)
+    {
+        workers.emplace_back([&]()
+        {
+            std::unique_ptr<phillip_main_t> ph(phillip->duplicate());
+            int conn;
+
+            ph->set_output_buffering(true);
+
+            while (connections.pop(&conn))
+            {
+                std::string request;
+                char buf[4096];
+                ssize_t n;
+                bool has_timed_out(false);
+                auto begin = std::chrono::steady_clock::now();
+
+                while (true)
+                {
+                    // THE TIMEOUT OF EACH RECV IS THE REST OF THE WHOLE TIME LIMIT.
+                    long long rest = timeout * 1000000LL -
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - begin).count();
+
+                    if (timeout > 0)
+                    {
+                        if (rest <= 0)
+                        {
+                            has_timed_out = true;
+                            break;
+                        }
+
+                        timeval tv;
+                        tv.tv_sec = static_cast<time_t>(rest / 1000000);
+                        tv.tv_usec = static_cast<suseconds_t>(rest % 1000000);
+                        ::setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                    }
+
+                    n = ::recv(conn, buf, sizeof(buf), 0);
+
+                    if (n > 0)
+                        request.append(buf, n);
+                    else if (n < 0 and errno == EINTR)
+                        continue;
+                    else
+                    {
+                        has_timed_out = (n < 0 and (errno == EAGAIN or errno == EWOULDBLOCK));
+                        break;
+                    }
+                }
+
+                std::string response = has_timed_out ?
+                    _respond_error(util::format(
+                    "The request was not completed in %d seconds.", timeout)) :
+                    _respond(ph.get(), request);
+                for (size_t sent = 0; sent < response.size(); sent += n)
+                {
+                    n = ::send(conn, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0) break;
+                }
+
+                ::close(conn);
+            }
+        });
+    }
+
+    util::print_console_fmt(
+        "Serving on \"%s\" with %d threads ...", path.c_str(), thread_num);
+
+    while (true)
+    {
+        int conn = ::accept(fd, NULL, NULL);
+
+        if (conn >= 0)
+            connections.push(std::move(conn));
+        else if (errno != EINTR)
+            break;
+    }
+
+    util::print_error("Failed to accept a connection.");
+
+    connections.close();
+    for (auto &th : workers)
+        th.join();
+
+    ::close(fd);
+    ::unlink(path.c_str());
+#endif
+}
+
+
+std::string _respond(phillip_main_t *phillip, const std::string &request)
+{
+    std::ostringstream oss;
+    hash_map<std::string, std::string> files;
+
+    oss << "<response>" << std::endl;
+
+    try
+    {
+        sexp::reader_t reader(request.data(), request.size(), "request");
+        std::vector<lf::input_t> inputs;
+
+        for (; not reader.is_end(); reader.read())
+        {
+            lf::input_t ipt;
+            proc::parse_obs_t::parse(&reader, &ipt);
+            if (not ipt.name.empty())
+                inputs.push_back(ipt);
+        }
+
+        if (not reader.is_balanced())
+            throw phillip_exception_t("Syntax error: too few parentheses.");
+
+        for (auto ipt = inputs.begin(); ipt != inputs.end(); ++ipt)
+        {
+            IF_VERBOSE_1("Serving observation: " + ipt->name);
+
+            phillip->infer(*ipt);
+
+            const std::vector<ilp::ilp_solution_t> &sols = phillip->get_solutions();
+            for (auto sol = sols.begin(); sol != sols.end(); ++sol)
+                sol->print_graph(&oss);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        util::print_warning_fmt("A request was failed: %s", e.what());
+        oss << "<error>" << util::escape_xml(e.what()) << "</error>" << std::endl;
+    }
+
+    // OUTPUTS TO FILES ARE NOT WRITTEN IN SERVE MODE.
+    phillip->take_buffered_outputs(&files);
+
+    oss << "</response>" << std::endl;
+    return oss.str();
+}
+
+
+std::string _respond_error(const std::string &message)
+{
+    util::print_warning_fmt("A request was failed: %s", message.c_str());
+    return
+        "<response>\n<error>" + util::escape_xml(message) +
+        "</error>\n</response>\n";
+}
+
+
+bool _is_complete_request(const std::string &request)
+{
+    try
+    {
+        bool has_root(false);
+        sexp::reader_t reader(request.data(), request.size(), "request");
+
+        for (; not reader.is_end(); reader.read())
+            has_root = has_root or reader.is_root();
+
+        return has_root and reader.is_balanced();
+    }
+    catch (const std::exception&)
+    {
+        // LET _respond() REPORT THE ERROR.
+        return true;
     }
 }
 
@@ -428,6 +1282,10 @@ bool _interpret_option(
                 config->mode = EXE_MODE_INFERENCE;
             else if (arg == "compile_kb" or arg == "compile")
                 config->mode = EXE_MODE_COMPILE_KB;
+            else if (arg == "compile_obs")
+                config->mode = EXE_MODE_COMPILE_OBS;
+            else if (arg == "serve")
+                config->mode = EXE_MODE_SERVE;
             else if (arg == "learning" or arg == "learn")
                 config->mode = EXE_MODE_LEARNING;
             else
@@ -461,6 +1319,11 @@ bool _interpret_option(
                 phillip->set_param("path_sol_out", util::normalize_path(val));
                 return true;
             }
+            else if (key == "metrics")
+            {
+                phillip->set_param("path_metrics_out", util::normalize_path(val));
+                return true;
+            }
             else
                 return false;
         }
@@ -529,6 +1392,8 @@ bool _interpret_option(
         {
             phillip->set_param("kb_thread_num", spl[0]);
             phillip->set_param("gurobi_thread_num", spl[0]);
+            phillip->set_param("parse_thread_num", spl[0]);
+            phillip->set_param("infer_thread_num", spl[0]);
             return true;
         }
         else if (spl.size() == 2)
@@ -543,6 +1408,21 @@ bool _interpret_option(
                 phillip->set_param("gurobi_thread_num", spl[1]);
                 return true;
             }
+            else if (spl[0] == "parse")
+            {
+                phillip->set_param("parse_thread_num", spl[1]);
+                return true;
+            }
+            else if (spl[0] == "infer")
+            {
+                phillip->set_param("infer_thread_num", spl[1]);
+                return true;
+            }
+            else if (spl[0] == "lhs" or spl[0] == "ilp" or spl[0] == "sol" or spl[0] == "choice")
+            {
+                phillip->set_param(spl[0] + "_thread_num", spl[1]);
+                return true;
+            }
             else
                 return false;
         }
@@ -594,6 +1474,10 @@ bool preprocess(const execution_configure_t &config, phillip_main_t *phillip)
     float max_dist = phillip->param_float("kb_max_distance", -1.0);
     int thread_num = phillip->param_int("kb_thread_num", 1);
     bool disable_stop_word = phillip->flag("disable_stop_word");
+    int cache_size = phillip->param_int(
+        "distance_cache_size", kb::DEFAULT_DISTANCE_CACHE_SIZE / (1024 * 1024));
+    int axiom_cache_size = phillip->param_int(
+        "axiom_cache_size", kb::DEFAULT_AXIOM_CACHE_SIZE);
     std::string dist_key = config.dist_key.empty() ? "basic" : config.dist_key;
     std::string tab_key = config.tab_key.empty() ? "null" : config.tab_key;
 
@@ -613,7 +1497,9 @@ bool preprocess(const execution_configure_t &config, phillip_main_t *phillip)
         generate(config.sol_key, phillip);
 
     kb::knowledge_base_t::setup(
-        config.kb_name, max_dist, thread_num, disable_stop_word);
+        config.kb_name, max_dist, thread_num, disable_stop_word,
+        static_cast<size_t>(std::max(cache_size, 0)) * 1024 * 1024,
+        static_cast<size_t>(std::max(axiom_cache_size, 0)));
     kb::knowledge_base_t::instance()->set_distance_provider(dist_key, phillip);
     kb::knowledge_base_t::instance()->set_category_table(tab_key, phillip);
 
@@ -621,11 +1507,13 @@ bool preprocess(const execution_configure_t &config, phillip_main_t *phillip)
     {
     case EXE_MODE_INFERENCE:
     case EXE_MODE_LEARNING:
+    case EXE_MODE_SERVE:
         if (lhs != NULL) phillip->set_lhs_enumerator(lhs);
         if (ilp != NULL) phillip->set_ilp_convertor(ilp);
         if (sol != NULL) phillip->set_ilp_solver(sol);
         return true;
     case EXE_MODE_COMPILE_KB:
+    case EXE_MODE_COMPILE_OBS:
         return true;
     default:
         return false;
@@ -642,14 +1530,20 @@ void print_usage()
         "",
         "  Mode:",
         "    -m {compile_kb|compile} : Compiling knowledge-base mode.",
+        "    -m compile_obs : Compiling observations into a binary file given by -o.",
         "    -m {inference|infer} : Inference mode.",
         "    -m {learning|learn} : Learning mode.",
+        "    -m serve : Serving mode, which solves observations sent through stdin or a socket.",
         "",
         "  Common Options:",
         "    -l <NAME> : Loads a config-file.",
         "    -p <NAME>=<VALUE> : Sets a parameter.",
         "    -f <NAME> : Sets a flag.",
         "    -t <INT> : Sets the number of threads for parallelization.",
+        "    -P parse=<INT> : Sets the number of threads for parsing inputs.",
+        "    -P infer=<INT> : Sets the number of threads for solving observations in inference mode.",
+        "    -P {lhs|ilp|sol}=<INT> : Sets the number of threads for each stage in -f pipeline.",
+        "    -P choice=<INT> : Sets the number of threads for inferring instantiations of :choice.",
         "    -v <INT> : Sets verbosity (0 ~ 5).",
         "    -h : Prints simple usage.",
         "",
@@ -657,6 +1551,7 @@ void print_usage()
         "    -c dist=<NAME> : Sets a component to define relatedness between predicates.",
         "    -c tab=<NAME> : Sets a component for making category-table.",
         "    -k <NAME> : Sets the prefix of the path of the compiled knowledge base.",
+        "    -f append_kb : Appends axioms to the compiled knowledge base instead of re-compiling it.",
         "",
         "  Options in inference-mode or learning-mode:",
         "    -c lhs=<NAME> : Sets a component for making latent hypotheses sets.",
@@ -667,6 +1562,7 @@ void print_usage()
         "    -o lhs=<PATH> : Prints the XML of the latent hypothesis set for debug to the given file path.",
         "    -o ilp=<PATH> : Prints the XML of the ILP problem for debug to the given file path.",
         "    -o sol=<PATH> : Prints the XML of the ILP solution for debug to the given file path.",
+        "    -o metrics=<PATH> : Prints metrics of each input and of the whole run to the given file path in JSON lines.",
         "    -t <NAME> : Solves only the observation of corresponding name.",
         "    -t !<NAME> : Excludes the observation which corresponds with given name.",
         "    -G : Forces to satisfy the requirements.",
@@ -675,6 +1571,18 @@ void print_usage()
         "    -T lhs=<INT> : Sets timeout of the creation of latent hypotheses sets in seconds.",
         "    -T ilp=<INT> : Sets timeout of the conversion into ILP problem in seconds.",
         "    -T sol=<INT> : Sets timeout of the optimization of ILP problem in seconds.",
+        "    -p distance_cache_size=<INT> : Sets the memory cap of the distance cache in MB.",
+        "    -p axiom_cache_size=<INT> : Sets the max number of decoded axioms to be cached.",
+        "    -f stream_obs : Solves each observation as soon as it is parsed, without loading all of them.",
+        "    -p stream_queue_size=<INT> : Sets the max number of observations waiting to be solved in -f stream_obs.",
+        "    -p reorder_buffer_size=<INT> : Sets the max number of results waiting to be written in parallel inference.",
+        "    -f pipeline : Overlaps enumeration, conversion and optimization of successive observations.",
+        "    -p pipeline_queue_size=<INT> : Sets the max number of inputs waiting between stages in -f pipeline.",
+        "",
+        "  Options in serve-mode (in addition to options in inference-mode):",
+        "    -p serve_socket=<PATH> : Serves requests on the Unix domain socket instead of stdin.",
+        "    -P infer=<INT> : Sets the number of requests solved at the same time on the socket.",
+        "    -p serve_timeout=<INT> : Sets the time limit in seconds to receive a request on the socket (default: 60, 0 for no limit).",
         "",
         "  Wiki: https://github.com/kazeto/phillip/wiki"};
 
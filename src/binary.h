@@ -6,6 +6,11 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <map>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <exception>
 
 #include "./phillip.h"
 #include "./lhs/lhs_enumerator.h"
@@ -29,7 +34,9 @@ enum execution_mode_e
     EXE_MODE_INFERENCE,
     EXE_MODE_LEARNING,
     EXE_MODE_HELP,
-    EXE_MODE_COMPILE_KB
+    EXE_MODE_COMPILE_KB,
+    EXE_MODE_COMPILE_OBS,
+    EXE_MODE_SERVE
 };
 
 
@@ -159,6 +166,12 @@ void execute(
     const execution_configure_t &config, const inputs_t &inputs);
 
 
+/** The sub-routine of bin::execute in serve mode.
+ *  Keeps the knowledge-base loaded and solves observations sent by clients
+ *  through the Unix domain socket given by "serve_socket", or through stdin. */
+void serve(phillip_main_t *phillip);
+
+
 /** The sub-routine of bin::prepare, which parses command line options.
  *  @param[out] option Options about binary execution.
  *  @param[out] inputs List of input filenames. */
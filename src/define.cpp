@@ -2,6 +2,7 @@
 
 #include <cstring>
 #include <cassert>
+#include <cmath>
 #include <errno.h>
 
 #include "./define.h"
@@ -10,6 +11,9 @@
 #include <direct.h>
 #else
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 const int FAILURE_MKDIR = -1;
@@ -18,26 +22,61 @@ const int FAILURE_MKDIR = -1;
 namespace phil
 {
 
-std::mutex string_hash_t::ms_mutex_hash;
-std::mutex string_hash_t::ms_mutex_unknown;
-hash_map<std::string, unsigned> string_hash_t::ms_hashier;
-std::vector<std::string> string_hash_t::ms_strs;
-unsigned string_hash_t::ms_issued_variable_count = 0;
+string_hash_t::shard_t string_hash_t::ms_shards[string_hash_t::NUM_SHARDS];
+std::atomic<std::string*> string_hash_t::ms_chunks[string_hash_t::NUM_CHUNKS];
+std::atomic<unsigned> string_hash_t::ms_num_strs(0);
+thread_local unsigned string_hash_t::ms_issued_variable_count = 0;
+
+
+unsigned string_hash_t::get_hash_from_shard(const std::string &str, size_t key)
+{
+    shard_t &sh = ms_shards[key % NUM_SHARDS];
+    std::lock_guard<std::mutex> lock(sh.mutex);
+
+    auto found = sh.hashier.find(str);
+    if (found != sh.hashier.end())
+        return found->second;
+
+    unsigned idx = ms_num_strs++;
+    if (idx >= EMPTY_HASH)
+        throw phillip_exception_t("Too many strings are interned.");
+
+    std::atomic<std::string*> &chunk = ms_chunks[idx >> CHUNK_BITS];
+    std::string *strs = chunk.load(std::memory_order_acquire);
+
+    // THE CHUNK MAY BE ALLOCATED BY A THREAD WORKING ON ANOTHER SHARD.
+    if (strs == NULL)
+    {
+        std::string *created = new std::string[CHUNK_SIZE];
+        if (chunk.compare_exchange_strong(strs, created, std::memory_order_acq_rel))
+            strs = created;
+        else
+            delete[] created;
+    }
+
+    // THE STRING IS WRITTEN BEFORE ITS HASH IS PUBLISHED.
+    strs[idx & (CHUNK_SIZE - 1)] = str;
+    sh.hashier[str] = idx;
+
+    return idx;
+}
 
 
 literal_t::literal_t(const sexp::stack_t &s)
-    : truth(true)
+    : truth(true), m_arity_id(0)
 {
+    std::string pred;
+
     if (s.is_functor())
     {
-        const std::string &str = s.children[0]->children[0]->str;
+        const sexp::string_view_t &str = s.children[0]->children[0]->str;
         if (str.at(0) == '!')
         {
             truth = false;
-            predicate = predicate_t(str.substr(1));
+            pred.assign(str.data() + 1, str.size() - 1);
         }
         else
-            predicate = predicate_t(str);
+            pred.assign(str.data(), str.size());
 
         for (int i = 1; i < s.children.size(); i++)
         {
@@ -49,16 +88,17 @@ literal_t::literal_t(const sexp::stack_t &s)
         }
     }
     else
-        predicate = s.children[0]->str;
+        pred = s.children[0]->str.to_string();
 
-    if (predicate.length() >= 255)
+    if (pred.length() >= 255)
     {
         util::print_warning_fmt(
             "Following predicate is too long and shortened: \"%s\"",
-            predicate.c_str());
-        predicate = predicate.substr(0, 250);
+            pred.c_str());
+        pred = pred.substr(0, 250);
     }
 
+    predicate = predicate_t(pred);
     regularize();
 }
 
@@ -66,7 +106,8 @@ literal_t::literal_t(const sexp::stack_t &s)
 bool literal_t::operator > (const literal_t &x) const
 {
     if (truth != x.truth) return truth;
-    if (predicate != x.predicate) return (predicate > x.predicate);
+    if (predicate != x.predicate)
+        return (predicate.string() > x.predicate.string());
     if (terms.size() != x.terms.size())
         return (terms.size() > x.terms.size());
 
@@ -82,7 +123,8 @@ bool literal_t::operator > (const literal_t &x) const
 bool literal_t::operator < (const literal_t &x) const
 {
     if (truth != x.truth) return not truth;
-    if (predicate != x.predicate) return (predicate < x.predicate);
+    if (predicate != x.predicate)
+        return (predicate.string() < x.predicate.string());
     if (terms.size() != x.terms.size())
         return (terms.size() < x.terms.size());
 
@@ -134,13 +176,13 @@ void literal_t::print( std::string *p_out_str, bool f_colored ) const
     if( not truth ) (*p_out_str) += "!";
 
 #ifdef _WIN32
-    (*p_out_str) += predicate;
+    (*p_out_str) += predicate.string();
 #else
     if( f_colored )
         (*p_out_str) +=
-            util::format( "\33[40m%s\33[0m", predicate.c_str() );
+            util::format( "\33[40m%s\33[0m", predicate.string().c_str() );
     else
-        (*p_out_str) += predicate;
+        (*p_out_str) += predicate.string();
 #endif
 
     for( int i=0; i<terms.size(); i++ )
@@ -168,7 +210,7 @@ size_t literal_t::write_binary(char *bin) const
 {
     size_t n(0);
 
-    n += util::string_to_binary(predicate, bin);
+    n += util::string_to_binary(predicate.string(), bin);
 
     /* terms */
     n += util::num_to_binary(terms.size(), bin + n);
@@ -199,6 +241,7 @@ size_t literal_t::read_binary( const char *bin )
     }
 
     n += util::binary_to_bool(bin + n, &truth);
+    update_arity();
 
     return n;
 }
@@ -222,7 +265,7 @@ namespace util
 
 
 cdb_data_t::cdb_data_t(std::string _filename)
-    : m_filename(_filename), m_fout(NULL), m_fin(NULL),
+    : m_filename(_filename), m_fout(NULL),
       m_builder(NULL), m_finder(NULL)
 {}
 
@@ -257,14 +300,12 @@ void cdb_data_t::prepare_query()
 
     if (not is_readable())
     {
-        m_fin = new std::ifstream(
-            m_filename.c_str(), std::ios_base::binary);
-        if (m_fin->fail())
+        if (not m_mapped.open(m_filename))
             throw phillip_exception_t(
             "Failed to open a database file: " + m_filename);
         else
         {
-            m_finder = new cdbpp::cdbpp(*m_fin);
+            m_finder = new cdbpp::cdbpp(m_mapped.data(), m_mapped.size(), false);
 
             if (not m_finder->is_open())
                 throw phillip_exception_t(
@@ -293,11 +334,153 @@ void cdb_data_t::finalize()
         m_finder = NULL;
     }
 
-    if (m_fin != NULL)
+    m_mapped.close();
+}
+
+
+void cdb_data_t::enumerate(const std::function<void(
+    const char *key, size_t ksize, const char *value, size_t vsize)> &proc) const
+{
+    /* A CDB++ FILE CONSISTS OF A HEADER, RECORDS AND HASH-TABLES.
+     * EACH RECORD IS [KEY-SIZE][KEY][VALUE-SIZE][VALUE]
+     * AND THE RECORDS END AT THE OFFSET OF THE FIRST HASH-TABLE. */
+    const size_t HEADER_SIZE = 16;
+    const size_t TABLE_REF_SIZE = sizeof(uint32_t) * 2;
+    mapped_file_t file(m_filename);
+
+    if (not file.is_open())
+        throw phillip_exception_t("Failed to open a database file: " + m_filename);
+
+    const char *data = file.data();
+    const size_t begin = HEADER_SIZE + TABLE_REF_SIZE * cdbpp::NUM_TABLES;
+
+    if (file.size() < begin or std::memcmp(data, "CDB+", 4) != 0)
+        throw phillip_exception_t("Failed to read a database file: " + m_filename);
+
+    // HASH-TABLES ARE WRITTEN IN ORDER, SO THE FIRST ONE HAS THE LOWEST OFFSET.
+    size_t end = begin;
+    for (size_t i = 0; i < cdbpp::NUM_TABLES; ++i)
+    {
+        uint32_t offset;
+        std::memcpy(&offset, data + HEADER_SIZE + TABLE_REF_SIZE * i, sizeof(uint32_t));
+        if (offset != 0)
+        {
+            end = std::min<size_t>(file.size(), offset);
+            break;
+        }
+    }
+
+    for (size_t pos = begin; pos + sizeof(uint32_t) <= end;)
+    {
+        uint32_t ksize, vsize;
+
+        std::memcpy(&ksize, data + pos, sizeof(uint32_t));
+        const char *key = data + pos + sizeof(uint32_t);
+        pos += sizeof(uint32_t) + ksize;
+
+        std::memcpy(&vsize, data + pos, sizeof(uint32_t));
+        const char *value = data + pos + sizeof(uint32_t);
+        pos += sizeof(uint32_t) + vsize;
+
+        if (pos > end)
+            throw phillip_exception_t("Broken database file: " + m_filename);
+
+        proc(key, ksize, value, vsize);
+    }
+}
+
+
+mapped_file_t::mapped_file_t(const std::string &filename)
+    : m_data(NULL), m_size(0), m_is_mapped(false)
+{
+    open(filename);
+}
+
+
+mapped_file_t::~mapped_file_t()
+{
+    close();
+}
+
+
+bool mapped_file_t::open(const std::string &filename)
+{
+    close();
+
+#ifdef _WIN32
+    std::ifstream fi(filename.c_str(), std::ios::binary | std::ios::in);
+    if (fi.fail()) return false;
+
+    fi.seekg(0, std::ios_base::end);
+    std::streamoff size = fi.tellg();
+    fi.seekg(0, std::ios_base::beg);
+    if (size < 0) return false;
+
+    // THE CALLER REPORTS A FILE WHICH IS NOT READ WHOLLY, AS WITH A FAILED mmap.
+    char *buf = new char[static_cast<size_t>(size) + 1];
+    fi.read(buf, size);
+    if (fi.gcount() != size)
+    {
+        delete[] buf;
+        return false;
+    }
+
+    m_size = static_cast<size_t>(size);
+    m_data = buf;
+    m_is_mapped = false;
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    m_size = static_cast<size_t>(st.st_size);
+
+    if (m_size > 0)
+    {
+        void *p = ::mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            m_size = 0;
+            return false;
+        }
+        m_data = static_cast<const char*>(p);
+        m_is_mapped = true;
+    }
+    else
     {
-        delete m_fin;
-        m_fin = NULL;
+        /* mmap REJECTS EMPTY FILES, SO USE A DUMMY BUFFER. */
+        m_data = new char[1];
+        m_is_mapped = false;
     }
+
+    ::close(fd);
+#endif
+
+    return true;
+}
+
+
+void mapped_file_t::close()
+{
+    if (m_data == NULL) return;
+
+#ifndef _WIN32
+    if (m_is_mapped)
+        ::munmap(const_cast<char*>(m_data), m_size);
+    else
+#endif
+        delete[] m_data;
+
+    m_data = NULL;
+    m_size = 0;
+    m_is_mapped = false;
 }
 
 
@@ -325,6 +508,215 @@ void xml_element_t::print(std::ostream *os) const
 }
 
 
+void sparse_bitset_t::merge(const sparse_bitset_t &x)
+{
+    if (x.empty()) return;
+
+    std::vector<block_t> merged;
+    auto it1 = m_blocks.begin();
+    auto it2 = x.m_blocks.begin();
+
+    merged.reserve(m_blocks.size() + x.m_blocks.size());
+    while (it1 != m_blocks.end() or it2 != x.m_blocks.end())
+    {
+        if (it2 == x.m_blocks.end() or
+            (it1 != m_blocks.end() and it1->index < it2->index))
+            merged.push_back(*(it1++));
+        else if (it1 == m_blocks.end() or it2->index < it1->index)
+            merged.push_back(*(it2++));
+        else
+        {
+            merged.push_back(block_t{ it1->index, it1->bits | it2->bits });
+            ++it1; ++it2;
+        }
+    }
+
+    m_blocks.swap(merged);
+}
+
+
+worker_pool_t::worker_pool_t(int num_thread)
+    : m_proc(NULL), m_num_tasks(0), m_num_issued(0), m_num_done(0),
+      m_is_stopped(false)
+{
+    for (int i = 0; i < num_thread; ++i)
+    {
+        m_workers.emplace_back([this]()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            while (true)
+            {
+                m_cond_task.wait(lock, [this]() {
+                    return m_is_stopped or m_num_issued < m_num_tasks; });
+                if (m_is_stopped) return;
+
+                int i = m_num_issued++;
+                lock.unlock();
+
+                std::exception_ptr e;
+                try { (*m_proc)(i); }
+                catch (...) { e = std::current_exception(); }
+
+                lock.lock();
+                if (e and not m_error) m_error = e;
+                if (++m_num_done == m_num_tasks)
+                    m_cond_done.notify_all();
+            }
+        });
+    }
+}
+
+
+worker_pool_t::~worker_pool_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_is_stopped = true;
+    }
+    m_cond_task.notify_all();
+
+    for (auto &t : m_workers) t.join();
+}
+
+
+void worker_pool_t::run(int num, const std::function<void(int)> &proc)
+{
+    if (num <= 0) return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_proc = &proc;
+    m_num_tasks = num;
+    m_num_issued = m_num_done = 0;
+    m_error = std::exception_ptr();
+    m_cond_task.notify_all();
+
+    m_cond_done.wait(lock, [this]() { return m_num_done == m_num_tasks; });
+
+    // LATER WORKERS WAKE UP ONLY BY THE NEXT CALL.
+    m_num_tasks = m_num_issued = m_num_done = 0;
+    m_proc = NULL;
+
+    if (m_error)
+    {
+        std::exception_ptr e = m_error;
+        m_error = std::exception_ptr();
+        std::rethrow_exception(e);
+    }
+}
+
+
+thread_local metrics_t *metrics_t::ms_current = NULL;
+
+
+void metrics_t::histogram_t::add(double value)
+{
+    if (count == 0 or value < min) min = value;
+    if (count == 0 or value > max) max = value;
+    ++count;
+    sum += value;
+
+    int k = INT_MIN;
+    if (value > 0.0) std::frexp(value, &k);
+    ++buckets[k];
+}
+
+
+void metrics_t::histogram_t::merge(const histogram_t &x)
+{
+    if (x.count == 0) return;
+
+    if (count == 0 or x.min < min) min = x.min;
+    if (count == 0 or x.max > max) max = x.max;
+    count += x.count;
+    sum += x.sum;
+
+    for (auto it = x.buckets.begin(); it != x.buckets.end(); ++it)
+        buckets[it->first] += it->second;
+}
+
+
+void metrics_t::merge(const metrics_t &x)
+{
+    for (auto it = x.m_counters.begin(); it != x.m_counters.end(); ++it)
+        m_counters[it->first] += it->second;
+
+    for (auto it = x.m_histograms.begin(); it != x.m_histograms.end(); ++it)
+        m_histograms[it->first].merge(it->second);
+}
+
+
+void metrics_t::print_json(
+    std::ostream *os, const std::string &scope, const std::string &name) const
+{
+    auto quote = [](const std::string &str) -> std::string
+    {
+        std::string out("\"");
+        for (auto c : str)
+        {
+            if (c == '"' or c == '\\') out += '\\';
+            if (static_cast<unsigned char>(c) < 0x20)
+                out += format("\\u%04x", c);
+            else
+                out += c;
+        }
+        return out + "\"";
+    };
+    auto number = [](double v) -> std::string { return format("%.9g", v); };
+
+    (*os) << "{\"scope\":" << quote(scope) << ",\"name\":" << quote(name);
+
+    (*os) << ",\"counters\":{";
+    for (auto it = m_counters.begin(); it != m_counters.end(); ++it)
+        (*os) << (it == m_counters.begin() ? "" : ",")
+              << quote(it->first) << ":" << it->second;
+    (*os) << "}";
+
+    // HIT RATES OF CACHES
+    const std::string HITS(".hits"), MISSES(".misses");
+    bool is_first(true);
+
+    (*os) << ",\"rates\":{";
+    for (auto it = m_counters.begin(); it != m_counters.end(); ++it)
+    {
+        if (not endswith(it->first, HITS)) continue;
+
+        std::string prefix = it->first.substr(0, it->first.size() - HITS.size());
+        auto found = m_counters.find(prefix + MISSES);
+        long long misses = (found != m_counters.end()) ? found->second : 0;
+        long long total = it->second + misses;
+
+        if (total == 0) continue;
+
+        (*os) << (is_first ? "" : ",") << quote(prefix + ".hit_rate") << ":"
+              << number(static_cast<double>(it->second) / total);
+        is_first = false;
+    }
+    (*os) << "}";
+
+    (*os) << ",\"histograms\":{";
+    for (auto it = m_histograms.begin(); it != m_histograms.end(); ++it)
+    {
+        const histogram_t &h = it->second;
+
+        (*os) << (it == m_histograms.begin() ? "" : ",") << quote(it->first)
+              << ":{\"count\":" << h.count
+              << ",\"sum\":" << number(h.sum)
+              << ",\"min\":" << number(h.min)
+              << ",\"max\":" << number(h.max)
+              << ",\"buckets\":[";
+
+        // EACH BUCKET IS PRINTED AS A PAIR OF ITS UPPER BOUND AND THE COUNT.
+        for (auto b = h.buckets.begin(); b != h.buckets.end(); ++b)
+            (*os) << (b == h.buckets.begin() ? "" : ",") << "["
+                  << number((b->first == INT_MIN) ? 0.0 : std::ldexp(1.0, b->first))
+                  << "," << b->second << "]";
+        (*os) << "]}";
+    }
+    (*os) << "}}" << std::endl;
+}
+
+
 const int BUFFER_SIZE_FOR_FMT = 256 * 256;
 
 struct { int year, month, day, hour, minuite, second; } TIME_BEGIN;
@@ -517,6 +909,28 @@ std::string strip(const std::string &input, const char *targets)
 }
 
 
+std::string escape_xml(const std::string &input)
+{
+    std::string out;
+    out.reserve(input.size());
+
+    for (char c : input)
+    {
+        switch (c)
+        {
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '&': out += "&amp;"; break;
+        case '"': out += "&quot;"; break;
+        case '\'': out += "&apos;"; break;
+        default: out += c;
+        }
+    }
+
+    return out;
+}
+
+
 bool startswith(const std::string &str, const std::string &query)
 {
     if (query.size() <= str.size())
@@ -538,7 +952,7 @@ bool endswith(const std::string &str, const std::string &query)
     if (query.size() <= str.size())
     {
         int q = query.size() - 1;
-        int s = query.size() - 1;
+        int s = str.size() - 1;
         for (int i = 0; i < query.size(); ++i)
         {
             if (query.at(q - i) != str.at(s - i))
@@ -7,18 +7,29 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <climits>
+#include <cstdint>
 #include <chrono>
 #include <sys/stat.h>
 #include <iostream>
 #include <initializer_list>
 #include <vector>
 #include <list>
+#include <map>
+#include <iterator>
+#include <algorithm>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <exception>
 
 #include "./lib/cdbpp.h"
@@ -48,16 +59,37 @@ typedef unsigned char small_size_t;
 typedef long int index_t;
 typedef long int axiom_id_t;
 typedef small_size_t term_idx_t;
-typedef std::string predicate_t;
 typedef std::string arity_t;
 typedef float duration_time_t;
 
+/** A read-only view of a contiguous array. */
+template <class T> class array_span_t
+{
+public:
+    typedef const T* const_iterator;
+
+    array_span_t() : m_begin(NULL), m_end(NULL) {}
+    array_span_t(const T *begin, const T *end) : m_begin(begin), m_end(end) {}
+
+    inline const_iterator begin() const { return m_begin; }
+    inline const_iterator end() const { return m_end; }
+    inline const T& operator[](size_t i) const { return m_begin[i]; }
+
+    inline size_t size() const { return m_end - m_begin; }
+    inline bool empty() const { return m_begin == m_end; }
+
+private:
+    const T *m_begin, *m_end;
+};
+
+
 namespace kb
 {
 class knowledge_base_t;
 
 typedef unsigned long int argument_set_id_t;
 typedef size_t arity_id_t;
+typedef unsigned int pattern_id_t;
 
 typedef std::pair<index_t, term_idx_t> term_pos_t;
 typedef std::tuple<
@@ -80,6 +112,81 @@ soft_unifiable_literal_indices(const arity_pattern_t &p)
 inline bool is_backward(std::pair<axiom_id_t, bool> &p)
 { return p.second; }
 
+
+/** Decoders of records in values of the databases. */
+template <class T> struct record_decoder_t;
+
+template <> struct record_decoder_t<axiom_id_t>
+{
+    static const size_t SIZE = sizeof(axiom_id_t);
+    static inline axiom_id_t decode(const char *p)
+    {
+        axiom_id_t id;
+        std::memcpy(&id, p, sizeof(axiom_id_t));
+        return id;
+    }
+};
+
+
+/** A read-only view of an array of records in a value of a database,
+ *  which begins with the number of records.
+ *  Records are decoded on access, so that no allocation is needed.
+ *  The view points into the memory-mapped database,
+ *  so it is valid while the knowledge-base is readable. */
+template <class T> class record_span_t
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef T reference;
+
+        const_iterator(const char *ptr) : m_ptr(ptr) {}
+
+        inline T operator*() const { return record_decoder_t<T>::decode(m_ptr); }
+        inline const_iterator& operator++() { m_ptr += record_decoder_t<T>::SIZE; return *this; }
+        inline const_iterator operator++(int) { const_iterator x(*this); ++(*this); return x; }
+        inline bool operator==(const const_iterator &x) const { return m_ptr == x.m_ptr; }
+        inline bool operator!=(const const_iterator &x) const { return m_ptr != x.m_ptr; }
+
+    private:
+        const char *m_ptr;
+    };
+
+    record_span_t() : m_begin(NULL), m_size(0) {}
+
+    /** @param value A value of a database, which can be NULL. */
+    record_span_t(const char *value) : m_begin(NULL), m_size(0)
+    {
+        if (value != NULL)
+        {
+            std::memcpy(&m_size, value, sizeof(size_t));
+            m_begin = value + sizeof(size_t);
+        }
+    }
+
+    inline const_iterator begin() const { return const_iterator(m_begin); }
+    inline const_iterator end() const
+    { return const_iterator(m_begin + m_size * record_decoder_t<T>::SIZE); }
+
+    inline size_t size() const { return m_size; }
+    inline bool empty() const { return m_size == 0; }
+
+private:
+    const char *m_begin;
+    size_t m_size;
+};
+
+typedef record_span_t<axiom_id_t> axiom_id_span_t;
+
+
+typedef array_span_t<std::pair<axiom_id_t, bool> > axiom_direction_span_t;
+
+
 }
 
 namespace pg
@@ -89,6 +196,10 @@ namespace pg
     typedef index_t edge_idx_t;
     typedef index_t hypernode_idx_t;
     typedef int depth_t;
+
+    typedef array_span_t<node_idx_t> node_span_t;
+    typedef array_span_t<edge_idx_t> edge_span_t;
+    typedef array_span_t<hypernode_idx_t> hypernode_span_t;
 }
 
 
@@ -106,6 +217,9 @@ enum verboseness_t
 class string_hash_t
 {
 public:
+    /** Returns a new variable such as "_u1".
+     *  The count is held by each thread, so that observations solved
+     *  on different threads get the same variables as solved alone. */
     static inline string_hash_t get_unknown_hash();
     static inline void reset_unknown_hash_count();
 
@@ -133,13 +247,45 @@ public:
     inline bool is_hard_term() const { return m_is_hard_term; }
 
 private:
-    /** Assign a hash to str if needed, and return the hash of str. */
-    static inline unsigned get_hash(std::string str);
+    /** Assign a hash to str if needed, and return the hash of str.
+     *  Recently used strings are cached for each thread. */
+    static inline unsigned get_hash(const std::string &str);
+
+    /** Looks up or interns str in the shard which str belongs to. */
+    static unsigned get_hash_from_shard(const std::string &str, size_t key);
+
+    /** Returns the string of given hash without locking. */
+    static inline const std::string& get_string(unsigned hash);
+
+    /** The hash of the empty string, which is never stored in chunks. */
+    static const unsigned EMPTY_HASH = UINT_MAX;
 
-    static std::mutex ms_mutex_hash, ms_mutex_unknown;
-    static hash_map<std::string, unsigned> ms_hashier;
-    static std::vector<std::string> ms_strs;
-    static unsigned ms_issued_variable_count;
+    static const unsigned CHUNK_BITS = 16;
+    static const unsigned CHUNK_SIZE = (1u << CHUNK_BITS);
+    static const unsigned NUM_CHUNKS = (1u << 16);
+    static const size_t NUM_SHARDS = 64;
+    static const size_t FRONT_CACHE_SIZE = 256;
+
+    struct shard_t
+    {
+        std::mutex mutex;
+        hash_map<std::string, unsigned> hashier;
+    };
+
+    struct front_cache_entry_t
+    {
+        front_cache_entry_t() : hash(UINT_MAX) {}
+        std::string str;
+        unsigned hash;
+    };
+
+    static shard_t ms_shards[NUM_SHARDS];
+
+    /** Interned strings are stored in chunks, which are allocated on demand
+     *  and never moved, so that they can be read without locking. */
+    static std::atomic<std::string*> ms_chunks[NUM_CHUNKS];
+    static std::atomic<unsigned> ms_num_strs;
+    static thread_local unsigned ms_issued_variable_count;
 
     inline void set_flags(const std::string &str);
 
@@ -153,6 +299,7 @@ private:
 
 
 typedef string_hash_t term_t;
+typedef string_hash_t predicate_t;
 typedef std::pair<term_t, term_t> substitution_t;
 
 
@@ -160,14 +307,59 @@ typedef std::pair<term_t, term_t> substitution_t;
 class literal_t
 {
 public:
+    static const int MAX_ARGUMENTS_NUM = 12;
+
+    /** An array of terms stored inline, with at most MAX_ARGUMENTS_NUM terms. */
+    class term_array_t
+    {
+    public:
+        typedef term_t* iterator;
+        typedef const term_t* const_iterator;
+
+        inline term_array_t() : m_size(0) {}
+        inline term_array_t(const term_array_t &x);
+        inline term_array_t(const std::vector<term_t> &x);
+
+        inline term_array_t& operator=(const term_array_t &x);
+
+        inline size_t size() const { return m_size; }
+        inline bool empty() const { return m_size == 0; }
+
+        inline term_t& operator[](size_t i) { return m_terms[i]; }
+        inline const term_t& operator[](size_t i) const { return m_terms[i]; }
+        inline term_t& at(size_t i);
+        inline const term_t& at(size_t i) const;
+
+        inline term_t& front() { return m_terms[0]; }
+        inline const term_t& front() const { return m_terms[0]; }
+        inline term_t& back() { return m_terms[m_size - 1]; }
+        inline const term_t& back() const { return m_terms[m_size - 1]; }
+
+        inline iterator begin() { return m_terms; }
+        inline iterator end() { return m_terms + m_size; }
+        inline const_iterator begin() const { return m_terms; }
+        inline const_iterator end() const { return m_terms + m_size; }
+
+        inline void push_back(const term_t &t);
+        inline void assign(size_t n, const term_t &t);
+        inline void clear() { m_size = 0; }
+
+    private:
+        term_t m_terms[MAX_ARGUMENTS_NUM];
+        small_size_t m_size;
+    };
+
     static inline std::string get_arity(
         const predicate_t &pred, int term_num, bool is_negated);
 
-    inline literal_t() {}
+    inline literal_t();
     inline literal_t(const std::string &_pred, bool _truth = true);
     inline literal_t(
         predicate_t _predicate, const std::vector<term_t> _terms,
         bool _truth = true);
+    inline literal_t(
+        const predicate_t &_predicate, const term_array_t &_terms,
+        bool _truth = true);
     inline literal_t(
         const std::string &_predicate, const std::vector<term_t> _terms,
         bool _truth = true);
@@ -184,6 +376,9 @@ public:
         const std::string &term1, const std::string &term2,
         bool _truth = true);
     literal_t(const sexp::stack_t &s);
+    inline literal_t(const literal_t &x);
+
+    inline literal_t& operator=(const literal_t &x);
 
     bool operator > (const literal_t &x) const;
     bool operator < (const literal_t &x) const;
@@ -191,26 +386,52 @@ public:
     bool operator != (const literal_t &x) const;
 
     inline std::string to_string(bool f_colored = false) const;
-    inline std::string get_arity() const;
+
+    /** Returns the arity of this literal.
+     *  The arity is cached on construction, so no string is built here
+     *  unless the literal has been modified afterwards.
+     *  The cache is never refreshed here, so that this is thread-safe. */
+    inline const std::string& get_arity() const;
+
+    /** Returns the id of the arity in the knowledge-base loaded now.
+     *  The id is looked up on the first call and cached until the arity-database
+     *  is modified. It is not cached for a literal modified after construction.
+     *  This is defined in kb.inline.h. */
+    inline kb::arity_id_t get_arity_id() const;
+
     inline std::string get_arity_with_all_constants() const;
     inline std::vector<std::string> get_arity_with_constants() const;
 
     inline bool is_valid() const;
-    inline bool is_equality() const { return predicate == "="; }
+    inline bool is_equality() const;
 
     size_t write_binary(char *bin) const;
     size_t read_binary(const char *bin);
 
     void print(std::string *p_out_str, bool f_colored = false) const;
 
-    static const int MAX_ARGUMENTS_NUM = 12;
-
     predicate_t predicate;
-    std::vector<term_t> terms;
+    term_array_t terms;
     bool truth;
 
 private:
     inline void regularize();
+
+    /** Returns the key to check whether m_arity is up to date. */
+    inline unsigned long long get_arity_key() const;
+
+    /** Caches the arity of the current predicate, terms and truth.
+     *  This is called only where the literal is built, never from const methods. */
+    inline void update_arity();
+
+    term_t m_arity;
+    unsigned long long m_arity_key;
+
+    /** The cached id of the arity in lower 32 bits and the version of
+     *  the arity-database in upper 32 bits, or 0 if not looked up yet.
+     *  This is atomic since literals in axioms are shared among threads,
+     *  and is the only member written by const methods. */
+    mutable std::atomic<unsigned long long> m_arity_id;
 };
 
 
@@ -265,7 +486,38 @@ std::ostream& operator<<(std::ostream& os, const literal_t& t);
 namespace util
 {
 
-/** A wrapper class of cdb++. */
+/** A class of read-only view of a file.
+ *  On POSIX systems the file is mapped with mmap,
+ *  otherwise the whole file is read into a buffer.
+ *  Once opened, the content can be read from any thread without locking. */
+class mapped_file_t
+{
+public:
+    mapped_file_t() : m_data(NULL), m_size(0), m_is_mapped(false) {}
+    mapped_file_t(const std::string &filename);
+    ~mapped_file_t();
+
+    /** Opens the file. Returns false on failure. */
+    bool open(const std::string &filename);
+    void close();
+
+    inline const char* data() const { return m_data; }
+    inline size_t size() const { return m_size; }
+    inline bool is_open() const { return m_data != NULL; }
+
+private:
+    mapped_file_t(const mapped_file_t&);
+    mapped_file_t& operator=(const mapped_file_t&);
+
+    const char *m_data;
+    size_t m_size;
+    bool m_is_mapped;
+};
+
+
+/** A wrapper class of cdb++.
+ *  On query mode the database file is memory-mapped,
+ *  so values returned by get() point into the mapping. */
 class cdb_data_t
 {
 public:
@@ -282,6 +534,14 @@ public:
         const void *key, size_t ksize, size_t *vsize) const;
     inline size_t size() const;
 
+    /** Calls proc for every record of the database file,
+     *  in order of insertion. The file must have been written completely. */
+    void enumerate(const std::function<void(
+        const char *key, size_t ksize, const char *value, size_t vsize)> &proc) const;
+
+    /** Closes the database and changes the path of its file. */
+    inline void set_filename(const std::string &filename) { finalize(); m_filename = filename; }
+
     inline const std::string& filename() const { return m_filename; }
     inline bool is_writable() const { return m_builder != NULL; }
     inline bool is_readable() const { return m_finder != NULL; }
@@ -289,9 +549,11 @@ public:
 private:
     std::string m_filename;
     std::ofstream  *m_fout;
-    std::ifstream  *m_fin;
     cdbpp::builder *m_builder;
     cdbpp::cdbpp   *m_finder;
+
+    /** The database file, on which m_finder looks up values without copying. */
+    mapped_file_t m_mapped;
 };
 
 
@@ -313,6 +575,220 @@ private:
 };
 
 
+/** A thread-safe FIFO queue with bounded capacity,
+ *  which connects a producer thread with a consumer thread. */
+template <class T> class blocking_queue_t
+{
+public:
+    blocking_queue_t(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1), m_is_closed(false) {}
+
+    /** Adds x to the queue, waiting while the queue is full.
+     *  Returns false and discards x if the queue has been closed. */
+    inline bool push(T &&x);
+
+    /** Takes the head of the queue, waiting while the queue is empty.
+     *  Returns false if the queue has been closed and is empty. */
+    inline bool pop(T *out);
+
+    /** Wakes up all waiting threads. Later push() will fail. */
+    inline void close();
+
+private:
+    std::deque<T> m_queue;
+    size_t m_capacity;
+    bool m_is_closed;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond_push, m_cond_pop;
+};
+
+
+/** Threads which are kept to run tasks repeatedly,
+ *  so that parallel loops called many times need not spawn threads each time. */
+class worker_pool_t
+{
+public:
+    worker_pool_t(int num_thread);
+    ~worker_pool_t();
+
+    /** Calls proc(i) for each i in [0, num) on the workers
+     *  and waits until all of them finish.
+     *  An exception thrown by proc is rethrown here. */
+    void run(int num, const std::function<void(int)> &proc);
+
+    inline int size() const { return static_cast<int>(m_workers.size()); }
+
+private:
+    worker_pool_t(const worker_pool_t&);
+    worker_pool_t& operator=(const worker_pool_t&);
+
+    std::vector<std::thread> m_workers;
+
+    const std::function<void(int)> *m_proc;
+    int m_num_tasks, m_num_issued, m_num_done;
+    std::exception_ptr m_error;
+    bool m_is_stopped;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond_task, m_cond_done;
+};
+
+
+/** Named counters and histograms which components update during inference,
+ *  such as the number of nodes made or the time taken by each stage.
+ *  Components record values via count() and observe() to the instance
+ *  set to the current thread by scope_t, so that they need not know
+ *  which inference they are serving. */
+class metrics_t
+{
+public:
+    /** A histogram whose buckets have exponential bounds,
+     *  where a value v is counted in the bucket of 2^k such that 2^(k-1) <= v < 2^k. */
+    struct histogram_t
+    {
+        histogram_t() : count(0), sum(0.0), min(0.0), max(0.0) {}
+
+        void add(double value);
+        void merge(const histogram_t &x);
+
+        long long count;
+        double sum, min, max;
+        std::map<int, long long> buckets; /**< Map from k to the number of values. */
+    };
+
+    /** Sets metrics to the current thread while the instance is alive. */
+    class scope_t
+    {
+    public:
+        scope_t(metrics_t *m) : m_prev(ms_current) { ms_current = m; }
+        ~scope_t() { ms_current = m_prev; }
+
+    private:
+        metrics_t *m_prev;
+    };
+
+    /** Adds n to the counter of the current thread's metrics, if any.
+     *  The key is not copied unless metrics are recorded,
+     *  so that this costs only a check on hot paths otherwise. */
+    static inline void count(const char *key, long long n = 1);
+
+    /** Adds value to the histogram of the current thread's metrics, if any. */
+    static inline void observe(const char *key, double value);
+
+    inline void add(const std::string &key, long long n = 1) { m_counters[key] += n; }
+    inline void add_sample(const std::string &key, double value) { m_histograms[key].add(value); }
+
+    void merge(const metrics_t &x);
+    inline void clear() { m_counters.clear(); m_histograms.clear(); }
+
+    inline const std::map<std::string, long long>& counters() const { return m_counters; }
+    inline const std::map<std::string, histogram_t>& histograms() const { return m_histograms; }
+
+    /** Prints the metrics as a JSON object in one line.
+     *  For each pair of counters "X.hits" and "X.misses", "X.hit_rate" is printed too. */
+    void print_json(std::ostream *os, const std::string &scope, const std::string &name) const;
+
+private:
+    static thread_local metrics_t *ms_current;
+
+    std::map<std::string, long long> m_counters;
+    std::map<std::string, histogram_t> m_histograms;
+};
+
+
+/** A set of non-negative integers as a sorted list of 64-bit blocks.
+ *  Sets of clustered integers, such as indices of nodes made around the same time,
+ *  are kept compact, and membership is looked up by binary search over blocks. */
+class sparse_bitset_t
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef int value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const int* pointer;
+        typedef const int& reference;
+
+        inline const_iterator(const sparse_bitset_t *set, size_t block);
+
+        inline int operator*() const;
+        inline const_iterator& operator++();
+        inline bool operator==(const const_iterator &x) const;
+        inline bool operator!=(const const_iterator &x) const { return not ((*this) == x); }
+
+    private:
+        inline void skip_empty();
+
+        const sparse_bitset_t *m_set;
+        size_t m_block;
+        std::uint64_t m_bits; /**< Bits of the current block not visited yet. */
+    };
+
+    inline void insert(int i);
+    inline size_t count(int i) const;
+    inline bool empty() const { return m_blocks.empty(); }
+
+    /** Adds all elements of x to this. */
+    void merge(const sparse_bitset_t &x);
+
+    inline const_iterator begin() const { return const_iterator(this, 0); }
+    inline const_iterator end() const { return const_iterator(this, m_blocks.size()); }
+
+private:
+    struct block_t
+    {
+        int index; /**< Elements in this block are in [64 * index, 64 * (index + 1)). */
+        std::uint64_t bits;
+    };
+
+    inline std::vector<block_t>::const_iterator find_block(int index) const;
+
+    std::vector<block_t> m_blocks;
+};
+
+
+/** A set kept as a sorted contiguous array.
+ *  Inserting values in ascending order, as indices of new nodes or edges,
+ *  is amortized O(1) and needs no allocation per element. */
+template <class T> class flat_set_t
+{
+public:
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    inline void insert(const T &x);
+    inline size_t count(const T &x) const;
+
+    inline size_t size() const { return m_values.size(); }
+    inline bool empty() const { return m_values.empty(); }
+
+    inline const_iterator begin() const { return m_values.begin(); }
+    inline const_iterator end() const { return m_values.end(); }
+
+    inline array_span_t<T> span() const;
+
+private:
+    std::vector<T> m_values;
+};
+
+
+/** A map from dense non-negative integers, such as indices of nodes,
+ *  to flat_set_t. Negative keys are ignored. */
+template <class T> class flat_multimap_t
+{
+public:
+    inline void insert(long long key, const T &value);
+
+    /** Returns values of key, which is valid until a value is inserted to key. */
+    inline array_span_t<T> find(long long key) const;
+
+private:
+    std::vector<flat_set_t<T> > m_sets;
+};
+
+
 class xml_element_t
 {
 public:
@@ -340,63 +816,162 @@ private:
 };
 
 
+/** A map from unordered pairs of keys to values.
+ *  Entries are kept in a flat array in insertion order and indexed by
+ *  an open-addressing table with Robin Hood hashing on the packed pair,
+ *  so that a lookup is a single probe sequence without any allocation. */
 template <class Key, class Value> class triangular_matrix_t
-: public hash_map<Key, hash_map<Key, Value> >
 {
 public:
-    inline void insert(Key k1, Key k2, const Value &v)
+    struct entry_t
     {
-        this->regularize_keys(k1, k2);
-        (*this)[k1].insert(std::make_pair(k2, v));
-    }
+        Key first, second; /**< The first is not greater than the second. */
+        Value value;
+    };
+    typedef typename std::vector<entry_t>::const_iterator const_iterator;
 
-    Value* find(Key k1, Key k2)
-    {
-        this->regularize_keys(k1, k2);
+    /** Adds v unless the pair of keys already exists. */
+    inline void insert(Key k1, Key k2, const Value &v) { get(k1, k2, v); }
 
-        auto found1 = this->hash_map<Key, hash_map<Key, Value> >::find(k1);
-        if (found1 == this->end()) return NULL;
+    /** Sets v to the pair of keys, overwriting the existing value. */
+    inline void assign(Key k1, Key k2, const Value &v) { get(k1, k2, v) = v; }
 
-        auto found2 = found1->second.find(k2);
-        return (found2 == found1->second.end()) ? NULL : &(found2->second);
-    }
+    inline Value* find(Key k1, Key k2);
+    inline const Value* find(Key k1, Key k2) const;
 
-    const Value* find(Key k1, Key k2) const
-    {
-        this->regularize_keys(k1, k2);
+    /** Removes the pair of keys. The last entry is moved to its place. */
+    bool erase(Key k1, Key k2);
 
-        auto found1 = this->hash_map<Key, hash_map<Key, Value> >::find(k1);
-        if (found1 == this->end()) return NULL;
+    void clear();
 
-        auto found2 = found1->second.find(k2);
-        return (found2 == found1->second.end()) ? NULL : &(found2->second);
-    }
+    inline size_t size() const { return m_entries.size(); }
+    inline bool empty() const { return m_entries.empty(); }
+
+    inline const_iterator begin() const { return m_entries.begin(); }
+    inline const_iterator end() const { return m_entries.end(); }
 
 protected:
-    inline void regularize_keys(Key &k1, Key &k2) const { if (k1 > k2) std::swap(k1, k2); }
+    struct slot_t
+    {
+        size_t hash;
+        index_t entry; /**< Index in m_entries, or -1 if empty. */
+    };
+
+    inline static void regularize_keys(Key &k1, Key &k2) { if (k1 > k2) std::swap(k1, k2); }
+    inline static size_t hash(const Key &k1, const Key &k2);
+
+    /** Returns the value of the pair of keys, adding v if not found. */
+    Value& get(Key k1, Key k2, const Value &v);
+
+    /** Returns the index of the slot of given regularized keys, or -1. */
+    index_t find_slot(const Key &k1, const Key &k2, size_t h) const;
+
+    void place(slot_t s);
+    void rehash(size_t capacity);
+
+    std::vector<entry_t> m_entries;
+    std::vector<slot_t> m_slots;
 };
 
 
-template <class T> class pair_set_t : public hash_map<T, hash_set<T> >
+template <class T> class pair_set_t : public triangular_matrix_t<T, bool>
 {
 public:
-    inline void insert(T x, T y)
-    {
-        this->regularize(x, y);
-        (*this)[x].insert(y);
-    }
+    inline void insert(T x, T y) { triangular_matrix_t<T, bool>::insert(x, y, true); }
+    inline int count(T x, T y) const { return (this->find(x, y) != NULL) ? 1 : 0; }
+};
+
+
+/** A disjoint-set forest with path compression and union by rank.
+ *  Members of each set are linked in a circular list, so that uniting sets
+ *  copies nothing and members are listed only when they are requested. */
+template <class T> class union_find_t
+{
+public:
+    /** Adds x as a singleton unless it exists and returns its index. */
+    index_t add(const T &x);
+
+    /** Unites sets of x and y, adding them if needed.
+     *  Returns false if they are already in the same set. */
+    bool unite(const T &x, const T &y);
+
+    /** Returns the index of the representative of the set of x,
+     *  or -1 if x has not been added. */
+    index_t find(const T &x);
+    index_t find(const T &x) const;
+
+    inline bool is_in_same_set(const T &x, const T &y) const;
+
+    /** Returns members of the set of x, or an empty vector if x is not added. */
+    std::vector<T> members(const T &x) const;
+
+    /** Returns all sets in order of their first-added members. */
+    std::list< std::vector<T> > sets() const;
+
+    inline size_t size() const { return m_values.size(); }
+    inline bool empty() const { return m_values.empty(); }
+    inline const std::vector<T>& values() const { return m_values; }
+
+    void clear();
+
+private:
+    index_t root(index_t i);
+    index_t root(index_t i) const;
+    void list_members(index_t i, std::vector<T> *out) const;
+
+    hash_map<T, index_t> m_indices;
+    std::vector<T> m_values;
+    std::vector<index_t> m_parents;
+    std::vector<int> m_ranks;
+    std::vector<index_t> m_next; /**< The next member in the circular list. */
+};
+
+
+/** A bounded cache which threads share.
+ *  Entries are distributed to shards by ShardHash, each of which has its own lock,
+ *  and are evicted with CLOCK algorithm when a shard is full. */
+template <class Key, class Value, class ShardHash = std::hash<Key> >
+class sharded_clock_cache_t
+{
+public:
+    /** @param capacity Upper bound of the number of entries. */
+    sharded_clock_cache_t(size_t capacity);
+
+    /** Copies the cached value of key to out and returns true if found. */
+    bool find(const Key &key, Value *out) const;
+    void insert(const Key &key, const Value &value);
+    void clear();
+
+    /** Changes the capacity. Cached entries are discarded. */
+    void set_capacity(size_t capacity);
 
-    inline int count(T x, T y) const
+    inline unsigned long long num_hits() const { return m_num_hits; }
+    inline unsigned long long num_misses() const { return m_num_misses; }
+    inline size_t capacity() const { return m_capacity_per_shard * NUM_SHARDS; }
+
+    /** Returns approximate memory per entry, including a node of the index. */
+    static inline size_t bytes_per_entry();
+
+private:
+    static const size_t NUM_SHARDS = 64;
+
+    struct shard_t
     {
-        this->regularize(x, y);
-        auto found1 = this->find(x);
-        if (found1 == this->end()) return 0;
-        auto found2 = found1->second.find(y);
-        return (found2 == found1->second.end()) ? 0 : 1;
-    }
+        shard_t() : hand(0) {}
 
-protected:
-    inline void regularize(T &x, T &y) const { if (x > y) std::swap(x, y); }
+        mutable std::mutex mutex;
+        hash_map<Key, size_t> index;
+        std::vector<Key> keys;
+        std::vector<Value> values;
+        std::vector<char> refs;
+        size_t hand;
+    };
+
+    inline shard_t& get_shard(const Key &key) const;
+
+    size_t m_capacity_per_shard;
+    std::unique_ptr<shard_t[]> m_shards;
+    mutable std::atomic<unsigned long long> m_num_hits, m_num_misses;
 };
 
 
@@ -471,6 +1046,9 @@ std::string replace(
     const std::string &replace);
 
 std::string strip(const std::string &input, const char *targets);
+
+/** Returns the string in which characters reserved in XML are escaped. */
+std::string escape_xml(const std::string &input);
 bool startswith(const std::string &str, const std::string &query);
 bool endswith(const std::string &str, const std::string &query);
 
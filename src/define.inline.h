@@ -11,14 +11,14 @@ namespace phil
 
 
 inline string_hash_t::string_hash_t()
-: m_hash(0)
+: m_hash(EMPTY_HASH), m_is_constant(false), m_is_unknown(false), m_is_hard_term(false)
 {}
 
 
 inline string_hash_t::string_hash_t(const string_hash_t& h)
-: m_hash(h.m_hash)
+: m_hash(h.m_hash), m_is_constant(h.m_is_constant),
+  m_is_unknown(h.m_is_unknown), m_is_hard_term(h.m_is_hard_term)
 {
-    set_flags(string());
 #ifdef _DEBUG
     m_string = h.string();
 #endif
@@ -37,8 +37,6 @@ inline string_hash_t::string_hash_t( const std::string &s )
 
 inline string_hash_t string_hash_t::get_unknown_hash()
 {
-    std::lock_guard<std::mutex> lock(ms_mutex_unknown);
-
     char buffer[128];
     _sprintf(buffer, "_u%d", ++ms_issued_variable_count);
     return string_hash_t(std::string(buffer));
@@ -47,39 +45,51 @@ inline string_hash_t string_hash_t::get_unknown_hash()
 
 inline void string_hash_t::reset_unknown_hash_count()
 {
-    std::lock_guard<std::mutex> lock(ms_mutex_unknown);
     ms_issued_variable_count = 0;
 }
 
 
-inline unsigned string_hash_t::get_hash(std::string str)
+inline unsigned string_hash_t::get_hash(const std::string &str)
 {
-    std::lock_guard<std::mutex> lock(ms_mutex_hash);
+    static thread_local front_cache_entry_t cache[FRONT_CACHE_SIZE];
 
-    hash_map<std::string, unsigned>::iterator it = ms_hashier.find(str);
-    if (it != ms_hashier.end())
-        return it->second;
-    else
+    // THE EMPTY STRING ALWAYS HAS THE HASH OF DEFAULT-CONSTRUCTED INSTANCES.
+    if (str.empty()) return EMPTY_HASH;
+
+    size_t key = std::hash<std::string>()(str);
+    front_cache_entry_t &entry = cache[(key / NUM_SHARDS) % FRONT_CACHE_SIZE];
+
+    if (entry.hash == UINT_MAX or entry.str != str)
     {
-        ms_strs.push_back(str);
-        unsigned idx(ms_strs.size() - 1);
-        ms_hashier[str] = idx;
-        return idx;
+        entry.hash = get_hash_from_shard(str, key);
+        entry.str = str;
     }
+
+    return entry.hash;
+}
+
+
+inline const std::string& string_hash_t::get_string(unsigned hash)
+{
+    static const std::string EMPTY;
+    if (hash == EMPTY_HASH) return EMPTY;
+
+    const std::string *strs =
+        ms_chunks[hash >> CHUNK_BITS].load(std::memory_order_acquire);
+
+    return (strs == NULL) ? EMPTY : strs[hash & (CHUNK_SIZE - 1)];
 }
 
 
 inline const std::string& string_hash_t::string() const
 {
-    std::lock_guard<std::mutex> lock(ms_mutex_hash);
-    return ms_strs.at(m_hash);
+    return get_string(m_hash);
 }
 
 
 inline string_hash_t::operator const std::string& () const
 {
-    std::lock_guard<std::mutex> lock(ms_mutex_hash);
-    return ms_strs.at(m_hash);
+    return get_string(m_hash);
 }
 
 
@@ -99,7 +109,9 @@ inline string_hash_t& string_hash_t::operator = (const std::string &s)
 inline string_hash_t& string_hash_t::operator = (const string_hash_t &h)
 {
     m_hash = h.m_hash;
-    set_flags(string());
+    m_is_constant = h.m_is_constant;
+    m_is_unknown = h.m_is_unknown;
+    m_is_hard_term = h.m_is_hard_term;
 
 #ifdef _DEBUG
     m_string = h.string();
@@ -168,17 +180,103 @@ inline void string_hash_t::set_flags(const std::string &str)
 }
 
 
+inline literal_t::term_array_t::term_array_t(const term_array_t &x)
+    : m_size(x.m_size)
+{
+    std::copy(x.begin(), x.end(), m_terms);
+}
+
+
+inline literal_t::term_array_t::term_array_t(const std::vector<term_t> &x)
+    : m_size(0)
+{
+    for (const auto &t : x)
+        push_back(t);
+}
+
+
+inline literal_t::term_array_t&
+literal_t::term_array_t::operator=(const term_array_t &x)
+{
+    m_size = x.m_size;
+    std::copy(x.begin(), x.end(), m_terms);
+    return *this;
+}
+
+
+inline term_t& literal_t::term_array_t::at(size_t i)
+{
+    if (i >= m_size)
+        throw std::out_of_range("literal_t::term_array_t::at");
+    return m_terms[i];
+}
+
+
+inline const term_t& literal_t::term_array_t::at(size_t i) const
+{
+    if (i >= m_size)
+        throw std::out_of_range("literal_t::term_array_t::at");
+    return m_terms[i];
+}
+
+
+inline void literal_t::term_array_t::push_back(const term_t &t)
+{
+    if (m_size >= MAX_ARGUMENTS_NUM)
+        throw phillip_exception_t(util::format(
+            "A literal cannot have more than %d terms.", MAX_ARGUMENTS_NUM));
+    m_terms[m_size++] = t;
+}
+
+
+inline void literal_t::term_array_t::assign(size_t n, const term_t &t)
+{
+    if (n > MAX_ARGUMENTS_NUM)
+        throw phillip_exception_t(util::format(
+            "A literal cannot have more than %d terms.", MAX_ARGUMENTS_NUM));
+    m_size = static_cast<small_size_t>(n);
+    std::fill(m_terms, m_terms + n, t);
+}
+
+
 inline std::string literal_t::get_arity(
     const predicate_t &pred, int term_num, bool is_negated)
 {
     return
         (is_negated ? "!" : "") +
-        util::format("%s/%d", pred.c_str(), term_num);
+        util::format("%s/%d", pred.string().c_str(), term_num);
+}
+
+
+inline literal_t::literal_t()
+    : m_arity_key(ULLONG_MAX), m_arity_id(0)
+{}
+
+
+inline literal_t::literal_t(const literal_t &x)
+    : predicate(x.predicate), terms(x.terms), truth(x.truth),
+      m_arity(x.m_arity), m_arity_key(x.m_arity_key),
+      m_arity_id(x.m_arity_id.load(std::memory_order_relaxed))
+{}
+
+
+inline literal_t& literal_t::operator=(const literal_t &x)
+{
+    predicate = x.predicate;
+    terms = x.terms;
+    truth = x.truth;
+    m_arity = x.m_arity;
+    m_arity_key = x.m_arity_key;
+    m_arity_id.store(x.m_arity_id.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return (*this);
 }
 
 
 inline literal_t::literal_t( const std::string &_pred, bool _truth )
-    : predicate(_pred), truth(_truth) {}
+    : predicate(_pred), truth(_truth)
+{
+    update_arity();
+}
 
 
 inline literal_t::literal_t(
@@ -189,6 +287,14 @@ inline literal_t::literal_t(
 }
 
 
+inline literal_t::literal_t(
+    const predicate_t &_pred, const term_array_t &_terms, bool _truth )
+    : predicate(_pred), terms(_terms), truth(_truth)
+{
+    regularize();
+}
+
+
 inline literal_t::literal_t(
     const std::string &_pred,
     const std::vector<term_t> _terms, bool _truth )
@@ -240,9 +346,14 @@ inline std::string literal_t::to_string( bool f_colored ) const
 }
 
 
-inline std::string literal_t::get_arity() const
+inline const std::string& literal_t::get_arity() const
 {
-    return get_arity(predicate, terms.size(), not truth);
+    // THE LITERAL HAS BEEN MODIFIED SINCE ITS ARITY WAS CACHED.
+    // THE INTERNED STRING IS RETURNED WITHOUT WRITING THE CACHE.
+    if (m_arity_key != get_arity_key())
+        return term_t(get_arity(predicate, terms.size(), not truth)).string();
+
+    return m_arity.string();
 }
 
 
@@ -255,7 +366,7 @@ inline std::string literal_t::get_arity_with_all_constants() const
         args += util::format("+%d:%s", i, std::string(terms[i]).c_str());
     }
 
-    return util::format("%s/%d%s", predicate.c_str(), terms.size(), args.c_str());
+    return util::format("%s/%d%s", predicate.string().c_str(), terms.size(), args.c_str());
 }
 
 
@@ -274,16 +385,23 @@ inline std::vector<std::string> literal_t::get_arity_with_constants() const
         if((i & (1<<j)) == (1<<j)) args += constants[j];
       }
 
-      ret.push_back(util::format("%s/%d%s", predicate.c_str(), terms.size(), args.c_str()));
+      ret.push_back(util::format("%s/%d%s", predicate.string().c_str(), terms.size(), args.c_str()));
     }
 
     return ret;
 }
 
 
+inline bool literal_t::is_equality() const
+{
+    static const predicate_t EQ("=");
+    return predicate == EQ;
+}
+
+
 inline bool literal_t::is_valid() const
 {
-    return not terms.empty() and not predicate.empty();
+    return not terms.empty() and not predicate.string().empty();
 }
 
 
@@ -292,6 +410,25 @@ inline void literal_t::regularize()
     if (is_equality())
         if (terms.at(0) > terms.at(1))
             std::swap(terms[0], terms[1]);
+
+    update_arity();
+}
+
+
+inline unsigned long long literal_t::get_arity_key() const
+{
+    return
+        (static_cast<unsigned long long>(predicate.get_hash()) << 32) |
+        (static_cast<unsigned long long>(terms.size()) << 1) |
+        (truth ? 1ull : 0ull);
+}
+
+
+inline void literal_t::update_arity()
+{
+    m_arity = term_t(get_arity(predicate, terms.size(), not truth));
+    m_arity_key = get_arity_key();
+    m_arity_id.store(0, std::memory_order_relaxed);
 }
 
 
@@ -311,6 +448,558 @@ inline bool timeout_t::do_time_out(const std::chrono::system_clock::time_point &
 }
 
 
+template <class T> inline bool blocking_queue_t<T>::push(T &&x)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond_push.wait(lock, [this]() { return m_is_closed or m_queue.size() < m_capacity; });
+
+    if (m_is_closed) return false;
+
+    m_queue.push_back(std::move(x));
+    m_cond_pop.notify_one();
+    return true;
+}
+
+
+template <class T> inline bool blocking_queue_t<T>::pop(T *out)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond_pop.wait(lock, [this]() { return m_is_closed or not m_queue.empty(); });
+
+    if (m_queue.empty()) return false;
+
+    (*out) = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_cond_push.notify_one();
+    return true;
+}
+
+
+template <class T> inline void blocking_queue_t<T>::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_is_closed = true;
+    m_cond_push.notify_all();
+    m_cond_pop.notify_all();
+}
+
+
+
+inline void metrics_t::count(const char *key, long long n)
+{
+    if (ms_current != NULL)
+        ms_current->add(key, n);
+}
+
+
+inline void metrics_t::observe(const char *key, double value)
+{
+    if (ms_current != NULL)
+        ms_current->add_sample(key, value);
+}
+
+
+
+inline sparse_bitset_t::const_iterator::const_iterator(
+    const sparse_bitset_t *set, size_t block)
+    : m_set(set), m_block(block), m_bits(0)
+{
+    if (m_block < m_set->m_blocks.size())
+        m_bits = m_set->m_blocks[m_block].bits;
+}
+
+
+inline int sparse_bitset_t::const_iterator::operator*() const
+{
+    int offset = 0;
+    std::uint64_t bits = m_bits;
+
+    while ((bits & 0xffffffffull) == 0) { bits >>= 32; offset += 32; }
+    while ((bits & 0xffull) == 0) { bits >>= 8; offset += 8; }
+    while ((bits & 1ull) == 0) { bits >>= 1; ++offset; }
+
+    return 64 * m_set->m_blocks[m_block].index + offset;
+}
+
+
+inline sparse_bitset_t::const_iterator& sparse_bitset_t::const_iterator::operator++()
+{
+    m_bits &= (m_bits - 1);
+    if (m_bits == 0 and ++m_block < m_set->m_blocks.size())
+        m_bits = m_set->m_blocks[m_block].bits;
+    return (*this);
+}
+
+
+inline bool sparse_bitset_t::const_iterator::operator==(const const_iterator &x) const
+{
+    return m_set == x.m_set and m_block == x.m_block and m_bits == x.m_bits;
+}
+
+
+inline std::vector<sparse_bitset_t::block_t>::const_iterator
+sparse_bitset_t::find_block(int index) const
+{
+    return std::lower_bound(
+        m_blocks.begin(), m_blocks.end(), index,
+        [](const block_t &b, int i) { return b.index < i; });
+}
+
+
+inline void sparse_bitset_t::insert(int i)
+{
+    auto it = find_block(i / 64);
+    std::uint64_t bit = 1ull << (i % 64);
+
+    if (it != m_blocks.end() and it->index == i / 64)
+        m_blocks[it - m_blocks.begin()].bits |= bit;
+    else
+        m_blocks.insert(m_blocks.begin() + (it - m_blocks.begin()), block_t{ i / 64, bit });
+}
+
+
+inline size_t sparse_bitset_t::count(int i) const
+{
+    if (i < 0) return 0;
+
+    auto it = find_block(i / 64);
+    return (it != m_blocks.end() and it->index == i / 64) ?
+        ((it->bits >> (i % 64)) & 1ull) : 0;
+}
+
+
+
+template <class T> inline void flat_set_t<T>::insert(const T &x)
+{
+    if (m_values.empty() or m_values.back() < x)
+        m_values.push_back(x);
+    else
+    {
+        auto it = std::lower_bound(m_values.begin(), m_values.end(), x);
+        if (*it != x)
+            m_values.insert(it, x);
+    }
+}
+
+
+template <class T> inline size_t flat_set_t<T>::count(const T &x) const
+{
+    return std::binary_search(m_values.begin(), m_values.end(), x) ? 1 : 0;
+}
+
+
+template <class T> inline array_span_t<T> flat_set_t<T>::span() const
+{
+    return array_span_t<T>(m_values.data(), m_values.data() + m_values.size());
+}
+
+
+template <class T> inline void flat_multimap_t<T>::insert(long long key, const T &value)
+{
+    if (key < 0) return;
+    if (key >= static_cast<long long>(m_sets.size()))
+        m_sets.resize(key + 1);
+    m_sets[key].insert(value);
+}
+
+
+template <class T> inline array_span_t<T> flat_multimap_t<T>::find(long long key) const
+{
+    return (key >= 0 and key < static_cast<long long>(m_sets.size())) ?
+        m_sets[key].span() : array_span_t<T>();
+}
+
+
+template <class Key, class Value>
+inline Value* triangular_matrix_t<Key, Value>::find(Key k1, Key k2)
+{
+    regularize_keys(k1, k2);
+    index_t i = find_slot(k1, k2, hash(k1, k2));
+    return (i >= 0) ? &m_entries[m_slots[i].entry].value : NULL;
+}
+
+
+template <class Key, class Value>
+inline const Value* triangular_matrix_t<Key, Value>::find(Key k1, Key k2) const
+{
+    regularize_keys(k1, k2);
+    index_t i = find_slot(k1, k2, hash(k1, k2));
+    return (i >= 0) ? &m_entries[m_slots[i].entry].value : NULL;
+}
+
+
+template <class Key, class Value>
+bool triangular_matrix_t<Key, Value>::erase(Key k1, Key k2)
+{
+    regularize_keys(k1, k2);
+    index_t found = find_slot(k1, k2, hash(k1, k2));
+    if (found < 0) return false;
+
+    size_t i = static_cast<size_t>(found);
+    index_t erased = m_slots[i].entry;
+    size_t mask = m_slots.size() - 1;
+
+    // SHIFT FOLLOWING SLOTS BACKWARD UNTIL ONE IS AT ITS HOME POSITION.
+    for (size_t j = (i + 1) & mask;; j = (j + 1) & mask)
+    {
+        const slot_t &next = m_slots[j];
+        if (next.entry < 0 or ((j - next.hash) & mask) == 0) break;
+        m_slots[i] = next;
+        i = j;
+    }
+    m_slots[i].entry = -1;
+
+    // FILL THE HOLE IN m_entries WITH THE LAST ENTRY.
+    index_t last = static_cast<index_t>(m_entries.size()) - 1;
+    if (erased != last)
+    {
+        entry_t &e = m_entries[last];
+        m_slots[find_slot(e.first, e.second, hash(e.first, e.second))].entry = erased;
+        m_entries[erased] = e;
+    }
+    m_entries.pop_back();
+
+    return true;
+}
+
+
+template <class Key, class Value> void triangular_matrix_t<Key, Value>::clear()
+{
+    m_entries.clear();
+    m_slots.clear();
+}
+
+
+template <class Key, class Value> inline size_t
+triangular_matrix_t<Key, Value>::hash(const Key &k1, const Key &k2)
+{
+    uint64_t x =
+        static_cast<uint64_t>(std::hash<Key>()(k1)) * 0x9e3779b97f4a7c15ULL
+        + static_cast<uint64_t>(std::hash<Key>()(k2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return static_cast<size_t>(x ^ (x >> 31));
+}
+
+
+template <class Key, class Value>
+Value& triangular_matrix_t<Key, Value>::get(Key k1, Key k2, const Value &v)
+{
+    regularize_keys(k1, k2);
+    size_t h = hash(k1, k2);
+    index_t i = find_slot(k1, k2, h);
+
+    if (i >= 0)
+        return m_entries[m_slots[i].entry].value;
+
+    // KEEP THE LOAD FACTOR NOT MORE THAN 3/4.
+    if ((m_entries.size() + 1) * 4 > m_slots.size() * 3)
+        rehash(std::max<size_t>(16, m_slots.size() * 2));
+
+    entry_t e = { k1, k2, v };
+    m_entries.push_back(e);
+
+    slot_t s = { h, static_cast<index_t>(m_entries.size()) - 1 };
+    place(s);
+
+    return m_entries.back().value;
+}
+
+
+template <class Key, class Value> index_t
+triangular_matrix_t<Key, Value>::find_slot(const Key &k1, const Key &k2, size_t h) const
+{
+    if (m_slots.empty()) return -1;
+
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = h & mask, dist = 0;; i = (i + 1) & mask, ++dist)
+    {
+        const slot_t &s = m_slots[i];
+
+        // A SLOT NEARER TO ITS HOME THAN THE KEY WOULD BE MEANS THE KEY IS ABSENT.
+        if (s.entry < 0 or ((i - s.hash) & mask) < dist) return -1;
+
+        if (s.hash == h)
+        {
+            const entry_t &e = m_entries[s.entry];
+            if (e.first == k1 and e.second == k2)
+                return static_cast<index_t>(i);
+        }
+    }
+}
+
+
+template <class Key, class Value> void triangular_matrix_t<Key, Value>::place(slot_t s)
+{
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = s.hash & mask, dist = 0;; i = (i + 1) & mask, ++dist)
+    {
+        slot_t &t = m_slots[i];
+        if (t.entry < 0)
+        {
+            t = s;
+            return;
+        }
+
+        // TAKE THE SLOT FROM AN ENTRY NEARER TO ITS HOME.
+        size_t d = (i - t.hash) & mask;
+        if (d < dist)
+        {
+            std::swap(t, s);
+            dist = d;
+        }
+    }
+}
+
+
+template <class Key, class Value>
+void triangular_matrix_t<Key, Value>::rehash(size_t capacity)
+{
+    slot_t empty = { 0, -1 };
+    m_slots.assign(capacity, empty);
+
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        const entry_t &e = m_entries[i];
+        slot_t s = { hash(e.first, e.second), static_cast<index_t>(i) };
+        place(s);
+    }
+}
+
+
+template <class T> index_t union_find_t<T>::add(const T &x)
+{
+    auto found = m_indices.find(x);
+    if (found != m_indices.end()) return found->second;
+
+    index_t i = static_cast<index_t>(m_values.size());
+    m_indices[x] = i;
+    m_values.push_back(x);
+    m_parents.push_back(i);
+    m_ranks.push_back(0);
+    m_next.push_back(i);
+
+    return i;
+}
+
+
+template <class T> bool union_find_t<T>::unite(const T &x, const T &y)
+{
+    index_t i = add(x), j = add(y);
+    index_t ri = root(i), rj = root(j);
+
+    if (ri == rj) return false;
+
+    if (m_ranks[ri] < m_ranks[rj]) std::swap(ri, rj);
+    if (m_ranks[ri] == m_ranks[rj]) ++m_ranks[ri];
+    m_parents[rj] = ri;
+
+    // SPLICE THE TWO CIRCULAR LISTS OF MEMBERS.
+    std::swap(m_next[ri], m_next[rj]);
+
+    return true;
+}
+
+
+template <class T> index_t union_find_t<T>::find(const T &x)
+{
+    auto found = m_indices.find(x);
+    return (found != m_indices.end()) ? root(found->second) : -1;
+}
+
+
+template <class T> index_t union_find_t<T>::find(const T &x) const
+{
+    auto found = m_indices.find(x);
+    return (found != m_indices.end()) ? root(found->second) : -1;
+}
+
+
+template <class T>
+inline bool union_find_t<T>::is_in_same_set(const T &x, const T &y) const
+{
+    index_t i = find(x);
+    return (i >= 0) and (i == find(y));
+}
+
+
+template <class T> std::vector<T> union_find_t<T>::members(const T &x) const
+{
+    std::vector<T> out;
+    auto found = m_indices.find(x);
+    if (found != m_indices.end())
+        list_members(root(found->second), &out);
+    return out;
+}
+
+
+template <class T> std::list< std::vector<T> > union_find_t<T>::sets() const
+{
+    std::list< std::vector<T> > out;
+    std::vector<bool> is_listed(m_values.size(), false);
+
+    for (index_t i = 0; i < static_cast<index_t>(m_values.size()); ++i)
+    {
+        index_t r = root(i);
+        if (is_listed[r]) continue;
+
+        is_listed[r] = true;
+        out.push_back(std::vector<T>());
+        list_members(i, &out.back());
+    }
+
+    return out;
+}
+
+
+template <class T> void union_find_t<T>::clear()
+{
+    m_indices.clear();
+    m_values.clear();
+    m_parents.clear();
+    m_ranks.clear();
+    m_next.clear();
+}
+
+
+template <class T> index_t union_find_t<T>::root(index_t i)
+{
+    // PATH HALVING, WHICH COMPRESSES PATHS IN A SINGLE PASS.
+    while (m_parents[i] != i)
+    {
+        m_parents[i] = m_parents[m_parents[i]];
+        i = m_parents[i];
+    }
+    return i;
+}
+
+
+template <class T> index_t union_find_t<T>::root(index_t i) const
+{
+    // NOT TO WRITE ON READING. UNION BY RANK KEEPS THE PATH SHORT.
+    while (m_parents[i] != i)
+        i = m_parents[i];
+    return i;
+}
+
+
+template <class T>
+void union_find_t<T>::list_members(index_t i, std::vector<T> *out) const
+{
+    index_t j = i;
+    do
+    {
+        out->push_back(m_values[j]);
+        j = m_next[j];
+    } while (j != i);
+}
+
+
+template <class Key, class Value, class ShardHash>
+sharded_clock_cache_t<Key, Value, ShardHash>::sharded_clock_cache_t(size_t capacity)
+    : m_capacity_per_shard(0), m_shards(new shard_t[NUM_SHARDS]),
+      m_num_hits(0), m_num_misses(0)
+{
+    set_capacity(capacity);
+}
+
+
+template <class Key, class Value, class ShardHash>
+bool sharded_clock_cache_t<Key, Value, ShardHash>::find(const Key &key, Value *out) const
+{
+    shard_t &sh = get_shard(key);
+    std::lock_guard<std::mutex> lock(sh.mutex);
+    auto found = sh.index.find(key);
+
+    if (found == sh.index.end())
+    {
+        ++m_num_misses;
+        return false;
+    }
+
+    sh.refs[found->second] = 1;
+    *out = sh.values[found->second];
+    ++m_num_hits;
+    return true;
+}
+
+
+template <class Key, class Value, class ShardHash>
+void sharded_clock_cache_t<Key, Value, ShardHash>::insert(const Key &key, const Value &value)
+{
+    if (m_capacity_per_shard == 0) return;
+
+    shard_t &sh = get_shard(key);
+    std::lock_guard<std::mutex> lock(sh.mutex);
+
+    if (sh.index.count(key) > 0) return;
+
+    if (sh.keys.size() < m_capacity_per_shard)
+    {
+        sh.index[key] = sh.keys.size();
+        sh.keys.push_back(key);
+        sh.values.push_back(value);
+        sh.refs.push_back(0);
+        return;
+    }
+
+    /* CLOCK: SKIP RECENTLY REFERRED ENTRIES AND EVICT THE FIRST OTHER ONE. */
+    while (sh.refs[sh.hand] != 0)
+    {
+        sh.refs[sh.hand] = 0;
+        sh.hand = (sh.hand + 1) % m_capacity_per_shard;
+    }
+
+    sh.index.erase(sh.keys[sh.hand]);
+    sh.index[key] = sh.hand;
+    sh.keys[sh.hand] = key;
+    sh.values[sh.hand] = value;
+    sh.hand = (sh.hand + 1) % m_capacity_per_shard;
+}
+
+
+template <class Key, class Value, class ShardHash>
+void sharded_clock_cache_t<Key, Value, ShardHash>::clear()
+{
+    for (size_t i = 0; i < NUM_SHARDS; ++i)
+    {
+        shard_t &sh = m_shards[i];
+        std::lock_guard<std::mutex> lock(sh.mutex);
+
+        sh.index.clear();
+        sh.keys.clear();
+        sh.values.clear();
+        sh.refs.clear();
+        sh.hand = 0;
+    }
+}
+
+
+template <class Key, class Value, class ShardHash>
+void sharded_clock_cache_t<Key, Value, ShardHash>::set_capacity(size_t capacity)
+{
+    clear();
+    m_capacity_per_shard = (capacity + NUM_SHARDS - 1) / NUM_SHARDS;
+}
+
+
+template <class Key, class Value, class ShardHash>
+inline size_t sharded_clock_cache_t<Key, Value, ShardHash>::bytes_per_entry()
+{
+    return
+        sizeof(Key) * 2 + sizeof(Value) + sizeof(char) +
+        sizeof(size_t) + 4 * sizeof(void*);
+}
+
+
+template <class Key, class Value, class ShardHash>
+inline typename sharded_clock_cache_t<Key, Value, ShardHash>::shard_t&
+sharded_clock_cache_t<Key, Value, ShardHash>::get_shard(const Key &key) const
+{
+    return m_shards[ShardHash()(key) % NUM_SHARDS];
+}
+
+
 
 inline void cdb_data_t::put(
     const void *key, size_t ksize, const void *value, size_t vsize)
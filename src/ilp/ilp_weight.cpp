@@ -53,8 +53,11 @@ weighted_converter_t::~weighted_converter_t()
 
 ilp_converter_t* weighted_converter_t::duplicate(phillip_main_t *ptr) const
 {
-    return new weighted_converter_t(
-        ptr, m_default_observation_cost, m_weight_provider->duplicate());
+    weighted_converter_t *out = new weighted_converter_t(
+        ptr, m_default_observation_cost,
+        m_weight_provider->duplicate(), m_is_logarithmic);
+    out->m_dynamic_weight_map = m_dynamic_weight_map;
+    return out;
 }
 
 ilp::ilp_problem_t* weighted_converter_t::execute() const
@@ -114,12 +117,11 @@ ilp::ilp_problem_t* weighted_converter_t::execute() const
     {
         for (int depth = 1; not do_time_out(begin); ++depth)
         {
-            const hash_set<pg::node_idx_t>
-            *nodes = graph->search_nodes_with_depth(depth);
-            if (nodes == NULL) break;
+            pg::node_span_t nodes = graph->search_nodes_with_depth(depth);
+            if (nodes.empty()) break;
 
             hash_set<pg::hypernode_idx_t> hns;
-            for (auto it = nodes->begin(); it != nodes->end(); ++it)
+            for (auto it = nodes.begin(); it != nodes.end(); ++it)
                 hns.insert(graph->node(*it).master_hypernode());
 
             for (auto hn : hns)
@@ -203,17 +205,9 @@ ilp::ilp_problem_t* weighted_converter_t::execute() const
             cons.add_term(costvar, 1.0);
 
             hash_set<pg::edge_idx_t> edges;
-            const hash_set<pg::hypernode_idx_t> *hns =
-            graph->search_hypernodes_with_node(n_idx);
-
-            if (hns != NULL)
-            for (auto hn : (*hns))
+            for (auto hn : graph->search_hypernodes_with_node(n_idx))
             {
-                const hash_set<pg::edge_idx_t>
-                    *es = graph->search_edges_with_hypernode(hn);
-                if (es == NULL) continue;
-
-                for (auto e : (*es))
+                for (auto e : graph->search_edges_with_hypernode(hn))
                 {
                     const pg::edge_t edge = graph->edge(e);
 
@@ -294,7 +288,7 @@ ilp::ilp_problem_t* weighted_converter_t::execute() const
     for(auto n: graph->nodes()) {
         const literal_t &l = n.literal();
 
-        if("%dynamic-weight%" == l.predicate) {
+        if(l.predicate == "%dynamic-weight%") {
             util::print_console(n.to_string());
 
             term_t unify_from = l.terms[1];
@@ -319,7 +313,7 @@ ilp::ilp_problem_t* weighted_converter_t::execute() const
                 util::print_console_fmt("%s:%f", query.c_str(), dcost);
 
             } else {
-                for(auto eq_n: *graph->search_nodes_with_term(unify_from)) {
+                for(auto eq_n: graph->search_nodes_with_term(unify_from)) {
                     if(!graph->node(eq_n).is_equality_node()) continue;
 
                     // Variation part is heuristically determined.
@@ -403,9 +397,9 @@ std::vector<double> weighted_converter_t::basic_weight_provider_t::operator()(
 
     if (edge.is_chain_edge())
     {
-        lf::axiom_t axiom(base->get_axiom(edge.axiom_id()));
-        lf::logical_function_t branch =
-            axiom.func.branch(edge.type() == pg::EDGE_HYPOTHESIZE ? 0 : 1);
+        auto axiom = base->get_axiom(edge.axiom_id());
+        const lf::logical_function_t &branch =
+            axiom->func.branch(edge.type() == pg::EDGE_HYPOTHESIZE ? 0 : 1);
 
         if (weights.size() == 1 and branch.is_operator(lf::OPR_LITERAL))
         {
@@ -474,7 +468,7 @@ int weighted_converter_t::tune(
         // Update the body literals.
         const std::vector<pg::node_idx_t> &hn = graph->hypernode(graph->edge(e).head());
         for(int l=0; l<hn.size(); l++) {
-            if("etc" != graph->node(hn[l]).literal().predicate) continue;
+            if(graph->node(hn[l]).literal().predicate != "etc") continue;
 
             num_updates++;
 
@@ -524,7 +518,9 @@ void weighted_converter_t::load_dynamic_weight_parameters(std::istream *is) {
 weighted_converter_t::weight_provider_t*
 weighted_converter_t::basic_weight_provider_t::duplicate() const
 {
-    return new basic_weight_provider_t(m_default_weight);
+    basic_weight_provider_t *out = new basic_weight_provider_t(m_default_weight);
+    out->m_updated_weights = m_updated_weights;
+    return out;
 }
 
 
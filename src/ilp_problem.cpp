@@ -248,10 +248,10 @@ add_constraint_of_dependence_of_node_on_hypernode(pg::node_idx_t idx)
     if (node.is_equality_node() or node.is_non_equality_node())
     {
         auto hns = m_graph->search_hypernodes_with_node(idx);
-        if (hns != NULL)
+        if (not hns.empty())
         {
             hash_set<pg::edge_idx_t> parental_edges;
-            for (auto it = hns->begin(); it != hns->end(); ++it)
+            for (auto it = hns.begin(); it != hns.end(); ++it)
                 m_graph->enumerate_parental_edges(*it, &parental_edges);
 
             for (auto it = parental_edges.begin(); it != parental_edges.end(); ++it)
@@ -319,10 +319,10 @@ void ilp_problem_t::add_constraints_to_forbid_chaining_from_explained_node(
     if (from[0] != idx_explained and from[1] != idx_explained) return;
 
     auto hns = m_graph->search_hypernodes_with_node(idx_explained);
-    for (auto hn = hns->begin(); hn != hns->end(); ++hn)
+    for (auto hn = hns.begin(); hn != hns.end(); ++hn)
     {
         auto es = m_graph->search_edges_with_hypernode(*hn);
-        for (auto j = es->begin(); j != es->end(); ++j)
+        for (auto j = es.begin(); j != es.end(); ++j)
         {
             const pg::edge_t &e_ch = m_graph->edge(*j);
             if (not e_ch.is_chain_edge() or e_ch.tail() != (*hn)) continue;
@@ -364,7 +364,8 @@ void ilp_problem_t::add_constraints_to_forbid_looping_unification(
 
     pg::node_idx_t idx_explains = (from[0] == idx_explained) ? from[1] : from[0];
     hash_set<pg::node_idx_t> descendants;
-    hash_set<pg::node_idx_t> ancestors(m_graph->node(idx_explained).ancestors());
+    const util::sparse_bitset_t &ancs = m_graph->node(idx_explained).ancestors();
+    hash_set<pg::node_idx_t> ancestors(ancs.begin(), ancs.end());
 
     m_graph->enumerate_descendant_nodes(idx_explains, &descendants);
     descendants.insert(idx_explains);
@@ -531,14 +532,14 @@ bool ilp_problem_t::add_constraints_of_transitive_unification(
 
 void ilp_problem_t::add_constraints_of_transitive_unifications()
 {
-    std::list< const hash_set<term_t>* >
+    std::list< std::vector<term_t> >
         clusters = m_graph->enumerate_variable_clusters();
 
     for( auto cl = clusters.begin(); cl != clusters.end(); ++cl )
     {
-        if( (*cl)->size() <= 2 ) continue;
+        if( cl->size() <= 2 ) continue;
 
-        std::vector<term_t> terms( (*cl)->begin(), (*cl)->end() );
+        const std::vector<term_t> &terms = *cl;
         for( size_t i = 2; i < terms.size(); ++i )
         for( size_t j = 1; j < i;            ++j )
         for( size_t k = 0; k < j;            ++k )
@@ -567,11 +568,7 @@ void ilp_problem_t::enumerate_variables_for_requirement(
     }
     else
     {
-        const hash_set<pg::node_idx_t> *nodes =
-            m_graph->search_nodes_with_arity(req.literal.get_arity());
-
-        if (nodes != NULL)
-        for (auto n_idx : (*nodes))
+        for (auto n_idx : m_graph->search_nodes_with_arity(req.literal.get_arity()))
         {
             pg::edge_idx_t e = m_graph->find_unifying_edge(req.index, n_idx);
 
@@ -756,17 +753,10 @@ size_t ilp_problem_t::add_constrains_of_exclusive_chains(
 template<class T> variable_idx_t
     ilp_problem_t::find_variable_with_hypernode_unordered(T begin, T end) const
 {
-    const hash_set<pg::hypernode_idx_t> *hns =
-        m_graph->find_hypernode_with_unordered_nodes(begin, end);
-    if (hns == NULL)
-        return -1;
-    else
+    for (auto hn : m_graph->find_hypernode_with_unordered_nodes(begin, end))
     {
-        for (auto it = hns->begin(); it != hns->end(); ++it)
-        {
-            variable_idx_t i = find_variable_with_hypernode(*it);
-            if (i >= 0) return i;
-        }
+        variable_idx_t i = find_variable_with_hypernode(hn);
+        if (i >= 0) return i;
     }
     return -1;
 }
@@ -1003,7 +993,7 @@ void ilp_problem_t::_print_explanations_in_solution(
         bool is_backward = (edge.type() == pg::EDGE_HYPOTHESIZE);
         std::string s_from(util::join(hn_from.begin(), hn_from.end(), ","));
         std::string s_to(util::join(hn_to.begin(), hn_to.end(), ","));
-        std::string axiom_name = base->get_axiom(edge.axiom_id()).name;
+        std::string axiom_name = base->get_axiom(edge.axiom_id())->name;
         std::string gaps = util::join_f(
             m_graph->get_gaps_on_edge(*it),
             [](const std::pair<arity_t, arity_t> &p){return p.first + ":" + p.second; }, ",");
@@ -1149,7 +1139,9 @@ void ilp_solution_t::enumerate_unified_terms_sets(std::list<hash_set<term_t> > *
 
     assert(out->empty()); // ON BEGINNING, OUT MUST BE EMPTY.
 
-    for (auto n : graph->nodes())
+    util::union_find_t<term_t> terms;
+
+    for (const auto &n : graph->nodes())
     if (n.is_equality_node())
     {
         variable_idx_t v = problem()->find_variable_with_node(n.index());
@@ -1157,37 +1149,13 @@ void ilp_solution_t::enumerate_unified_terms_sets(std::list<hash_set<term_t> > *
         if (v >= 0)
         if (variable_is_active(v))
         {
-            const std::vector<term_t> &unified = n.literal().terms;
-            auto it_set = out->begin();
-
-            for (; it_set != out->end(); ++it_set)
-            if (it_set->count(unified.at(0)) > 0 or it_set->count(unified.at(1)) > 0)
-                break;
-
-            if (it_set == out->end())
-                out->push_back(hash_set<term_t>(unified.begin(), unified.end()));
-            else
-                it_set->insert(unified.begin(), unified.end());
-        }
-    }
-
-    while (true)
-    {
-        bool has_merged(false);
-
-        for (auto it1 = out->begin(); it1 != out->end() and not has_merged; ++it1)
-        for (auto it2 = out->begin(); it2 != it1 and not has_merged; ++it2)
-        if (it1 != it2)
-        if (util::has_intersection(it1->begin(), it1->end(), it2->begin(), it2->end()))
-        {
-            it1->insert(it2->begin(), it2->end());
-            out->erase(it2);
-            has_merged = true;
+            const literal_t::term_array_t &unified = n.literal().terms;
+            terms.unite(unified.at(0), unified.at(1));
         }
-
-        if (not has_merged) break;
     }
 
+    for (const auto &set : terms.sets())
+        out->push_back(hash_set<term_t>(set.begin(), set.end()));
 }
 
 
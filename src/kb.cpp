@@ -3,6 +3,7 @@
 #include <iomanip>
 #include <cassert>
 #include <cstring>
+#include <cstdio>
 #include <climits>
 #include <algorithm>
 #include <thread>
@@ -110,7 +111,8 @@ std::string knowledge_base_t::ms_filename = "kb";
 float knowledge_base_t::ms_max_distance = -1.0f;
 int knowledge_base_t::ms_thread_num_for_rm = 1;
 bool knowledge_base_t::ms_do_disable_stop_word = false;
-std::mutex knowledge_base_t::ms_mutex_for_cache;
+size_t knowledge_base_t::ms_distance_cache_size = DEFAULT_DISTANCE_CACHE_SIZE;
+size_t knowledge_base_t::ms_axiom_cache_size = DEFAULT_AXIOM_CACHE_SIZE;
 std::mutex knowledge_base_t::ms_mutex_for_rm;
 
 
@@ -127,7 +129,8 @@ knowledge_base_t* knowledge_base_t::instance()
 
 void knowledge_base_t::setup(
     std::string filename, float max_distance,
-    int thread_num_for_rm, bool do_disable_stop_word)
+    int thread_num_for_rm, bool do_disable_stop_word,
+    size_t distance_cache_size, size_t axiom_cache_size)
 {
     if (ms_instance != NULL)
         ms_instance.reset(NULL);
@@ -136,6 +139,8 @@ void knowledge_base_t::setup(
     ms_max_distance = max_distance;
     ms_thread_num_for_rm = thread_num_for_rm;
     ms_do_disable_stop_word = do_disable_stop_word;
+    ms_distance_cache_size = distance_cache_size;
+    ms_axiom_cache_size = axiom_cache_size;
 
     if (ms_thread_num_for_rm < 0) ms_thread_num_for_rm = 1;
 }
@@ -144,6 +149,8 @@ void knowledge_base_t::setup(
 knowledge_base_t::knowledge_base_t(const std::string &filename)
     : m_state(STATE_NULL),
       m_filename(filename), m_version(KB_VERSION_1),
+      m_generation(0), m_generation_overwritten(0),
+      m_is_appendable(false), m_is_appending(false),
       m_cdb_rhs(filename + ".rhs.cdb"),
       m_cdb_lhs(filename + ".lhs.cdb"),
       m_cdb_axiom_group(filename + ".group.cdb"),
@@ -152,7 +159,10 @@ knowledge_base_t::knowledge_base_t(const std::string &filename)
       m_cdb_pattern_to_ids(filename + ".search.cdb"),
       m_axioms(filename),
       m_arity_db(filename + ".arity.dat"),
-      m_rm(filename + ".rm.dat")
+      m_rm(filename + ".rm.dat"),
+      m_num_base_axioms(0), m_num_base_arities(0),
+      m_cache_distance(ms_distance_cache_size),
+      m_cache_axiom(ms_axiom_cache_size)
 {
     m_distance_provider = { NULL, "" };
     m_category_table = { NULL, "" };
@@ -185,6 +195,10 @@ void knowledge_base_t::prepare_compile()
 
     if (m_state == STATE_NULL)
     {
+        m_is_appending = false;
+        m_generation_overwritten = _read_generation();
+        _set_generation(0);
+
         m_axioms.prepare_compile();
         m_cdb_rhs.prepare_compile();
         m_cdb_lhs.prepare_compile();
@@ -217,6 +231,7 @@ void knowledge_base_t::prepare_query()
     if (m_state == STATE_NULL)
     {
         read_config();
+        _set_generation(m_generation);
         m_arity_db.read();
 
         m_axioms.prepare_query();
@@ -228,12 +243,71 @@ void knowledge_base_t::prepare_query()
         m_cdb_pattern_to_ids.prepare_query();
         m_rm.prepare_query();
         m_category_table.instance->prepare_query(this);
+        m_pattern_table.load(
+            m_arity_db.arities().size(), m_cdb_arity_patterns, m_cdb_pattern_to_ids);
 
         m_state = STATE_QUERY;
     }
 }
 
 
+void knowledge_base_t::prepare_append()
+{
+    if (m_distance_provider.instance == NULL)
+        throw phillip_exception_t(
+        "Preparing KB had failed, "
+        "because distance provider has not been set.");
+
+    if (m_category_table.instance == NULL)
+        throw phillip_exception_t(
+        "Preparing KB had failed, "
+        "because category table has not been set.");
+
+    if (m_state != STATE_NULL)
+        finalize();
+
+    read_config();
+
+    if (not m_is_appendable)
+        throw phillip_exception_t(
+        "This compiled knowledge base does not support appending axioms. "
+        "Please re-compile it.");
+
+    // CATEGORY-TABLES ARE COMPUTED FROM THE WHOLE OF KNOWLEDGE BASE.
+    if (m_category_table.key != "null")
+        throw phillip_exception_t(
+        "Cannot append axioms to the knowledge base with category-table \"" +
+        m_category_table.key + "\". Please re-compile it.");
+
+    int base = m_generation;
+    std::string base_idx = _get_prefix_of_generation(base) + ".index.dat";
+
+    _set_generation(base);
+    _load_current_generation();
+
+    m_rm_base.reset(new reachable_matrix_t(_get_prefix_of_generation(base) + ".rm.dat"));
+    m_rm_base->prepare_query();
+
+    _set_generation(base + 1);
+
+    m_axioms.prepare_append(base_idx);
+    m_cdb_rhs.prepare_compile();
+    m_cdb_lhs.prepare_compile();
+    m_cdb_axiom_group.prepare_compile();
+    m_cdb_arg_set.prepare_compile();
+    m_cdb_arity_patterns.prepare_compile();
+    m_cdb_pattern_to_ids.prepare_compile();
+    m_category_table.instance->prepare_compile(this);
+
+    m_num_base_axioms = m_axioms.num_axioms();
+    m_num_base_arities = m_arity_db.arities().size();
+    m_appended_arities.clear();
+
+    m_is_appending = true;
+    m_state = STATE_COMPILE;
+}
+
+
 void knowledge_base_t::finalize()
 {
     if (m_state == STATE_NULL) return;
@@ -241,31 +315,11 @@ void knowledge_base_t::finalize()
     kb_state_e state = m_state;
     m_state = STATE_NULL;
 
+    // AXIOM-IDS ARE NOT VALID ANY LONGER.
+    m_cache_axiom.clear();
+
     if (state == STATE_COMPILE)
     {
-        auto insert_cdb = [](
-            const hash_map<arity_id_t, hash_set<axiom_id_t> > &ids,
-            util::cdb_data_t *dat)
-        {
-            IF_VERBOSE_1("starts writing " + dat->filename() + "...");
-
-            for (auto it = ids.begin(); it != ids.end(); ++it)
-            {
-                size_t read_size = sizeof(size_t)+sizeof(axiom_id_t)* it->second.size();
-                char *buffer = new char[read_size];
-
-                int size = util::to_binary<size_t>(it->second.size(), buffer);
-                for (auto id = it->second.begin(); id != it->second.end(); ++id)
-                    size += util::to_binary<axiom_id_t>(*id, buffer + size);
-
-                assert(read_size == size);
-                dat->put((char*)&it->first, sizeof(arity_id_t), buffer, size);
-                delete[] buffer;
-            }
-
-            IF_VERBOSE_1("completed writing " + dat->filename() + ".");
-        };
-
         extend_inconsistency();
 
         insert_cdb(m_rhs_to_axioms, &m_cdb_rhs);
@@ -278,10 +332,15 @@ void knowledge_base_t::finalize()
         m_group_to_axioms.clear();
         m_argument_sets.clear();
 
-        set_stop_words();
+        // ON APPENDING, STOP-WORDS OF THE PREVIOUS GENERATION ARE KEPT.
+        if (not m_is_appending)
+            set_stop_words();
+        else if (not m_asserted_stop_words.empty())
+            util::print_warning(
+            "Assertions of stop-words are ignored on appending axioms.");
+
         create_query_map();
         create_reachable_matrix();
-        write_config();
         m_arity_db.write();
 
         if (phillip_main_t::verbose() == FULL_VERBOSE)
@@ -312,6 +371,7 @@ void knowledge_base_t::finalize()
         m_arity_db.clear();
     }
 
+    m_workers.reset();
     m_axioms.finalize();
     m_cdb_rhs.finalize();
     m_cdb_lhs.finalize();
@@ -321,14 +381,40 @@ void knowledge_base_t::finalize()
     m_cdb_pattern_to_ids.finalize();
     m_rm.finalize();
     m_category_table.instance->finalize();
+    m_pattern_table.clear();
+
+    if (state == STATE_COMPILE)
+    {
+        // THE CONFIGURATION IS WRITTEN LAST, SO THAT READERS SWITCH
+        // TO THE NEW GENERATION ONLY AFTER ALL OF ITS FILES HAVE BEEN WRITTEN.
+        write_config();
+
+        if (m_is_appending)
+        {
+            // THE PREVIOUS GENERATION IS KEPT FOR READERS WHICH STILL USE IT.
+            _remove_generation(m_generation - 2);
+
+            m_rm_base.reset();
+            m_appended_arities.clear();
+            m_is_appending = false;
+        }
+        else
+        {
+            // GENERATIONS APPENDED TO THE OVERWRITTEN KNOWLEDGE BASE ARE OBSOLETE.
+            for (int g = m_generation_overwritten; g > 0; --g)
+                _remove_generation(g);
+            m_generation_overwritten = 0;
+        }
+    }
 }
 
 
 void knowledge_base_t::write_config() const
 {
     std::string filename(m_filename + ".conf");
+    std::string filename_tmp(filename + ".tmp");
     std::ofstream fo(
-        filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+        filename_tmp.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
     char version(NUM_OF_KB_VERSION_TYPES - 1); // LATEST VERSION
     char num_dp = m_distance_provider.key.length();
     char num_ct = m_category_table.key.length();
@@ -346,7 +432,30 @@ void knowledge_base_t::write_config() const
     fo.write(&num_ct, sizeof(char));
     fo.write(m_category_table.key.c_str(), m_category_table.key.length());
 
+    fo.write((char*)&m_generation, sizeof(int));
+
+    size_t num_sw = m_stop_words.size();
+    fo.write((char*)&num_sw, sizeof(size_t));
+    for (auto sw : m_stop_words)
+    {
+        size_t len = sw.length();
+        fo.write((char*)&len, sizeof(size_t));
+        fo.write(sw.c_str(), len);
+    }
+
     fo.close();
+
+    if (fo.fail())
+        throw phillip_exception_t(
+        util::format("Failed to write KB-configuration file: \"%s\"", filename.c_str()));
+
+    // REPLACES THE CONFIGURATION AT ONCE.
+#ifdef _WIN32
+    std::remove(filename.c_str());
+#endif
+    if (std::rename(filename_tmp.c_str(), filename.c_str()) != 0)
+        throw phillip_exception_t(
+        util::format("Failed to write KB-configuration file: \"%s\"", filename.c_str()));
 }
 
 
@@ -388,8 +497,192 @@ void knowledge_base_t::read_config()
     key[num] = '\0';
     set_category_table(key);
 
+    // THE GENERATION AND STOP-WORDS ARE LACKING IN OLDER CONFIGURATIONS.
+    int generation(0);
+    size_t num_sw(0);
+    m_stop_words.clear();
+
+    fi.read((char*)&generation, sizeof(int));
+    fi.read((char*)&num_sw, sizeof(size_t));
+    m_is_appendable = not fi.fail();
+
+    for (size_t i = 0; i < num_sw and m_is_appendable; ++i)
+    {
+        size_t len;
+        fi.read((char*)&len, sizeof(size_t));
+        if (fi.fail()) break;
+
+        std::string sw(len, '\0');
+        fi.read(&sw[0], len);
+        m_stop_words.insert(sw);
+    }
+
+    if (fi.fail())
+    {
+        generation = 0;
+        m_is_appendable = false;
+        m_stop_words.clear();
+    }
+
+    m_generation = generation;
     fi.close();
+}
+
+
+std::string knowledge_base_t::_get_prefix_of_generation(int generation) const
+{
+    return (generation == 0) ?
+        m_filename : util::format("%s.g%d", m_filename.c_str(), generation);
+}
 
+
+void knowledge_base_t::_set_generation(int generation)
+{
+    std::string prefix = _get_prefix_of_generation(generation);
+
+    m_generation = generation;
+    m_cdb_rhs.set_filename(prefix + ".rhs.cdb");
+    m_cdb_lhs.set_filename(prefix + ".lhs.cdb");
+    m_cdb_axiom_group.set_filename(prefix + ".group.cdb");
+    m_cdb_arg_set.set_filename(prefix + ".args.cdb");
+    m_cdb_arity_patterns.set_filename(prefix + ".pattern.cdb");
+    m_cdb_pattern_to_ids.set_filename(prefix + ".search.cdb");
+    m_axioms.set_index_filename(prefix + ".index.dat");
+    m_arity_db.set_filename(prefix + ".arity.dat");
+    m_rm.set_filename(prefix + ".rm.dat");
+}
+
+
+void knowledge_base_t::_remove_generation(int generation) const
+{
+    if (generation < 0) return;
+
+    const std::string prefix = _get_prefix_of_generation(generation);
+    const std::vector<std::string> exts = {
+        ".rhs.cdb", ".lhs.cdb", ".group.cdb", ".args.cdb",
+        ".pattern.cdb", ".search.cdb", ".index.dat", ".arity.dat", ".rm.dat" };
+
+    for (auto ext : exts)
+        std::remove((prefix + ext).c_str());
+}
+
+
+int knowledge_base_t::_read_generation() const
+{
+    std::string filename(m_filename + ".conf");
+    std::ifstream fi(filename.c_str(), std::ios::in | std::ios::binary);
+    char version, num;
+    float max_distance;
+    int generation(0);
+
+    if (not fi) return 0;
+
+    // SKIPS THE VERSION, THE MAX-DISTANCE AND THE KEYS OF COMPONENTS.
+    fi.read(&version, sizeof(char));
+    fi.read((char*)&max_distance, sizeof(float));
+    for (int i = 0; i < 2; ++i)
+    {
+        fi.read(&num, sizeof(char));
+        fi.ignore(static_cast<unsigned char>(num));
+    }
+    fi.read((char*)&generation, sizeof(int));
+
+    return fi.fail() ? 0 : generation;
+}
+
+
+void knowledge_base_t::_load_current_generation()
+{
+    IF_VERBOSE_1("Loading the knowledge base of generation " +
+        util::format("%d", m_generation) + "...");
+
+    m_arity_db.read();
+
+    auto binary_to_ids = [](const char *value, hash_set<axiom_id_t> *out)
+    {
+        size_t size(0), num_id(0);
+        size += util::binary_to<size_t>(value + size, &num_id);
+
+        for (size_t j = 0; j < num_id; ++j)
+        {
+            axiom_id_t id;
+            size += util::binary_to<axiom_id_t>(value + size, &id);
+            out->insert(id);
+        }
+    };
+
+    auto load_arity_to_ids = [&](
+        const util::cdb_data_t &dat, hash_map<arity_id_t, hash_set<axiom_id_t> > *out)
+    {
+        dat.enumerate([&](const char *key, size_t ksize, const char *value, size_t vsize)
+        {
+            arity_id_t idx;
+            std::memcpy(&idx, key, sizeof(arity_id_t));
+            binary_to_ids(value, &(*out)[idx]);
+        });
+    };
+
+    load_arity_to_ids(m_cdb_rhs, &m_rhs_to_axioms);
+    load_arity_to_ids(m_cdb_lhs, &m_lhs_to_axioms);
+
+    m_cdb_axiom_group.enumerate(
+        [&](const char *key, size_t ksize, const char *value, size_t vsize)
+    {
+        // KEYS BEGINNING WITH '#' ARE AXIOM-IDS, WHICH ARE REBUILT ON WRITING.
+        if (ksize > 0 and key[0] != '#')
+            binary_to_ids(value, &m_group_to_axioms[std::string(key, ksize)]);
+    });
+
+    std::map<argument_set_id_t, hash_set<std::string> > id_to_args;
+    m_cdb_arg_set.enumerate(
+        [&](const char *key, size_t ksize, const char *value, size_t vsize)
+    {
+        argument_set_id_t id;
+        std::memcpy(&id, value, sizeof(argument_set_id_t));
+        id_to_args[id].insert(std::string(key, ksize));
+    });
+    for (auto &e : id_to_args)
+        m_argument_sets.push_back(e.second);
+
+    m_cdb_arity_patterns.enumerate(
+        [&](const char *key, size_t ksize, const char *value, size_t vsize)
+    {
+        arity_id_t idx;
+        size_t num_query, size(0);
+
+        std::memcpy(&idx, key, sizeof(arity_id_t));
+        size += util::binary_to<size_t>(value, &num_query);
+
+        std::set<arity_pattern_t> &queries = m_base_arity_to_queries[idx];
+        for (size_t i = 0; i < num_query; ++i)
+        {
+            arity_pattern_t q;
+            size += binary_to_query(value + size, &q);
+            queries.insert(q);
+        }
+    });
+
+    m_cdb_pattern_to_ids.enumerate(
+        [&](const char *key, size_t ksize, const char *value, size_t vsize)
+    {
+        arity_pattern_t q;
+        size_t size(0), num_id(0);
+        binary_to_query(key, &q);
+
+        std::set<std::pair<axiom_id_t, bool> > &ids = m_base_pattern_to_ids[q];
+        size += util::binary_to<size_t>(value + size, &num_id);
+
+        for (size_t i = 0; i < num_id; ++i)
+        {
+            axiom_id_t id;
+            char flag;
+            size += util::binary_to<axiom_id_t>(value + size, &id);
+            size += util::binary_to<char>(value + size, &flag);
+            ids.insert(std::make_pair(id, flag != 0x00));
+        }
+    });
+
+    IF_VERBOSE_1("Completed loading the knowledge base.");
 }
 
 
@@ -412,7 +705,11 @@ axiom_id_t knowledge_base_t::insert_implication(
         std::vector<const lf::logical_function_t*> branches;
         func.enumerate_literal_branches(&branches);
         for (auto br : branches)
-            m_arity_db.add(br->literal().get_arity());
+        {
+            arity_id_t idx = m_arity_db.add(br->literal().get_arity());
+            if (m_is_appending)
+                m_appended_arities.insert(idx);
+        }
 
         // IF func IS CATEGORICAL KNOWLEDGE, IT IS INSERTED TO CATEGORY-TABLE.
         if (m_category_table.instance->insert(func))
@@ -537,7 +834,7 @@ void knowledge_base_t::insert_argument_set(const lf::logical_function_t &f)
     else
     {
         hash_set<std::string> *pivot = NULL;
-        const std::vector<term_t> &terms(f.literal().terms);
+        const literal_t::term_array_t &terms(f.literal().terms);
         hash_set<std::string> args(terms.begin(), terms.end());
 
         for (auto it_set = m_argument_sets.begin(); it_set != m_argument_sets.end();)
@@ -627,64 +924,6 @@ search_argument_set_id(const std::string &arity, int term_idx) const
 }
 
 
-void knowledge_base_t::search_arity_patterns(arity_id_t arity, std::list<arity_pattern_t> *out) const
-{
-    if (not m_cdb_arity_patterns.is_readable())
-    {
-        util::print_warning("kb-search: Kb-state is invalid.");
-        return;
-    }
-
-    size_t value_size;
-    const char *value = (const char*)
-        m_cdb_arity_patterns.get(&arity, sizeof(arity_id_t), &value_size);
-
-    if (value != NULL)
-    {
-        size_t num_query, read_size(0);
-        read_size += util::binary_to<size_t>(value, &num_query);
-        out->assign(num_query, arity_pattern_t());
-
-        for (auto it = out->begin(); it != out->end(); ++it)
-            read_size += binary_to_query(value + read_size, &(*it));
-    }
-}
-
-
-void knowledge_base_t::search_axioms_with_arity_pattern(
-    const arity_pattern_t &query,
-    std::list<std::pair<axiom_id_t, bool> > *out) const
-{
-    if (not m_cdb_pattern_to_ids.is_readable())
-    {
-        util::print_warning("kb-search: Kb-state is invalid.");
-        return;
-    }
-
-    std::vector<char> key;
-    query_to_binary(query, &key);
-
-    size_t value_size;
-    const char *value = (const char*)
-        m_cdb_pattern_to_ids.get(&key[0], key.size(), &value_size);
-
-    if (value != NULL)
-    {
-        size_t size(0), num_id(0);
-        size += util::binary_to<size_t>(value + size, &num_id);
-        out->assign(num_id, std::pair<axiom_id_t, bool>());
-
-        for (auto it = out->begin(); it != out->end(); ++it)
-        {
-            char flag;
-            size += util::binary_to<axiom_id_t>(value + size, &(it->first));
-            size += util::binary_to<char>(value + size, &flag);
-            it->second = (flag != 0x00);
-        }
-    }
-}
-
-
 void knowledge_base_t::set_distance_provider(
     const std::string &key, phillip_main_t *ph)
 {
@@ -720,25 +959,52 @@ void knowledge_base_t::set_category_table(
 float knowledge_base_t::get_distance(
     const std::string &arity1, const std::string &arity2 ) const
 {
-    arity_id_t get1 = search_arity_id(arity1);
-    arity_id_t get2 = search_arity_id(arity2);
+    return get_distance(search_arity_id(arity1), search_arity_id(arity2));
+}
+
+
+float knowledge_base_t::get_distance(arity_id_t get1, arity_id_t get2) const
+{
     if (get1 == INVALID_ARITY_ID or get2 == INVALID_ARITY_ID) return -1.0f;
 
-    std::lock_guard<std::mutex> lock(ms_mutex_for_cache);
-    auto found1 = m_cache_distance.find(get1);
-    if (found1 != m_cache_distance.end())
+    float dist;
+    util::metrics_t::count("kb.get_distance");
+    if (m_cache_distance.find(get1, get2, &dist))
     {
-        auto found2 = found1->second.find(get2);
-        if (found2 != found1->second.end())
-            return found2->second;
+        util::metrics_t::count("kb.distance_cache.hits");
+        return dist;
     }
 
-    float dist(m_rm.get(get1, get2));
-    m_cache_distance[get1][get2] = dist;
+    util::metrics_t::count("kb.distance_cache.misses");
+    dist = m_rm.get(get1, get2);
+    m_cache_distance.insert(get1, get2, dist);
     return dist;
 }
 
 
+void knowledge_base_t::insert_cdb(
+    const hash_map<arity_id_t, hash_set<axiom_id_t> > &ids, util::cdb_data_t *dat)
+{
+    IF_VERBOSE_1("starts writing " + dat->filename() + "...");
+
+    for (auto it = ids.begin(); it != ids.end(); ++it)
+    {
+        size_t read_size = sizeof(size_t)+sizeof(axiom_id_t)* it->second.size();
+        char *buffer = new char[read_size];
+
+        int size = util::to_binary<size_t>(it->second.size(), buffer);
+        for (auto id = it->second.begin(); id != it->second.end(); ++id)
+            size += util::to_binary<axiom_id_t>(*id, buffer + size);
+
+        assert(read_size == size);
+        dat->put((char*)&it->first, sizeof(arity_id_t), buffer, size);
+        delete[] buffer;
+    }
+
+    IF_VERBOSE_1("completed writing " + dat->filename() + ".");
+}
+
+
 void knowledge_base_t::insert_axiom_group_to_cdb()
 {
     util::cdb_data_t &dat(m_cdb_axiom_group);
@@ -818,15 +1084,26 @@ void knowledge_base_t::set_stop_words()
     m_axioms.prepare_query();
 
     typedef std::pair <std::string, char> term_pos_t;
-    hash_map<arity_t, hash_set<term_idx_t> > candidates;
-    std::set<term_pos_t> excluded;
-    hash_map<std::string, size_t> counts; // ARITY FREQUENCY IN EVIDENCE
-    std::set<std::list<std::string> > arities_set; // ARITY SET IN EVIDENCE
-    hash_map<arity_t, hash_map<term_idx_t, std::list<std::string> > >
-        names_of_axiom_excludes_expected_stop_word;
+    struct result_t
+    {
+        hash_map<arity_t, hash_set<term_idx_t> > candidates;
+        std::set<term_pos_t> excluded;
+        hash_map<std::string, size_t> counts; // ARITY FREQUENCY IN EVIDENCE
+        std::set<std::list<std::string> > arities_set; // ARITY SET IN EVIDENCE
+        hash_map<arity_t, hash_map<term_idx_t, std::list<std::string> > >
+            names_of_axiom_excludes_expected_stop_word;
+    };
 
-    auto proc = [&](const lf::axiom_t &ax, bool is_backward)
+    auto proc = [&](const lf::axiom_t &ax, bool is_backward, result_t *out)
     {
+        hash_map<arity_t, hash_set<term_idx_t> > &candidates(out->candidates);
+        std::set<term_pos_t> &excluded(out->excluded);
+        hash_map<std::string, size_t> &counts(out->counts);
+        std::set<std::list<std::string> > &arities_set(out->arities_set);
+        hash_map<arity_t, hash_map<term_idx_t, std::list<std::string> > >
+            &names_of_axiom_excludes_expected_stop_word(
+            out->names_of_axiom_excludes_expected_stop_word);
+
         auto evd = is_backward ? ax.func.get_rhs() : ax.func.get_lhs();
         auto hyp = is_backward ? ax.func.get_lhs() : ax.func.get_rhs();
         hash_set<term_t> terms_evd;
@@ -879,25 +1156,48 @@ void knowledge_base_t::set_stop_words()
         }
     };
 
-    for (axiom_id_t id = 0; id < m_axioms.num_axioms(); ++id)
-    {
-        lf::axiom_t ax = m_axioms.get(id);
+    std::vector<result_t> results(_get_num_of_scanning_threads());
 
+    _scan_axioms(results.size(), [&](int th_id, const lf::axiom_t &ax)
+    {
         if (ax.func.is_operator(lf::OPR_IMPLICATION))
-            proc(ax, true);
+            proc(ax, true, &results[th_id]);
         else if (ax.func.is_operator(lf::OPR_PARAPHRASE))
         {
-            proc(ax, true);
-            proc(ax, false);
+            proc(ax, true, &results[th_id]);
+            proc(ax, false, &results[th_id]);
         }
-
-        if (id % 10 == 0 and phillip_main_t::verbose() >= VERBOSE_1)
+    });
+
+    // MERGE THE RESULTS OF EACH THREAD IN ORDER OF AXIOM-ID
+    result_t &merged(results.front());
+    for (size_t i = 1; i < results.size(); ++i)
+    {
+        result_t &r(results[i]);
+
+        for (auto &e : r.candidates)
+            merged.candidates[e.first].insert(e.second.begin(), e.second.end());
+        merged.excluded.insert(r.excluded.begin(), r.excluded.end());
+        for (auto &e : r.counts)
+            merged.counts[e.first] += e.second;
+        merged.arities_set.insert(r.arities_set.begin(), r.arities_set.end());
+        for (auto &e1 : r.names_of_axiom_excludes_expected_stop_word)
+        for (auto &e2 : e1.second)
         {
-            float progress = (float)(id)* 100.0f / (float)m_axioms.num_axioms();
-            std::cerr << util::format("processed %d axioms [%.4f%%]\r", id, progress);
+            std::list<std::string> &names =
+                merged.names_of_axiom_excludes_expected_stop_word[e1.first][e2.first];
+            names.splice(names.end(), e2.second);
         }
     }
 
+    hash_map<arity_t, hash_set<term_idx_t> > &candidates(merged.candidates);
+    std::set<term_pos_t> &excluded(merged.excluded);
+    hash_map<std::string, size_t> &counts(merged.counts);
+    std::set<std::list<std::string> > &arities_set(merged.arities_set);
+    hash_map<arity_t, hash_map<term_idx_t, std::list<std::string> > >
+        &names_of_axiom_excludes_expected_stop_word(
+        merged.names_of_axiom_excludes_expected_stop_word);
+
     // CHECK WHETHER THERE ARE ASSERTED STOP-WORDS IN candidates
     {
         for (auto e : m_asserted_stop_words)
@@ -1025,8 +1325,16 @@ void knowledge_base_t::create_query_map()
     std::map<arity_id_t, std::set<arity_pattern_t> > arity_to_queries;
     std::map<arity_pattern_t, std::set< std::pair<axiom_id_t, bool> > > pattern_to_ids;
 
-    auto proc = [this, &pattern_to_ids, &arity_to_queries](
-        const lf::axiom_t &ax, bool is_backward)
+    // ON APPENDING, ONLY APPENDED AXIOMS ARE ADDED TO THE PATTERNS OF THE PREVIOUS GENERATION.
+    arity_to_queries.swap(m_base_arity_to_queries);
+    pattern_to_ids.swap(m_base_pattern_to_ids);
+
+    typedef std::map<arity_id_t, std::set<arity_pattern_t> > arity_to_queries_t;
+    typedef std::map<arity_pattern_t, std::set< std::pair<axiom_id_t, bool> > > pattern_to_ids_t;
+
+    auto proc = [this](
+        const lf::axiom_t &ax, bool is_backward,
+        pattern_to_ids_t *pattern_to_ids, arity_to_queries_t *arity_to_queries)
     {
         std::vector<const lf::logical_function_t*> branches;
         hash_map<string_hash_t, std::set<std::pair<arity_id_t, char> > > term2arity;
@@ -1060,30 +1368,40 @@ void knowledge_base_t::create_query_map()
         if (category_table()->do_target(branches[i]->literal().get_arity()))
             std::get<2>(query).push_back(i);
 
-        pattern_to_ids[query].insert(std::make_pair(ax.id, is_backward));
+        (*pattern_to_ids)[query].insert(std::make_pair(ax.id, is_backward));
 
         for (auto idx : std::get<0>(query))
         if (m_stop_words.count(search_arity(idx)) == 0)
-            arity_to_queries[idx].insert(query);
+            (*arity_to_queries)[idx].insert(query);
     };
 
-    for (axiom_id_t i = 0; i < m_axioms.num_axioms(); ++i)
+    int num_thread = _get_num_of_scanning_threads();
+    std::vector<pattern_to_ids_t> partial_pattern_to_ids(num_thread);
+    std::vector<arity_to_queries_t> partial_arity_to_queries(num_thread);
+
+    _scan_axioms(num_thread, [&](int th_id, const lf::axiom_t &ax)
     {
-        lf::axiom_t ax = get_axiom(i);
+        pattern_to_ids_t *p2i = &partial_pattern_to_ids[th_id];
+        arity_to_queries_t *a2q = &partial_arity_to_queries[th_id];
 
         if (ax.func.is_operator(lf::OPR_IMPLICATION))
-            proc(ax, true);
+            proc(ax, true, p2i, a2q);
         else if (ax.func.is_operator(lf::OPR_PARAPHRASE))
         {
-            proc(ax, true);
-            proc(ax, false);
+            proc(ax, true, p2i, a2q);
+            proc(ax, false, p2i, a2q);
         }
+    }, (m_is_appending ? m_num_base_axioms : 0));
 
-        if (i % 10 == 0 and phillip_main_t::verbose() >= VERBOSE_1)
-        {
-            float progress = (float)(i)* 100.0f / (float)m_axioms.num_axioms();
-            std::cerr << util::format("processed %d axioms [%.4f%%]\r", i, progress);
-        }
+    for (int i = 0; i < num_thread; ++i)
+    {
+        for (auto &e : partial_pattern_to_ids[i])
+            pattern_to_ids[e.first].insert(e.second.begin(), e.second.end());
+        for (auto &e : partial_arity_to_queries[i])
+            arity_to_queries[e.first].insert(e.second.begin(), e.second.end());
+
+        partial_pattern_to_ids[i].clear();
+        partial_arity_to_queries[i].clear();
     }
 
     m_cdb_arity_patterns.prepare_compile();
@@ -1185,46 +1503,79 @@ void knowledge_base_t::create_reachable_matrix()
 
     _create_reachable_matrix_direct(ignored, &base_lhs, &base_rhs, &base_para);
 
+    reachability_graph_t graph(
+        arities.size(), base_lhs, base_rhs, base_para, get_max_distance());
+    base_lhs.clear();
+    base_rhs.clear();
+    base_para.clear();
+
+    // ON APPENDING, ROWS ARE RE-COMPUTED ONLY FOR APPENDED ARITIES AND
+    // ARITIES WITHIN THE MAX-DISTANCE FROM THEM IN THE PREVIOUS GENERATION.
+    // THE OTHER ROWS ARE COPIED FROM THE PREVIOUS GENERATION.
+    std::vector<char> do_compute(arities.size(), 1);
+    if (m_is_appending)
+    {
+        hash_map<size_t, float> row;
+
+        for (arity_id_t idx = 0; idx < m_num_base_arities; ++idx)
+            do_compute[idx] = (m_appended_arities.count(idx) > 0);
+
+        for (arity_id_t idx = 0; idx < m_rm_base->num_rows(); ++idx)
+        {
+            m_rm_base->get(idx, &row);
+
+            for (auto it = row.begin(); it != row.end(); ++it)
+            {
+                if (m_appended_arities.count(it->first) > 0)
+                    do_compute[idx] = 1;
+                if (m_appended_arities.count(idx) > 0 and it->first < arities.size())
+                    do_compute[it->first] = 1;
+            }
+        }
+
+        IF_VERBOSE_3(util::format("  num of re-computed rows = %d",
+            static_cast<int>(std::count(do_compute.begin(), do_compute.end(), 1))));
+    }
+
     IF_VERBOSE_2("  writing reachable matrix...");
-    std::vector<std::thread> worker;
     int num_thread =
         std::min<int>(arities.size(),
         std::min<int>(ms_thread_num_for_rm, std::thread::hardware_concurrency()));
 
-    for (int th_id = 0; th_id < num_thread; ++th_id)
-    {
-        worker.emplace_back(
-            [&](int th_id)
-            {
-                for(arity_id_t idx = th_id; idx < arities.size(); idx += num_thread)
-                {
-                    if (ignored.count(idx) != 0) continue;
+    _get_workers(num_thread).run(num_thread,
+        [&](int th_id)
+        {
+            reachability_graph_t::workspace_t ws(graph);
 
-                    hash_map<arity_id_t, float> dist;
-                    _create_reachable_matrix_indirect(
-                        idx, base_lhs, base_rhs, base_para, &dist);
-                    m_rm.put(idx, dist);
+            for(arity_id_t idx = th_id; idx < arities.size(); idx += num_thread)
+            {
+                if (ignored.count(idx) != 0) continue;
 
-                    ms_mutex_for_rm.lock();
+                hash_map<arity_id_t, float> dist;
+                if (do_compute[idx])
+                    _create_reachable_matrix_indirect(idx, graph, &ws, &dist);
+                else
+                    m_rm_base->get(idx, &dist);
+                m_rm.put(idx, dist);
 
-                    num_inserted += dist.size();
-                    ++processed;
+                ms_mutex_for_rm.lock();
 
-                    clock_t c = clock();
-                    if (c - clock_past > CLOCKS_PER_SEC)
-                    {
-                        float progress = (float)(processed)* 100.0f / (float)arities.size();
-                        std::cerr << util::format(
-                            "processed %d tokens [%.4f%%]\r", processed, progress);
-                        std::cerr.flush();
-                        clock_past = c;
-                    }
+                num_inserted += dist.size();
+                ++processed;
 
-                    ms_mutex_for_rm.unlock();
+                clock_t c = clock();
+                if (c - clock_past > CLOCKS_PER_SEC)
+                {
+                    float progress = (float)(processed)* 100.0f / (float)arities.size();
+                    std::cerr << util::format(
+                        "processed %d tokens [%.4f%%]\r", processed, progress);
+                    std::cerr.flush();
+                    clock_past = c;
                 }
-            }, th_id);
-    }
-    for (auto &t : worker) t.join();
+
+                ms_mutex_for_rm.unlock();
+            }
+        });
 
     time(&time_end);
     int proc_time(time_end - time_start);
@@ -1244,7 +1595,6 @@ void knowledge_base_t::_create_reachable_matrix_direct(
     hash_map<arity_id_t, hash_map<arity_id_t, float> > *out_rhs,
     std::set<std::pair<arity_id_t, arity_id_t> > *out_para)
 {
-    size_t num_processed(0);
     const std::vector<arity_t> &arities = m_arity_db.arities();
 
     // SET VALUES IN CATEGORY-TABLE TO REACHABLE-MATRIX
@@ -1270,9 +1620,25 @@ void knowledge_base_t::_create_reachable_matrix_direct(
         }
     }
 
-    for (axiom_id_t id = 0; id < m_axioms.num_axioms(); ++id)
+    struct result_t
+    {
+        hash_map<arity_id_t, hash_map<arity_id_t, float> > lhs, rhs;
+        std::set<std::pair<arity_id_t, arity_id_t> > para;
+    };
+    std::vector<result_t> results(_get_num_of_scanning_threads());
+
+    auto set_min = [](hash_map<arity_id_t, float> *target, arity_id_t idx, float dist)
+    {
+        auto found = target->find(idx);
+        if (found == target->end())
+            (*target)[idx] = dist;
+        else if (dist < found->second)
+            found->second = dist;
+    };
+
+    _scan_axioms(results.size(), [&](int th_id, const lf::axiom_t &axiom)
     {
-        lf::axiom_t axiom = get_axiom(id);
+        result_t &out = results[th_id];
 
         if (axiom.func.is_operator(lf::OPR_IMPLICATION) or
             axiom.func.is_operator(lf::OPR_PARAPHRASE))
@@ -1310,127 +1676,368 @@ void knowledge_base_t::_create_reachable_matrix_direct(
 
                 for (auto it_l = lhs_ids.begin(); it_l != lhs_ids.end(); ++it_l)
                 {
-                    hash_map<arity_id_t, float> &target = (*out_lhs)[*it_l];
+                    hash_map<arity_id_t, float> &target = out.lhs[*it_l];
                     for (auto it_r = rhs_ids.begin(); it_r != rhs_ids.end(); ++it_r)
-                    {
-                        auto found = target.find(*it_r);
-                        if (found == target.end())
-                            target[*it_r] = dist;
-                        else if (dist < found->second)
-                            target[*it_r] = dist;
-                    }
+                        set_min(&target, *it_r, dist);
                 }
 
                 for (auto it_r = rhs_ids.begin(); it_r != rhs_ids.end(); ++it_r)
                 {
-                    hash_map<arity_id_t, float> &target = (*out_rhs)[*it_r];
+                    hash_map<arity_id_t, float> &target = out.rhs[*it_r];
                     for (auto it_l = lhs_ids.begin(); it_l != lhs_ids.end(); ++it_l)
-                    {
-                        auto found = target.find(*it_l);
-                        if (found == target.end())
-                            target[*it_l] = dist;
-                        else if (dist < found->second)
-                            target[*it_l] = dist;
-                    }
+                        set_min(&target, *it_l, dist);
                 }
 
                 if (axiom.func.is_operator(lf::OPR_PARAPHRASE))
                 for (auto it_l = lhs_ids.begin(); it_l != lhs_ids.end(); ++it_l)
                 for (auto it_r = rhs_ids.begin(); it_r != rhs_ids.end(); ++it_r)
-                    out_para->insert(util::make_sorted_pair(*it_l, *it_r));
+                    out.para.insert(util::make_sorted_pair(*it_l, *it_r));
             }
         }
+    });
 
-        if (++num_processed % 10 == 0 and phillip_main_t::verbose() >= VERBOSE_1)
+    // MERGE THE RESULTS OF EACH THREAD
+    for (auto &r : results)
+    {
+        for (auto &e1 : r.lhs)
         {
-            float progress = (float)(num_processed)* 100.0f / (float)m_axioms.num_axioms();
-            std::cerr << util::format("processed %d axioms [%.4f%%]\r", num_processed, progress);
+            hash_map<arity_id_t, float> &target = (*out_lhs)[e1.first];
+            for (auto &e2 : e1.second)
+                set_min(&target, e2.first, e2.second);
         }
+
+        for (auto &e1 : r.rhs)
+        {
+            hash_map<arity_id_t, float> &target = (*out_rhs)[e1.first];
+            for (auto &e2 : e1.second)
+                set_min(&target, e2.first, e2.second);
+        }
+
+        out_para->insert(r.para.begin(), r.para.end());
+
+        r.lhs.clear();
+        r.rhs.clear();
+        r.para.clear();
     }
 }
 
 
+int knowledge_base_t::_get_num_of_scanning_threads() const
+{
+    int num = std::min<int>(
+        ms_thread_num_for_rm, std::thread::hardware_concurrency());
+    num = std::min<int>(num, m_axioms.num_axioms());
+    return std::max<int>(num, 1);
+}
+
+
+void knowledge_base_t::_scan_axioms(
+    int num_thread, const std::function<void(int, const lf::axiom_t&)> &proc,
+    axiom_id_t begin) const
+{
+    const axiom_id_t num_axioms = m_axioms.num_axioms() - begin;
+    std::atomic<axiom_id_t> num_processed(0);
+
+    // EACH THREAD PROCESSES A CONTIGUOUS RANGE OF AXIOMS,
+    // SO THAT MERGING RESULTS IN ORDER OF THREADS KEEPS THE ORDER OF AXIOMS.
+    auto run = [&](int th_id)
+    {
+        axiom_id_t first = begin + num_axioms * th_id / num_thread;
+        axiom_id_t last = begin + num_axioms * (th_id + 1) / num_thread;
+
+        for (axiom_id_t id = first; id < last; ++id)
+        {
+            proc(th_id, m_axioms.get(id));
+
+            axiom_id_t n = ++num_processed;
+            if (th_id == 0 and n % 10 == 0 and phillip_main_t::verbose() >= VERBOSE_1)
+            {
+                float progress = (float)(n)* 100.0f / (float)num_axioms;
+                std::cerr << util::format("processed %d axioms [%.4f%%]\r", n, progress);
+            }
+        }
+    };
+
+    if (num_thread <= 1)
+        run(0);
+    else
+        _get_workers(num_thread).run(num_thread, run);
+}
+
+
+util::worker_pool_t& knowledge_base_t::_get_workers(int num_thread) const
+{
+    if (not m_workers or m_workers->size() < num_thread)
+        m_workers.reset(new util::worker_pool_t(std::max(num_thread, 1)));
+    return *m_workers;
+}
+
+
 void knowledge_base_t::_create_reachable_matrix_indirect(
-    arity_id_t target,
-    const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base_lhs,
-    const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base_rhs,
-    const std::set<std::pair<arity_id_t, arity_id_t> > &base_para,
+    arity_id_t target, const reachability_graph_t &graph,
+    reachability_graph_t::workspace_t *ws,
     hash_map<arity_id_t, float> *out) const
 {
-    if (base_lhs.count(target) == 0 or base_rhs.count(target) == 0) return;
+    if (not graph.forward.has_row[target] or not graph.backward.has_row[target])
+        return;
 
-    std::map<std::tuple<arity_id_t, bool, bool>, float> current;
-    std::map<std::tuple<arity_id_t, bool, bool>, float> processed;
+    /* LABEL-CORRECTING DIJKSTRA ON A CIRCULAR BUCKET-QUEUE.
+     * A STATE IS (ARITY, CAN-ABDUCTION, CAN-DEDUCTION),
+     * WHICH IS ENCODED AS (ARITY * 4 + CAN-ABDUCTION * 2 + CAN-DEDUCTION). */
+    const float max_dist = get_max_distance();
+    const float width = graph.bucket_width;
+    const size_t num_buckets = graph.num_buckets;
 
-    current[std::make_tuple(target, true, true)] = 0.0f;
-    processed[std::make_tuple(target, true, true)] = 0.0f;
-    (*out)[target] = 0.0f;
+    if (++ws->stamp == 0)
+    {
+        std::fill(ws->stamps.begin(), ws->stamps.end(), 0);
+        ws->stamp = 1;
+    }
+    ws->touched.clear();
 
-    while (not current.empty())
+    size_t num_queued(0), current(0);
+    auto push = [&](std::uint32_t state, float dist)
     {
-        std::map<std::tuple<arity_id_t, bool, bool>, float> next;
-        auto _process = [&](
-            arity_id_t idx1, bool can_abduction, bool can_deduction,
-            float dist, bool is_forward)
+        if (ws->stamps[state] != ws->stamp)
         {
-            const hash_map<arity_id_t, hash_map<arity_id_t, float> >
-                &base = (is_forward ? base_lhs : base_rhs);
-            auto found = base.find(idx1);
+            ws->stamps[state] = ws->stamp;
+            ws->touched.push_back(state);
+        }
+        ws->dists[state] = dist;
+
+        size_t b = std::max<size_t>(static_cast<size_t>(dist / width), current);
+        ws->buckets[b % num_buckets].push_back(std::make_pair(state, dist));
+        ++num_queued;
+    };
+
+    push(static_cast<std::uint32_t>(target * 4 + 3), 0.0f);
+
+    while (num_queued > 0)
+    {
+        std::vector<std::pair<std::uint32_t, float> > &bucket =
+            ws->buckets[current % num_buckets];
+
+        while (not bucket.empty())
+        {
+            std::uint32_t state = bucket.back().first;
+            float dist = bucket.back().second;
+            bucket.pop_back();
+            --num_queued;
+
+            // SKIP AN ENTRY WHOSE STATE HAS BEEN QUEUED AGAIN WITH SHORTER DISTANCE.
+            if (dist > ws->dists[state])
+                continue;
 
-            if (found != base.end())
-            for (auto it2 = found->second.begin(); it2 != found->second.end(); ++it2)
+            arity_id_t idx1 = state / 4;
+            bool can_abduction = ((state & 2) != 0);
+            bool can_deduction = ((state & 1) != 0);
+
+            for (int k = 0; k < 2; ++k)
             {
-                arity_id_t idx2(it2->first);
-                if (idx1 == idx2) continue;
-
-                bool is_paraphrasal =
-                    (base_para.count(util::make_sorted_pair(idx1, idx2)) > 0);
-                if (not is_paraphrasal and
-                    ((is_forward and not can_deduction) or
-                    (not is_forward and not can_abduction)))
-                    continue;
-
-                float dist_new(dist + it2->second); // DISTANCE idx1 ~ idx2
-                if (get_max_distance() < 0.0f or dist_new <= get_max_distance())
-                {
-                    std::tuple<arity_id_t, bool, bool> key =
-                        std::make_tuple(idx2, can_abduction, can_deduction);
+                bool is_forward = (k == 1);
+                const reachability_graph_t::edges_t &edges =
+                    is_forward ? graph.forward : graph.backward;
 
-                    // ONCE DONE DEDUCTION, YOU CANNOT DO ABDUCTION!
-                    if (is_forward and not is_paraphrasal) std::get<1>(key) = false;
+                for (size_t e = edges.offsets[idx1]; e < edges.offsets[idx1 + 1]; ++e)
+                {
+                    bool is_paraphrasal = (edges.is_paraphrasal[e] != 0);
+                    if (not is_paraphrasal and
+                        ((is_forward and not can_deduction) or
+                        (not is_forward and not can_abduction)))
+                        continue;
 
-                    bool do_add(false);
-                    auto found = processed.find(key);
-                    if (found == processed.end())  do_add = true;
-                    else if (dist_new < found->second) do_add = true;
+                    float dist_new(dist + edges.dists[e]); // DISTANCE idx1 ~ idx2
+                    if (max_dist >= 0.0f and dist_new > max_dist) continue;
 
-                    if (do_add)
-                    {
-                        next[key] = dist_new;
-                        processed[key] = dist_new;
+                    // ONCE DONE DEDUCTION, YOU CANNOT DO ABDUCTION!
+                    bool abd = can_abduction and (is_paraphrasal or not is_forward);
+                    std::uint32_t state2 =
+                        edges.targets[e] * 4 + (abd ? 2 : 0) + (can_deduction ? 1 : 0);
 
-                        auto found_out = out->find(idx2);
-                        if (found_out == out->end())           (*out)[idx2] = dist_new;
-                        else if (dist_new < found_out->second) (*out)[idx2] = dist_new;
-                    }
+                    if (ws->stamps[state2] != ws->stamp or dist_new < ws->dists[state2])
+                        push(state2, dist_new);
                 }
             }
-        };
+        }
+
+        ++current;
+    }
+
+    for (auto state : ws->touched)
+    {
+        arity_id_t idx = state / 4;
+        float dist = ws->dists[state];
+        auto found = out->find(idx);
+
+        if (found == out->end()) (*out)[idx] = dist;
+        else if (dist < found->second) found->second = dist;
+    }
+}
+
+
+void knowledge_base_t::arity_pattern_table_t::load(
+    size_t num_arities,
+    const util::cdb_data_t &arity_to_patterns,
+    const util::cdb_data_t &pattern_to_axioms)
+{
+    clear();
+
+    // SORT PATTERNS TO ASSIGN IDS IN ORDER OF THEM.
+    std::map<arity_pattern_t, std::pair<pattern_id_t, std::string> > pattern_to_value;
 
-        for (auto it1 = current.begin(); it1 != current.end(); ++it1)
+    pattern_to_axioms.enumerate(
+        [&](const char *key, size_t ksize, const char *value, size_t vsize)
+    {
+        arity_pattern_t q;
+        binary_to_query(key, &q);
+        pattern_to_value[q].second.assign(value, vsize);
+    });
+
+    axiom_offsets.reserve(pattern_to_value.size() + 1);
+    patterns.reserve(pattern_to_value.size());
+
+    for (auto &e : pattern_to_value)
+    {
+        const char *value = e.second.second.data();
+        size_t size(0), num_id(0);
+        size += util::binary_to<size_t>(value + size, &num_id);
+
+        e.second.first = static_cast<pattern_id_t>(patterns.size());
+        patterns.push_back(e.first);
+        axiom_offsets.push_back(axioms.size());
+
+        for (size_t i = 0; i < num_id; ++i)
+        {
+            axiom_id_t id;
+            char flag;
+            size += util::binary_to<axiom_id_t>(value + size, &id);
+            size += util::binary_to<char>(value + size, &flag);
+            axioms.push_back(std::make_pair(id, flag != 0x00));
+        }
+
+        e.second.second.clear();
+    }
+    axiom_offsets.push_back(axioms.size());
+
+    std::vector<std::vector<pattern_id_t> > arity_to_ids(num_arities);
+
+    arity_to_patterns.enumerate(
+        [&](const char *key, size_t ksize, const char *value, size_t vsize)
+    {
+        arity_id_t arity;
+        size_t num_query, size(0);
+
+        std::memcpy(&arity, key, sizeof(arity_id_t));
+        size += util::binary_to<size_t>(value, &num_query);
+
+        if (arity >= arity_to_ids.size())
+            arity_to_ids.resize(arity + 1);
+
+        for (size_t i = 0; i < num_query; ++i)
+        {
+            arity_pattern_t q;
+            size += binary_to_query(value + size, &q);
+
+            auto found = pattern_to_value.find(q);
+            if (found != pattern_to_value.end())
+                arity_to_ids[arity].push_back(found->second.first);
+        }
+    });
+
+    arity_offsets.reserve(arity_to_ids.size() + 1);
+    for (auto &ids : arity_to_ids)
+    {
+        std::sort(ids.begin(), ids.end());
+        arity_offsets.push_back(arity_patterns.size());
+        arity_patterns.insert(arity_patterns.end(), ids.begin(), ids.end());
+    }
+    arity_offsets.push_back(arity_patterns.size());
+}
+
+
+void knowledge_base_t::arity_pattern_table_t::clear()
+{
+    patterns.clear();
+    arity_offsets.clear();
+    arity_patterns.clear();
+    axiom_offsets.clear();
+    axioms.clear();
+}
+
+
+knowledge_base_t::reachability_graph_t::reachability_graph_t(
+    size_t num,
+    const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base_lhs,
+    const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base_rhs,
+    const std::set<std::pair<arity_id_t, arity_id_t> > &base_para,
+    float max_distance)
+    : num_arities(num), bucket_width(1.0f), num_buckets(2)
+{
+    float min_positive(-1.0f), max_edge(0.0f);
+
+    auto build = [&](
+        const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base,
+        edges_t *out)
+    {
+        out->offsets.assign(num + 1, 0);
+        out->has_row.assign(num, 0);
+
+        for (arity_id_t idx1 = 0; idx1 < num; ++idx1)
         {
-            arity_id_t idx = std::get<0>(it1->first);
-            bool can_abduction = std::get<1>(it1->first);
-            bool can_deduction = std::get<2>(it1->first);
+            out->offsets[idx1] = out->targets.size();
+
+            auto found = base.find(idx1);
+            if (found == base.end()) continue;
+
+            out->has_row[idx1] = 1;
 
-            _process(idx, can_abduction, can_deduction, it1->second, false);
-            _process(idx, can_abduction, can_deduction, it1->second, true);
+            std::vector<std::pair<arity_id_t, float> >
+                row(found->second.begin(), found->second.end());
+            std::sort(row.begin(), row.end());
+
+            for (auto it = row.begin(); it != row.end(); ++it)
+            {
+                if (it->first == idx1) continue;
+                if (max_distance >= 0.0f and it->second > max_distance) continue;
+
+                out->targets.push_back(static_cast<std::uint32_t>(it->first));
+                out->dists.push_back(it->second);
+                out->is_paraphrasal.push_back(
+                    base_para.count(util::make_sorted_pair(idx1, it->first)) > 0);
+
+                max_edge = std::max(max_edge, it->second);
+                if (it->second > 0.0f and
+                    (min_positive < 0.0f or it->second < min_positive))
+                    min_positive = it->second;
+            }
         }
 
-        current = next;
+        out->offsets[num] = out->targets.size();
+    };
+
+    assert(num * 4 <= UINT32_MAX);
+
+    build(base_lhs, &forward);
+    build(base_rhs, &backward);
+
+    /* WITH BUCKETS NARROWER THAN ANY EDGE, EACH STATE IS SETTLED AT ONCE.
+     * THE NUMBER OF BUCKETS IS BOUNDED FOR THE CASE OF TINY EDGES. */
+    const float MAX_NUM_BUCKETS = 4096.0f;
+    if (max_edge > 0.0f)
+    {
+        bucket_width = std::max(min_positive, max_edge / MAX_NUM_BUCKETS);
+        num_buckets = static_cast<size_t>(max_edge / bucket_width) + 2;
     }
 }
 
+
+knowledge_base_t::reachability_graph_t::workspace_t::workspace_t(
+    const reachability_graph_t &g)
+    : dists(g.num_arities * 4, 0.0f), stamps(g.num_arities * 4, 0),
+      stamp(0), buckets(g.num_buckets)
+{}
+
+
 // #define _DEV
 
 void knowledge_base_t::extend_inconsistency()
@@ -1447,8 +2054,8 @@ void knowledge_base_t::extend_inconsistency()
     {
         for (auto ax = it->second.begin(); ax != it->second.end(); ++ax)
         {
-            lf::axiom_t axiom = get_axiom(*ax);
-            auto literals = axiom.func.get_all_literals();
+            auto axiom = get_axiom(*ax);
+            auto literals = axiom->func.get_all_literals();
             if (literals.size() != 2) continue;
         }
     }
@@ -1462,11 +2069,9 @@ void knowledge_base_t::_enumerate_deducible_literals(
 }
 
 
-std::list<axiom_id_t> knowledge_base_t::search_id_list(
+axiom_id_span_t knowledge_base_t::search_id_list(
     const std::string &query, const util::cdb_data_t *dat) const
 {
-    std::list<axiom_id_t> out;
-
     if (dat != NULL)
     {
         if (not dat->is_readable())
@@ -1477,30 +2082,17 @@ std::list<axiom_id_t> knowledge_base_t::search_id_list(
             const char *value = (const char*)
                 dat->get(query.c_str(), query.length(), &value_size);
 
-            if (value != NULL)
-            {
-                size_t size(0), num_id(0);
-                size += util::binary_to<size_t>(value + size, &num_id);
-
-                for (int j = 0; j<num_id; ++j)
-                {
-                    axiom_id_t id;
-                    size += util::binary_to<axiom_id_t>(value + size, &id);
-                    out.push_back(id);
-                }
-            }
+            return axiom_id_span_t(value);
         }
     }
 
-    return out;
+    return axiom_id_span_t();
 }
 
 
-std::list<axiom_id_t> knowledge_base_t::search_id_list(
+axiom_id_span_t knowledge_base_t::search_id_list(
     arity_id_t arity_id, const util::cdb_data_t *dat) const
 {
-    std::list<axiom_id_t> out;
-
     if (arity_id != INVALID_ARITY_ID and dat != NULL)
     {
         if (not dat->is_readable())
@@ -1511,22 +2103,11 @@ std::list<axiom_id_t> knowledge_base_t::search_id_list(
             const char *value = (const char*)
                 dat->get((char*)&arity_id, sizeof(arity_id_t), &value_size);
 
-            if (value != NULL)
-            {
-                size_t size(0), num_id(0);
-                size += util::binary_to<size_t>(value + size, &num_id);
-
-                for (int j = 0; j<num_id; ++j)
-                {
-                    axiom_id_t id;
-                    size += util::binary_to<axiom_id_t>(value + size, &id);
-                    out.push_back(id);
-                }
-            }
+            return axiom_id_span_t(value);
         }
     }
 
-    return out;
+    return axiom_id_span_t();
 }
 
 
@@ -1534,8 +2115,8 @@ std::list<axiom_id_t> knowledge_base_t::search_id_list(
 std::mutex knowledge_base_t::axioms_database_t::ms_mutex;
 
 knowledge_base_t::axioms_database_t::axioms_database_t(const std::string &filename)
-: m_filename(filename),
-m_fo_idx(NULL), m_fo_dat(NULL), m_fi_idx(NULL), m_fi_dat(NULL),
+: m_filename(filename), m_filename_idx(filename + ".index.dat"),
+m_fo_idx(NULL), m_fo_dat(NULL),
 m_num_compiled_axioms(0), m_num_unnamed_axioms(0)
 {}
 
@@ -1556,7 +2137,7 @@ void knowledge_base_t::axioms_database_t::prepare_compile()
         std::lock_guard<std::mutex> lock(ms_mutex);
 
         m_fo_idx = new std::ofstream(
-            (m_filename + ".index.dat").c_str(), std::ios::binary | std::ios::out);
+            m_filename_idx.c_str(), std::ios::binary | std::ios::out);
         m_fo_dat = new std::ofstream(
             (m_filename + ".axioms.dat").c_str(), std::ios::binary | std::ios::out);
         m_num_compiled_axioms = 0;
@@ -1575,13 +2156,61 @@ void knowledge_base_t::axioms_database_t::prepare_query()
     {
         std::lock_guard<std::mutex> lock(ms_mutex);
 
-        m_fi_idx = new std::ifstream(
-            (m_filename + ".index.dat").c_str(), std::ios::binary | std::ios::in);
-        m_fi_dat = new std::ifstream(
-            (m_filename + ".axioms.dat").c_str(), std::ios::binary | std::ios::in);
+        const std::string &path_idx(m_filename_idx);
+        std::string path_dat(m_filename + ".axioms.dat");
+
+        if (not m_fi_idx.open(path_idx))
+            throw phillip_exception_t("Failed to open " + path_idx);
+        if (not m_fi_dat.open(path_dat))
+            throw phillip_exception_t("Failed to open " + path_dat);
+
+        if (m_fi_idx.size() < sizeof(int))
+            throw phillip_exception_t("Broken index file: " + path_idx);
+
+        std::memcpy(
+            &m_num_compiled_axioms,
+            m_fi_idx.data() + m_fi_idx.size() - sizeof(int), sizeof(int));
+    }
+}
+
+
+void knowledge_base_t::axioms_database_t::prepare_append(const std::string &filename_base_idx)
+{
+    if (is_readable())
+        finalize();
+
+    if (not is_writable())
+    {
+        std::lock_guard<std::mutex> lock(ms_mutex);
+
+        std::string path_dat(m_filename + ".axioms.dat");
+        util::mapped_file_t base_idx;
+        std::ifstream fi_dat(path_dat.c_str(), std::ios::binary | std::ios::ate);
+
+        if (not base_idx.open(filename_base_idx))
+            throw phillip_exception_t("Failed to open " + filename_base_idx);
+        if (base_idx.size() < sizeof(int))
+            throw phillip_exception_t("Broken index file: " + filename_base_idx);
+        if (not fi_dat)
+            throw phillip_exception_t("Failed to open " + path_dat);
+
+        // THE INDEX OF THE PREVIOUS GENERATION IS COPIED TO THE NEW ONE,
+        // AND NEW AXIOMS ARE APPENDED TO THE END OF THE SHARED DATA-FILE.
+        std::memcpy(
+            &m_num_compiled_axioms,
+            base_idx.data() + base_idx.size() - sizeof(int), sizeof(int));
+        m_num_unnamed_axioms = m_num_compiled_axioms;
+        m_writing_pos = static_cast<axiom_pos_t>(fi_dat.tellg());
+        fi_dat.close();
+
+        m_fo_idx = new std::ofstream(
+            m_filename_idx.c_str(), std::ios::binary | std::ios::out);
+        m_fo_idx->write(base_idx.data(), base_idx.size() - sizeof(int));
+        m_fo_dat = new std::ofstream(
+            path_dat.c_str(), std::ios::binary | std::ios::out | std::ios::app);
 
-        m_fi_idx->seekg(-static_cast<int>(sizeof(int)), std::ios_base::end);
-        m_fi_idx->read((char*)&m_num_compiled_axioms, sizeof(int));
+        if (m_fo_idx->fail() or m_fo_dat->fail())
+            throw phillip_exception_t("Failed to open " + m_filename_idx);
     }
 }
 
@@ -1603,17 +2232,8 @@ void knowledge_base_t::axioms_database_t::finalize()
         m_fo_dat = NULL;
     }
 
-    if (m_fi_idx != NULL)
-    {
-        delete m_fi_idx;
-        m_fi_idx = NULL;
-    }
-
-    if (m_fi_dat != NULL)
-    {
-        delete m_fi_dat;
-        m_fi_dat = NULL;
-    }
+    m_fi_idx.close();
+    m_fi_dat.close();
 }
 
 
@@ -1644,7 +2264,6 @@ void knowledge_base_t::axioms_database_t::put(
 
 lf::axiom_t knowledge_base_t::axioms_database_t::get(axiom_id_t id) const
 {
-    std::lock_guard<std::mutex> lock(ms_mutex);
     lf::axiom_t out;
 
     if (not is_readable())
@@ -1653,17 +2272,28 @@ lf::axiom_t knowledge_base_t::axioms_database_t::get(axiom_id_t id) const
         return out;
     }
 
+    if (id < 0 or id >= m_num_compiled_axioms)
+    {
+        util::print_warning_fmt("kb-search: Invalid axiom-id: %d", id);
+        return out;
+    }
+
+    /* THE MAPPED PAGES ARE READ-ONLY, SO NO LOCK IS NEEDED HERE. */
     axiom_pos_t pos;
     axiom_size_t size;
-    const int SIZE(512 * 512);
-    char buffer[SIZE];
+    const char *idx =
+        m_fi_idx.data() + id * (sizeof(axiom_pos_t)+sizeof(axiom_size_t));
+
+    std::memcpy(&pos, idx, sizeof(axiom_pos_t));
+    std::memcpy(&size, idx + sizeof(axiom_pos_t), sizeof(axiom_size_t));
 
-    m_fi_idx->seekg(id * (sizeof(axiom_pos_t)+sizeof(axiom_size_t)));
-    m_fi_idx->read((char*)&pos, sizeof(axiom_pos_t));
-    m_fi_idx->read((char*)&size, sizeof(axiom_size_t));
+    if (pos + size > m_fi_dat.size())
+    {
+        util::print_warning_fmt("kb-search: Broken axiom record: %d", id);
+        return out;
+    }
 
-    m_fi_dat->seekg(pos);
-    m_fi_dat->read(buffer, size);
+    const char *buffer = m_fi_dat.data() + pos;
 
     out.id = id;
     size_t _size = out.func.read_binary(buffer);
@@ -1679,11 +2309,23 @@ knowledge_base_t::arity_database_t::arity_database_t(const std::string &filename
 {
     m_arities.push_back("");
     m_arity2id[""] = INVALID_ARITY_ID;
+    renew_version();
+}
+
+
+void knowledge_base_t::arity_database_t::renew_version()
+{
+    static std::atomic<unsigned> num_versions(0);
+
+    // 0 IS RESERVED FOR LITERALS WHOSE ARITY-ID HAS NOT BEEN LOOKED UP.
+    do m_version = ++num_versions;
+    while (m_version == 0);
 }
 
 
 void knowledge_base_t::arity_database_t::clear()
 {
+    renew_version();
     m_arities.assign(1, "");
 
     m_arity2id.clear();
@@ -1828,11 +2470,14 @@ void knowledge_base_t::arity_database_t::add_mutual_exclusion(const literal_t &l
 
 
 
+const char knowledge_base_t::reachable_matrix_t::MAGIC[8] =
+{ 'P', 'H', 'I', 'L', 'R', 'M', 'C', '1' };
 std::mutex knowledge_base_t::reachable_matrix_t::ms_mutex;
 
 
 knowledge_base_t::reachable_matrix_t::reachable_matrix_t(const std::string &filename)
-    : m_filename(filename), m_fout(NULL), m_fin(NULL)
+    : m_filename(filename), m_fout(NULL),
+      m_num_rows(0), m_offsets(NULL), m_ids(NULL), m_dists(NULL)
 {}
 
 
@@ -1850,11 +2495,12 @@ void knowledge_base_t::reachable_matrix_t::prepare_compile()
     if (not is_writable())
     {
         std::lock_guard<std::mutex> lock(ms_mutex);
-        pos_t pos;
 
         m_fout = new std::ofstream(
-            m_filename.c_str(), std::ios::binary | std::ios::out);
-        m_fout->write((const char*)&pos, sizeof(pos_t));
+            (m_filename + ".tmp").c_str(), std::ios::binary | std::ios::out);
+        if (m_fout->fail())
+            throw phillip_exception_t(
+            "Failed to open a temporary file: " + m_filename + ".tmp");
     }
 }
 
@@ -1867,21 +2513,36 @@ void knowledge_base_t::reachable_matrix_t::prepare_query()
     if (not is_readable())
     {
         std::lock_guard<std::mutex> lock(ms_mutex);
-        pos_t pos;
-        size_t num, idx;
 
-        m_fin = new std::ifstream(
-            m_filename.c_str(), std::ios::binary | std::ios::in);
+        if (not m_mapped.open(m_filename))
+            throw phillip_exception_t("Failed to open " + m_filename);
 
-        m_fin->read((char*)&pos, sizeof(pos_t));
-        m_fin->seekg(pos, std::ios::beg);
+        const size_t header_size = sizeof(MAGIC) + sizeof(pos_t) * 2;
+        const char *p = m_mapped.data();
 
-        m_fin->read((char*)&num, sizeof(size_t));
-        for (size_t i = 0; i < num; ++i)
+        if (m_mapped.size() >= header_size and
+            std::memcmp(p, MAGIC, sizeof(MAGIC)) == 0)
         {
-            m_fin->read((char*)&idx, sizeof(idx));
-            m_fin->read((char*)&pos, sizeof(pos_t));
-            m_map_idx_to_pos[idx] = pos;
+            pos_t num_rows, num_entries;
+            std::memcpy(&num_rows, p + sizeof(MAGIC), sizeof(pos_t));
+            std::memcpy(&num_entries, p + sizeof(MAGIC) + sizeof(pos_t), sizeof(pos_t));
+
+            size_t expected =
+                header_size + sizeof(pos_t) * (num_rows + 1) +
+                (sizeof(col_t) + sizeof(float)) * num_entries;
+            if (m_mapped.size() < expected)
+                throw phillip_exception_t("Broken reachable-matrix: " + m_filename);
+
+            m_num_rows = num_rows;
+            m_offsets = reinterpret_cast<const pos_t*>(p + header_size);
+            m_ids = reinterpret_cast<const col_t*>(m_offsets + num_rows + 1);
+            m_dists = reinterpret_cast<const float*>(m_ids + num_entries);
+        }
+        else
+        {
+            // THE FILE IS WRITTEN IN THE OLDER FORMAT.
+            m_mapped.close();
+            read_legacy();
         }
     }
 }
@@ -1892,106 +2553,208 @@ void knowledge_base_t::reachable_matrix_t::finalize()
     if (m_fout != NULL)
     {
         std::lock_guard<std::mutex> lock(ms_mutex);
-        pos_t pos = m_fout->tellp();
-        size_t num = m_map_idx_to_pos.size();
-
-        m_fout->write((const char*)&num, sizeof(size_t));
-
-        for (auto it = m_map_idx_to_pos.begin(); it != m_map_idx_to_pos.end(); ++it)
-        {
-            m_fout->write((const char*)&it->first, sizeof(size_t));
-            m_fout->write((const char*)&it->second, sizeof(pos_t));
-        }
-
-        m_fout->seekp(0, std::ios::beg);
-        m_fout->write((const char*)&pos, sizeof(pos_t));
 
         delete m_fout;
         m_fout = NULL;
-    }
 
-    if (m_fin != NULL)
-    {
-        delete m_fin;
-        m_fin = NULL;
+        write_csr();
+        std::remove((m_filename + ".tmp").c_str());
     }
 
-    m_map_idx_to_pos.clear();
+    m_map_idx_to_row.clear();
+    m_mapped.close();
+    m_legacy_offsets.clear();
+    m_legacy_ids.clear();
+    m_legacy_dists.clear();
+
+    m_num_rows = 0;
+    m_offsets = NULL;
+    m_ids = NULL;
+    m_dists = NULL;
 }
 
 
 void knowledge_base_t::reachable_matrix_t::
 put(size_t idx1, const hash_map<size_t, float> &dist)
 {
-    std::lock_guard<std::mutex> lock(ms_mutex);
-    size_t num(0);
-    m_map_idx_to_pos[idx1] = m_fout->tellp();
+    std::vector<std::pair<col_t, float> > row;
+    row.reserve(dist.size());
 
-    for (auto it = dist.begin(); it != dist.end(); ++it)
-        if (idx1 <= it->first)
-            ++num;
-
-    m_fout->write((const char*)&num, sizeof(size_t));
     for (auto it = dist.begin(); it != dist.end(); ++it)
     {
         if (idx1 <= it->first)
         {
-            m_fout->write((const char*)&it->first, sizeof(size_t));
-            m_fout->write((const char*)&it->second, sizeof(float));
+            assert(it->first <= UINT32_MAX);
+            row.push_back(std::make_pair(
+                static_cast<col_t>(it->first), it->second));
         }
     }
+    std::sort(row.begin(), row.end());
+
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    m_map_idx_to_row[idx1] = std::make_pair(
+        static_cast<pos_t>(m_fout->tellp()), row.size());
+
+    for (auto it = row.begin(); it != row.end(); ++it)
+        m_fout->write((const char*)&it->first, sizeof(col_t));
+    for (auto it = row.begin(); it != row.end(); ++it)
+        m_fout->write((const char*)&it->second, sizeof(float));
 }
 
 
-float knowledge_base_t::reachable_matrix_t::get(size_t idx1, size_t idx2) const
+void knowledge_base_t::reachable_matrix_t::write_csr()
 {
-    if (idx1 > idx2) std::swap(idx1, idx2);
+    std::ifstream fi(
+        (m_filename + ".tmp").c_str(), std::ios::binary | std::ios::in);
+    std::ofstream fo(
+        m_filename.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
 
-    std::lock_guard<std::mutex> lock(ms_mutex);
-    size_t num, idx;
-    float dist;
-    auto find = m_map_idx_to_pos.find(idx1);
+    if (fi.fail() or fo.fail())
+        throw phillip_exception_t("Failed to write " + m_filename);
 
-    if (find == m_map_idx_to_pos.end()) return -1.0f;
+    pos_t num_rows(0), num_entries(0);
+    for (auto it = m_map_idx_to_row.begin(); it != m_map_idx_to_row.end(); ++it)
+    {
+        num_rows = std::max<pos_t>(num_rows, it->first + 1);
+        num_entries += it->second.second;
+    }
 
-    m_fin->seekg(find->second, std::ios::beg);
-    m_fin->read((char*)&num, sizeof(size_t));
+    fo.write(MAGIC, sizeof(MAGIC));
+    fo.write((const char*)&num_rows, sizeof(pos_t));
+    fo.write((const char*)&num_entries, sizeof(pos_t));
 
-    for (size_t i = 0; i < num; ++i)
+    /* WRITE OFFSETS */
+    pos_t offset(0);
+    for (size_t i = 0; i <= num_rows; ++i)
     {
-        m_fin->read((char*)&idx, sizeof(size_t));
-        m_fin->read((char*)&dist, sizeof(float));
-        if (idx == idx2) return dist;
+        fo.write((const char*)&offset, sizeof(pos_t));
+        if (i == num_rows) break;
+
+        auto found = m_map_idx_to_row.find(i);
+        if (found != m_map_idx_to_row.end())
+            offset += found->second.second;
     }
 
-    return -1.0f;
+    /* COPY IDS AND DISTANCES ROW BY ROW */
+    std::vector<char> buffer;
+    for (int k = 0; k < 2; ++k)
+    for (size_t i = 0; i < num_rows; ++i)
+    {
+        auto found = m_map_idx_to_row.find(i);
+        if (found == m_map_idx_to_row.end()) continue;
+
+        size_t num = found->second.second;
+        size_t size = (k == 0) ? sizeof(col_t) * num : sizeof(float) * num;
+        pos_t pos = found->second.first + (k == 0 ? 0 : sizeof(col_t) * num);
+
+        buffer.resize(size);
+        fi.seekg(pos, std::ios::beg);
+        fi.read(buffer.data(), size);
+        fo.write(buffer.data(), size);
+    }
 }
 
 
-hash_set<float> knowledge_base_t::reachable_matrix_t::get(size_t idx) const
+void knowledge_base_t::reachable_matrix_t::read_legacy()
 {
-    std::lock_guard<std::mutex> lock(ms_mutex);
-    size_t num;
-    float dist;
-    hash_set<float> out;
-    auto find = m_map_idx_to_pos.find(idx);
+    /* OLDER FORMAT: [POS OF INDEX] [ROWS ...] [INDEX]
+     * EACH ROW IS A LIST OF (size_t, float) IN ARBITRARY ORDER. */
+    std::ifstream fi(m_filename.c_str(), std::ios::binary | std::ios::in);
+    pos_t pos;
+    size_t num, idx;
+    std::map<size_t, pos_t> idx_to_pos;
 
-    if (find == m_map_idx_to_pos.end()) return out;
+    if (fi.fail())
+        throw phillip_exception_t("Failed to open " + m_filename);
 
-    m_fin->seekg(find->second, std::ios::beg);
-    m_fin->read((char*)&num, sizeof(size_t));
+    fi.read((char*)&pos, sizeof(pos_t));
+    fi.seekg(pos, std::ios::beg);
 
+    fi.read((char*)&num, sizeof(size_t));
     for (size_t i = 0; i < num; ++i)
     {
-        m_fin->read((char*)&idx, sizeof(size_t));
-        m_fin->read((char*)&dist, sizeof(float));
-        out.insert(dist);
+        fi.read((char*)&idx, sizeof(idx));
+        fi.read((char*)&pos, sizeof(pos_t));
+        idx_to_pos[idx] = pos;
+    }
+
+    if (fi.fail())
+        throw phillip_exception_t("Broken reachable-matrix: " + m_filename);
+
+    m_num_rows = idx_to_pos.empty() ? 0 : (idx_to_pos.rbegin()->first + 1);
+    m_legacy_offsets.assign(m_num_rows + 1, 0);
+
+    std::vector<std::pair<col_t, float> > row;
+    for (auto it = idx_to_pos.begin(); it != idx_to_pos.end(); ++it)
+    {
+        fi.seekg(it->second, std::ios::beg);
+        fi.read((char*)&num, sizeof(size_t));
+
+        row.resize(num);
+        for (size_t i = 0; i < num; ++i)
+        {
+            fi.read((char*)&idx, sizeof(size_t));
+            fi.read((char*)&row[i].second, sizeof(float));
+            row[i].first = static_cast<col_t>(idx);
+        }
+        std::sort(row.begin(), row.end());
+
+        for (auto r = row.begin(); r != row.end(); ++r)
+        {
+            m_legacy_ids.push_back(r->first);
+            m_legacy_dists.push_back(r->second);
+        }
+        m_legacy_offsets[it->first + 1] = num;
     }
 
+    for (size_t i = 0; i < m_num_rows; ++i)
+        m_legacy_offsets[i + 1] += m_legacy_offsets[i];
+
+    m_offsets = m_legacy_offsets.data();
+    m_ids = m_legacy_ids.data();
+    m_dists = m_legacy_dists.data();
+}
+
+
+float knowledge_base_t::reachable_matrix_t::get(size_t idx1, size_t idx2) const
+{
+    if (idx1 > idx2) std::swap(idx1, idx2);
+    if (idx1 >= m_num_rows) return -1.0f;
+
+    const col_t *begin = m_ids + m_offsets[idx1];
+    const col_t *end = m_ids + m_offsets[idx1 + 1];
+    const col_t *found = std::lower_bound(begin, end, static_cast<col_t>(idx2));
+
+    if (found == end or *found != idx2) return -1.0f;
+
+    return m_dists[found - m_ids];
+}
+
+
+hash_set<float> knowledge_base_t::reachable_matrix_t::get(size_t idx) const
+{
+    hash_set<float> out;
+
+    if (idx >= m_num_rows) return out;
+
+    for (pos_t i = m_offsets[idx]; i < m_offsets[idx + 1]; ++i)
+        out.insert(m_dists[i]);
+
     return out;
 }
 
 
+void knowledge_base_t::reachable_matrix_t::get(size_t idx, hash_map<size_t, float> *out) const
+{
+    out->clear();
+
+    if (idx >= m_num_rows) return;
+
+    for (pos_t i = m_offsets[idx]; i < m_offsets[idx + 1]; ++i)
+        (*out)[m_ids[i]] = m_dists[i];
+}
+
+
 namespace dist
 {
 
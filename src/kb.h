@@ -8,7 +8,10 @@
 #include <string>
 #include <memory>
 #include <mutex>
+#include <atomic>
+#include <functional>
 #include <ctime>
+#include <cstdint>
 
 #include "./define.h"
 #include "./logical_function.h"
@@ -28,6 +31,12 @@ static const axiom_id_t INVALID_AXIOM_ID = -1;
 static const argument_set_id_t INVALID_ARGUMENT_SET_ID = 0;
 static const arity_id_t INVALID_ARITY_ID = 0;
 
+/** The default memory cap of the distance cache in bytes. */
+static const size_t DEFAULT_DISTANCE_CACHE_SIZE = 64 * 1024 * 1024;
+
+/** The default number of axioms in the axiom cache. */
+static const size_t DEFAULT_AXIOM_CACHE_SIZE = 64 * 1024;
+
 
 enum unification_postpone_argument_type_e
 {
@@ -116,6 +125,49 @@ private:
 };
 
 
+/** A class of bounded cache for distances between arities,
+ *  whose capacity is given as a rough upper bound of memory usage. */
+class distance_cache_t
+{
+public:
+    /** @param max_bytes Rough upper bound of memory usage. */
+    distance_cache_t(size_t max_bytes) : m_cache(0) { set_max_bytes(max_bytes); }
+
+    inline bool find(arity_id_t a1, arity_id_t a2, float *out) const
+    { return m_cache.find(get_key(a1, a2), out); }
+    inline void insert(arity_id_t a1, arity_id_t a2, float dist)
+    { m_cache.insert(get_key(a1, a2), dist); }
+    inline void clear() { m_cache.clear(); }
+
+    /** Changes the memory cap. Cached entries are discarded. */
+    inline void set_max_bytes(size_t max_bytes)
+    { m_cache.set_capacity(max_bytes / cache_t::bytes_per_entry()); }
+
+    inline unsigned long long num_hits() const { return m_cache.num_hits(); }
+    inline unsigned long long num_misses() const { return m_cache.num_misses(); }
+    inline size_t capacity() const { return m_cache.capacity(); }
+
+private:
+    typedef unsigned long long key_t;
+
+    struct key_hash_t { inline size_t operator()(key_t key) const; };
+    typedef util::sharded_clock_cache_t<key_t, float, key_hash_t> cache_t;
+
+    static inline key_t get_key(arity_id_t a1, arity_id_t a2);
+
+    cache_t m_cache;
+};
+
+
+/** A class of bounded cache for decoded axioms, whose capacity is
+ *  the number of axioms. Axioms are immutable and shared, so that each one
+ *  is decoded only once while it stays in the cache and evicted ones remain
+ *  valid for their holders. Consecutive axioms, which are often used together,
+ *  are spread over shards since ids are hashed to themselves. */
+typedef util::sharded_clock_cache_t<axiom_id_t, std::shared_ptr<const lf::axiom_t> >
+    axiom_cache_t;
+
+
 /** A class of knowledge-base. */
 class knowledge_base_t
 {
@@ -123,7 +175,9 @@ public:
     static knowledge_base_t* instance();
     static void setup(
         std::string filename, float max_distance,
-        int thread_num_for_rm, bool do_disable_stop_word);
+        int thread_num_for_rm, bool do_disable_stop_word,
+        size_t distance_cache_size = DEFAULT_DISTANCE_CACHE_SIZE,
+        size_t axiom_cache_size = DEFAULT_AXIOM_CACHE_SIZE);
     static inline float get_max_distance();
 
     ~knowledge_base_t();
@@ -135,6 +189,11 @@ public:
     /** Prepares for reading knowledge base. */
     void prepare_query();
 
+    /** Prepares for appending axioms to the compiled knowledge base.
+     *  On finalize(), the next generation of the knowledge base is written
+     *  and it becomes the current one after everything is written. */
+    void prepare_append();
+
     /** Call this method on end of compiling or reading knowledge base. */
     void finalize();
 
@@ -145,21 +204,30 @@ public:
     void insert_argument_set(const lf::logical_function_t &f);
     void assert_stop_word(const arity_t &arity);
 
-    inline lf::axiom_t get_axiom(axiom_id_t id) const;
-    inline std::list<axiom_id_t> search_axioms_with_rhs(const std::string &arity) const;
-    inline std::list<axiom_id_t> search_axioms_with_lhs(const std::string &arity) const;
+    /** Returns the axiom of given id, which is decoded once and cached. */
+    inline std::shared_ptr<const lf::axiom_t> get_axiom(axiom_id_t id) const;
+    inline axiom_id_span_t search_axioms_with_rhs(const std::string &arity) const;
+    inline axiom_id_span_t search_axioms_with_lhs(const std::string &arity) const;
     inline const std::list<std::pair<term_idx_t, term_idx_t> >*
         search_inconsistent_terms(arity_id_t a1, arity_id_t a2) const;
     inline arity_id_t search_arity_id(const arity_t &arity) const;
     inline const arity_t& search_arity(arity_id_t id) const;
+
+    /** Returns the version of the arity-database,
+     *  which changes whenever ids of known arities may change. */
+    inline unsigned version_of_arities() const { return m_arity_db.version(); }
     hash_set<axiom_id_t> search_axiom_group(axiom_id_t id) const;
     inline const unification_postponement_t* find_unification_postponement(arity_id_t arity) const;
     inline const unification_postponement_t* find_unification_postponement(const arity_t &arity) const;
     argument_set_id_t search_argument_set_id(const std::string &arity, int term_idx) const;
-    void search_arity_patterns(arity_id_t arity, std::list<arity_pattern_t> *out) const;
-    void search_axioms_with_arity_pattern(
-        const arity_pattern_t &query,
-        std::list<std::pair<axiom_id_t, bool> > *out) const;
+
+    /** Returns ids of arity-patterns which include the arity. */
+    inline array_span_t<pattern_id_t> search_arity_patterns(arity_id_t arity) const;
+    inline const arity_pattern_t& get_arity_pattern(pattern_id_t id) const;
+
+    /** Returns axioms which can be applied with the arity-pattern,
+     *  each of which is paired with whether it is applied backward. */
+    inline axiom_direction_span_t search_axioms_with_arity_pattern(pattern_id_t id) const;
 
     void set_distance_provider(const std::string &key, phillip_main_t *ph = NULL);
     void set_category_table(const std::string &key, phillip_main_t *ph = NULL);
@@ -169,6 +237,7 @@ public:
      *  If these arities are not reachable, then return -1. */
     float get_distance(
         const std::string &arity1, const std::string &arity2) const;
+    float get_distance(arity_id_t arity1, arity_id_t arity2) const;
 
     /** Returns distance between arity1 and arity2 with distance-provider. */
     inline float get_distance(const lf::axiom_t &axiom) const;
@@ -181,10 +250,13 @@ public:
     inline bool is_writable() const;
     inline bool is_readable() const;
     inline const std::string& filename() const;
+    inline int generation() const;
     inline int num_of_axioms() const;
     inline const hash_set<std::string>& stop_words() const;
 
     inline void clear_distance_cache();
+    inline const distance_cache_t& distance_cache() const { return m_cache_distance; }
+    inline const axiom_cache_t& axiom_cache() const { return m_cache_axiom; }
 
 private:
     class axioms_database_t
@@ -195,8 +267,14 @@ private:
 
         void prepare_compile();
         void prepare_query();
+
+        /** Prepares for appending axioms to the data-file.
+         *  @param filename_base_idx The index-file of the previous generation. */
+        void prepare_append(const std::string &filename_base_idx);
         void finalize();
 
+        inline void set_index_filename(const std::string &filename);
+
         void put(const std::string &name, const lf::logical_function_t &func);
         lf::axiom_t get(axiom_id_t id) const;
         inline bool is_writable() const;
@@ -210,9 +288,13 @@ private:
         inline std::string get_name_of_unnamed_axiom();
 
         static std::mutex ms_mutex;
-        std::string m_filename;
+        std::string m_filename, m_filename_idx;
         std::ofstream *m_fo_idx, *m_fo_dat;
-        std::ifstream *m_fi_idx, *m_fi_dat;
+
+        /** Read-only views of index and axioms on query mode.
+         *  Axioms are decoded directly from these without locking. */
+        util::mapped_file_t m_fi_idx, m_fi_dat;
+
         int m_num_compiled_axioms, m_num_unnamed_axioms;
         axiom_pos_t m_writing_pos;
     };
@@ -226,6 +308,8 @@ private:
         void read();
         void write() const;
 
+        inline void set_filename(const std::string &filename) { m_filename = filename; }
+
         inline arity_id_t add(const arity_t&);
         inline void add_unification_postponement(const unification_postponement_t &unipp);
         void add_mutual_exclusion(const literal_t &l1, const literal_t &l2);
@@ -238,8 +322,15 @@ private:
         inline const std::list<std::pair<term_idx_t, term_idx_t> >*
             find_inconsistent_terms(arity_id_t, arity_id_t) const;
 
+        /** Returns the version, which is renewed on clear(). */
+        inline unsigned version() const { return m_version; }
+
     private:
+        /** Renews the version with one never given to any instance. */
+        void renew_version();
+
         std::string m_filename;
+        unsigned m_version;
 
         std::vector<arity_t> m_arities;
         hash_map<arity_t, arity_id_t> m_arity2id;
@@ -249,7 +340,12 @@ private:
             std::list<std::pair<term_idx_t, term_idx_t> > > > m_mutual_exclusions;
     };
 
-    /** A class of reachable-matrix for all predicate pairs. */
+    /** A class of reachable-matrix for all predicate pairs.
+     *  The matrix is stored as CSR: an array of row-offsets followed by
+     *  arrays of column-ids and distances, where each row is sorted by id.
+     *  On query mode the file is memory-mapped and looked up by
+     *  binary-search without locking.
+     *  Files of the older format are converted into CSR on loading. */
     class reachable_matrix_t
     {
     public:
@@ -263,16 +359,106 @@ private:
         float get(size_t idx1, size_t idx2) const;
         hash_set<float> get(size_t idx) const;
 
+        /** Gets the stored row of idx, whose columns are not less than idx. */
+        void get(size_t idx, hash_map<size_t, float> *out) const;
+
+        inline size_t num_rows() const { return m_num_rows; }
+        inline void set_filename(const std::string &filename) { finalize(); m_filename = filename; }
+
         inline bool is_writable() const;
         inline bool is_readable() const;
 
     private:
         typedef unsigned long long pos_t;
+        typedef std::uint32_t col_t;
+
+        void write_csr();
+        void read_legacy();
+
+        static const char MAGIC[8];
         static std::mutex ms_mutex;
         std::string   m_filename;
+
+        /** Rows are written to a temporary file on compiling
+         *  and are packed into CSR on finalize(). */
         std::ofstream *m_fout;
-        std::ifstream *m_fin;
-        hash_map<size_t, pos_t> m_map_idx_to_pos;
+        hash_map<size_t, std::pair<pos_t, size_t> > m_map_idx_to_row;
+
+        util::mapped_file_t m_mapped;
+        std::vector<pos_t> m_legacy_offsets;
+        std::vector<col_t> m_legacy_ids;
+        std::vector<float> m_legacy_dists;
+
+        size_t m_num_rows;
+        const pos_t *m_offsets;
+        const col_t *m_ids;
+        const float *m_dists;
+    };
+
+    /** A table of arity-patterns, which is built from the databases on loading,
+     *  so that no pattern is (de)serialized on querying.
+     *  Pattern-ids are assigned in order of arity_pattern_t,
+     *  so sorting ids sorts patterns in the same order. */
+    struct arity_pattern_table_t
+    {
+        void load(
+            size_t num_arities,
+            const util::cdb_data_t &arity_to_patterns,
+            const util::cdb_data_t &pattern_to_axioms);
+        void clear();
+
+        std::vector<arity_pattern_t> patterns;
+
+        /** Pattern-ids for each arity in CSR. */
+        std::vector<size_t> arity_offsets;
+        std::vector<pattern_id_t> arity_patterns;
+
+        /** Axioms for each pattern in CSR. */
+        std::vector<size_t> axiom_offsets;
+        std::vector<std::pair<axiom_id_t, bool> > axioms;
+    };
+
+    /** A graph of direct distances between arities in CSR,
+     *  on which rows of the reachable-matrix are computed. */
+    struct reachability_graph_t
+    {
+        struct edges_t
+        {
+            std::vector<size_t> offsets;
+            std::vector<std::uint32_t> targets;
+            std::vector<float> dists;
+            std::vector<char> is_paraphrasal;
+            std::vector<char> has_row;
+        };
+
+        /** Buffers for the shortest-path search, which are reused
+         *  over rows computed on the same thread.
+         *  States are indexed by (arity, can-abduction, can-deduction). */
+        struct workspace_t
+        {
+            workspace_t(const reachability_graph_t &g);
+
+            std::vector<float> dists;
+            std::vector<std::uint32_t> stamps;
+            std::uint32_t stamp;
+            /** Queued pairs of a state and its distance when it was queued. */
+            std::vector<std::vector<std::pair<std::uint32_t, float> > > buckets;
+            std::vector<std::uint32_t> touched;
+        };
+
+        reachability_graph_t(
+            size_t num_arities,
+            const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base_lhs,
+            const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base_rhs,
+            const std::set<std::pair<arity_id_t, arity_id_t> > &base_para,
+            float max_distance);
+
+        size_t num_arities;
+        edges_t forward, backward;
+
+        /** Width and number of buckets of the circular bucket-queue. */
+        float bucket_width;
+        size_t num_buckets;
     };
 
     enum kb_state_e { STATE_NULL, STATE_COMPILE, STATE_QUERY };
@@ -282,6 +468,26 @@ private:
     void write_config() const;
     void read_config();
 
+    /** Returns the prefix of the files of the given generation.
+     *  The data-file of axioms, the category-table and the configuration
+     *  are shared among generations. */
+    std::string _get_prefix_of_generation(int generation) const;
+
+    /** Changes the paths of the files of each database into the given generation. */
+    void _set_generation(int generation);
+
+    /** Removes the files of the given generation, which are no longer used. */
+    void _remove_generation(int generation) const;
+
+    /** Returns the generation written in the existing configuration, or 0 if none. */
+    int _read_generation() const;
+
+    /** Loads the databases of the current generation into the buffers for compiling. */
+    void _load_current_generation();
+
+    void insert_cdb(
+        const hash_map<arity_id_t, hash_set<axiom_id_t> > &ids, util::cdb_data_t *dat);
+
     /** Outputs m_group_to_axioms to m_cdb_axiom_group. */
     void insert_axiom_group_to_cdb();
     void insert_argument_set_to_cdb();
@@ -296,22 +502,35 @@ private:
         hash_map<arity_id_t, hash_map<arity_id_t, float> > *out_rhs,
         std::set<std::pair<arity_id_t, arity_id_t> > *out_para);
     void _create_reachable_matrix_indirect(
-        arity_id_t target,
-        const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base_lhs,
-        const hash_map<arity_id_t, hash_map<arity_id_t, float> > &base_rhs,
-        const std::set<std::pair<arity_id_t, arity_id_t> > &base_para,
+        arity_id_t target, const reachability_graph_t &graph,
+        reachability_graph_t::workspace_t *ws,
         hash_map<arity_id_t, float> *out) const;
 
+    /** Returns the number of threads to scan all axioms on compiling. */
+    int _get_num_of_scanning_threads() const;
+
+    /** Returns the workers kept over scans during a compilation,
+     *  making them if fewer than num_thread threads are kept. */
+    util::worker_pool_t& _get_workers(int num_thread) const;
+
+    /** Applies proc to every axiom in parallel.
+     *  Each thread processes a contiguous range of axiom-ids.
+     *  @param proc Is called with the index of the thread and an axiom.
+     *  @param begin Axioms whose ids are less than this are skipped. */
+    void _scan_axioms(
+        int num_thread,
+        const std::function<void(int, const lf::axiom_t&)> &proc,
+        axiom_id_t begin = 0) const;
+
     void extend_inconsistency();
     void _enumerate_deducible_literals(
         const literal_t &target, hash_set<literal_t> *out) const;
 
     /** Returns axioms corresponding with given query.
-     *  @param dat A database of cdb to seach axiom.
-     *  @param tmp A map of temporal axioms related with dat. */
-    std::list<axiom_id_t> search_id_list(
+     *  @param dat A database of cdb to seach axiom. */
+    axiom_id_span_t search_id_list(
         const std::string &query, const util::cdb_data_t *dat) const;
-    std::list<axiom_id_t> search_id_list(
+    axiom_id_span_t search_id_list(
         arity_id_t arity_id, const util::cdb_data_t *dat) const;
 
     static std::unique_ptr<knowledge_base_t, util::deleter_t<knowledge_base_t> > ms_instance;
@@ -319,22 +538,52 @@ private:
     static float ms_max_distance;
     static int ms_thread_num_for_rm;
     static bool ms_do_disable_stop_word;
-    static std::mutex ms_mutex_for_cache;
+    static size_t ms_distance_cache_size;
+    static size_t ms_axiom_cache_size;
     static std::mutex ms_mutex_for_rm;
 
     kb_state_e m_state;
     std::string m_filename;
     version_e m_version;
 
+    /** The generation of the compiled knowledge base.
+     *  It is incremented each time axioms are appended. */
+    int m_generation;
+
+    /** The generation overwritten by compiling the knowledge base from scratch.
+     *  Its files and those of earlier generations are removed on finalizing. */
+    int m_generation_overwritten;
+
+    /** Whether the configuration has the information needed to append axioms. */
+    bool m_is_appendable;
+    bool m_is_appending;
+
     util::cdb_data_t m_cdb_rhs, m_cdb_lhs;
     util::cdb_data_t m_cdb_axiom_group, m_cdb_arg_set;
     util::cdb_data_t m_cdb_arity_patterns, m_cdb_pattern_to_ids;
     axioms_database_t m_axioms;
     arity_database_t m_arity_db;
     reachable_matrix_t m_rm;
+    arity_pattern_table_t m_pattern_table;
 
     hash_map<size_t, hash_map<size_t, float> > m_partial_reachable_matrix;
 
+    /** The reachable-matrix of the previous generation, used on appending. */
+    std::unique_ptr<reachable_matrix_t> m_rm_base;
+
+    /** Threads used on compiling, which are released by finalize(). */
+    mutable std::unique_ptr<util::worker_pool_t> m_workers;
+
+    /** On appending, the number of axioms and arities in the previous generation
+     *  and arities of appended axioms. */
+    axiom_id_t m_num_base_axioms;
+    size_t m_num_base_arities;
+    hash_set<arity_id_t> m_appended_arities;
+
+    /** Arity-patterns of the previous generation, loaded on appending. */
+    std::map<arity_id_t, std::set<arity_pattern_t> > m_base_arity_to_queries;
+    std::map<arity_pattern_t, std::set<std::pair<axiom_id_t, bool> > > m_base_pattern_to_ids;
+
     /** A set of arities of stop-words.
      *  These arities are ignored in constructing a reachable-matrix. */
     hash_set<arity_t> m_stop_words;
@@ -361,7 +610,11 @@ private:
         std::string key;
     } m_category_table;
 
-    mutable hash_map<size_t, hash_map<size_t, float> > m_cache_distance;
+    /** Cache of get_distance(), which is valid while the KB is loaded. */
+    mutable distance_cache_t m_cache_distance;
+
+    /** Cache of get_axiom(), which is cleared on finalize(). */
+    mutable axiom_cache_t m_cache_axiom;
 };
 
 
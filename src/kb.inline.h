@@ -9,22 +9,49 @@ namespace kb
 
 
 
+inline distance_cache_t::key_t distance_cache_t::get_key(arity_id_t a1, arity_id_t a2)
+{
+    // THE REACHABLE-MATRIX IS SYMMETRIC.
+    if (a1 > a2) std::swap(a1, a2);
+    return (static_cast<key_t>(a1) << 32) | static_cast<key_t>(a2 & 0xffffffff);
+}
+
+
+inline size_t distance_cache_t::key_hash_t::operator()(key_t key) const
+{
+    key_t h = key * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(h >> 32);
+}
+
+
 inline float knowledge_base_t::get_max_distance()
 {
     return ms_max_distance;
 }
 
 
-inline lf::axiom_t knowledge_base_t::get_axiom(axiom_id_t id) const
+inline std::shared_ptr<const lf::axiom_t> knowledge_base_t::get_axiom(axiom_id_t id) const
 {
-    if (id >= 0 and id < m_axioms.num_axioms())
-        return m_axioms.get(id);
+    if (id < 0 or id >= m_axioms.num_axioms() or not m_axioms.is_readable())
+        return std::make_shared<lf::axiom_t>();
+
+    std::shared_ptr<const lf::axiom_t> out;
+
+    util::metrics_t::count("kb.get_axiom");
+    if (not m_cache_axiom.find(id, &out))
+    {
+        util::metrics_t::count("kb.axiom_cache.misses");
+        out = std::make_shared<lf::axiom_t>(m_axioms.get(id));
+        m_cache_axiom.insert(id, out);
+    }
     else
-        return lf::axiom_t();
+        util::metrics_t::count("kb.axiom_cache.hits");
+
+    return out;
 }
 
 
-inline std::list<axiom_id_t> knowledge_base_t::
+inline axiom_id_span_t knowledge_base_t::
 search_axioms_with_rhs(const std::string &rhs) const
 {
     arity_id_t id = m_arity_db.arity2id(rhs);
@@ -32,11 +59,45 @@ search_axioms_with_rhs(const std::string &rhs) const
 }
 
 
-inline std::list<axiom_id_t> knowledge_base_t::
+inline axiom_id_span_t knowledge_base_t::
 search_axioms_with_lhs(const std::string &lhs) const
 {
     arity_id_t id = m_arity_db.arity2id(lhs);
-    return search_id_list(lhs, &m_cdb_lhs);
+    return search_id_list(id, &m_cdb_lhs);
+}
+
+
+inline array_span_t<pattern_id_t> knowledge_base_t::
+search_arity_patterns(arity_id_t arity) const
+{
+    const arity_pattern_table_t &t = m_pattern_table;
+
+    if (arity + 1 >= t.arity_offsets.size())
+        return array_span_t<pattern_id_t>();
+
+    return array_span_t<pattern_id_t>(
+        t.arity_patterns.data() + t.arity_offsets[arity],
+        t.arity_patterns.data() + t.arity_offsets[arity + 1]);
+}
+
+
+inline const arity_pattern_t& knowledge_base_t::get_arity_pattern(pattern_id_t id) const
+{
+    return m_pattern_table.patterns.at(id);
+}
+
+
+inline axiom_direction_span_t knowledge_base_t::
+search_axioms_with_arity_pattern(pattern_id_t id) const
+{
+    const arity_pattern_table_t &t = m_pattern_table;
+
+    if (id + 1 >= t.axiom_offsets.size())
+        return axiom_direction_span_t();
+
+    return axiom_direction_span_t(
+        t.axioms.data() + t.axiom_offsets[id],
+        t.axioms.data() + t.axiom_offsets[id + 1]);
 }
 
 
@@ -49,13 +110,14 @@ search_inconsistent_terms(arity_id_t a1, arity_id_t a2) const
 
 inline float knowledge_base_t::get_distance(const lf::axiom_t &axiom) const
 {
+    util::metrics_t::count("kb.get_distance_of_axiom");
     return (*m_distance_provider.instance)(axiom);
 }
 
 
 inline float knowledge_base_t::get_distance(axiom_id_t id) const
 {
-    return get_distance(get_axiom(id));
+    return get_distance(*get_axiom(id));
 }
 
 
@@ -101,9 +163,14 @@ inline const std::string& knowledge_base_t::filename() const
 }
 
 
+inline int knowledge_base_t::generation() const
+{
+    return m_generation;
+}
+
+
 inline void knowledge_base_t::clear_distance_cache()
 {
-    std::lock_guard<std::mutex> lock(ms_mutex_for_cache);
     m_cache_distance.clear();
 }
 
@@ -142,7 +209,14 @@ inline bool knowledge_base_t::axioms_database_t::is_writable() const
 
 inline bool knowledge_base_t::axioms_database_t::is_readable() const
 {
-    return (m_fi_idx != NULL) and (m_fi_dat != NULL);
+    return m_fi_idx.is_open() and m_fi_dat.is_open();
+}
+
+
+inline void knowledge_base_t::axioms_database_t::set_index_filename(const std::string &filename)
+{
+    finalize();
+    m_filename_idx = filename;
 }
 
 
@@ -229,10 +303,34 @@ inline bool knowledge_base_t::reachable_matrix_t::is_writable() const
 
 inline bool knowledge_base_t::reachable_matrix_t::is_readable() const
 {
-    return (m_fin != NULL);
+    return (m_offsets != NULL);
 }
 
 
 }
 
+
+inline kb::arity_id_t literal_t::get_arity_id() const
+{
+    const kb::knowledge_base_t *base = kb::kb();
+    unsigned long long version = base->version_of_arities();
+
+    // THE CACHED ID MAY BE OF THE ARITY BEFORE THE LITERAL WAS MODIFIED.
+    if (m_arity_key != get_arity_key())
+        return base->search_arity_id(get_arity());
+
+    unsigned long long cache = m_arity_id.load(std::memory_order_relaxed);
+    if ((cache >> 32) == version)
+        return static_cast<kb::arity_id_t>(cache & 0xffffffffULL);
+
+    kb::arity_id_t id = base->search_arity_id(get_arity());
+
+    // UNKNOWN ARITIES ARE NOT CACHED, SINCE THEY MAY BE ADDED ON COMPILING.
+    if (id != kb::INVALID_ARITY_ID)
+        m_arity_id.store((version << 32) | id, std::memory_order_relaxed);
+
+    return id;
+}
+
+
 }
@@ -53,13 +53,16 @@ pg::proof_graph_t* a_star_based_enumerator_t::execute() const
 
         if (considered.count(static_cast<pg::chain_candidate_t>(cand)) == 0)
         {
-            lf::axiom_t axiom = base->get_axiom(cand.axiom_id);
+            auto axiom = base->get_axiom(cand.axiom_id);
             pg::hypernode_idx_t hn_new = cand.is_forward ?
-                graph->forward_chain(cand.nodes, axiom) :
-                graph->backward_chain(cand.nodes, axiom);
+                graph->forward_chain(cand.nodes, *axiom) :
+                graph->backward_chain(cand.nodes, *axiom);
 
+            util::metrics_t::count("lhs.candidates");
             if (hn_new >= 0)
             {
+                util::metrics_t::count("lhs.candidates_applied");
+
                 const std::vector<pg::node_idx_t> nodes_new = graph->hypernode(hn_new);
                 hash_map<pg::node_idx_t,
                     std::pair<float, hash_set<pg::node_idx_t> > > from2goals;
@@ -88,7 +91,7 @@ pg::proof_graph_t* a_star_based_enumerator_t::execute() const
 
                 for (auto p : from2goals)
                 {
-                    float dist = p.second.first + base->get_distance(axiom);
+                    float dist = p.second.first + base->get_distance(*axiom);
 
                     for (auto n : nodes_new)
                     {
@@ -136,8 +139,7 @@ const pg::proof_graph_t *graph, reachability_manager_t *out) const
       }
 
         float dist = kb->get_distance(
-            graph->node(*n1).literal().get_arity(),
-            graph->node(*n2).literal().get_arity());
+            graph->node(*n1).arity_id(), graph->node(*n2).arity_id());
 
         if (check_permissibility_of(dist))
         {
@@ -169,24 +171,24 @@ void a_star_based_enumerator_t::add_reachability(
     {
         for (auto ax : gen.axioms())
         {
-            lf::axiom_t axiom = kb::kb()->get_axiom(ax.first);
-            float d_from = dist + kb::kb()->get_distance(axiom);
+            auto axiom = kb::kb()->get_axiom(ax.first);
+            float d_from = dist + kb::kb()->get_distance(*axiom);
 
             if (not check_permissibility_of(d_from)) continue;
 
             for (auto g : goals_filtered)
             {
-                std::string arity_goal = graph->node(g).arity();
+                kb::arity_id_t arity_goal = graph->node(g).arity_id();
 
                 for (auto tar : gen.targets())
                 {
                     auto lits = not kb::is_backward(ax) ?
-                        axiom.func.get_rhs() : axiom.func.get_lhs();
+                        axiom->func.get_rhs() : axiom->func.get_lhs();
                     float d_to(-1.0f);
 
                     for (auto l : lits)
                     {
-                        float d = kb::kb()->get_distance(l->get_arity(), arity_goal);
+                        float d = kb::kb()->get_distance(l->get_arity_id(), arity_goal);
                         if ((d_to < 0.0f or d_to > d)
                             and check_permissibility_of(d))
                             d_to = d;
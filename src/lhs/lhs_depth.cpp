@@ -36,13 +36,12 @@ pg::proof_graph_t* depth_based_enumerator_t::execute() const
 
     for (int depth = 0; (m_depth_max < 0 or depth < m_depth_max); ++depth)
     {
-        const hash_set<pg::node_idx_t>
-            *nodes = graph->search_nodes_with_depth(depth);
-        if (nodes == NULL) break;
+        pg::node_span_t nodes = graph->search_nodes_with_depth(depth);
+        if (nodes.empty()) break;
 
         hash_map<axiom_id_t, std::set<pg::chain_candidate_t>> candidates;
 
-        for (auto n : (*nodes))
+        for (auto n : nodes)
         {
 
           if(phillip()->flag("abductive_theorem_prover")) {
@@ -67,7 +66,10 @@ pg::proof_graph_t* depth_based_enumerator_t::execute() const
 
         for (auto p : candidates)
         {
-            const lf::axiom_t &axiom = kb::kb()->get_axiom(p.first);
+            util::metrics_t::count("lhs.candidates", p.second.size());
+
+            auto ptr = kb::kb()->get_axiom(p.first);
+            const lf::axiom_t &axiom = *ptr;
 
             // Make inference efficient exploiting non-abducible literals.
             std::vector<const lf::logical_function_t*> nonab_lfs;
@@ -108,6 +110,9 @@ pg::proof_graph_t* depth_based_enumerator_t::execute() const
                 pg::hypernode_idx_t to = c.is_forward ?
                     graph->forward_chain(c.nodes, axiom) :
                     graph->backward_chain(c.nodes, axiom);
+
+                if (to >= 0)
+                    util::metrics_t::count("lhs.candidates_applied");
             }
 
             if (do_time_out(begin))
@@ -298,7 +298,7 @@ bool logical_function_t::is_valid_as_argument_set() const
         return false;
     else
     {
-        const std::vector<term_t> &terms(m_literal.terms);
+        const literal_t::term_array_t &terms(m_literal.terms);
 
         for (auto it_term = terms.begin(); it_term != terms.end(); ++it_term)
         {
@@ -544,8 +544,7 @@ void logical_function_t::add_branch(const logical_function_t &lf)
 
 void parse(const std::string &str, std::list<logical_function_t> *out)
 {
-    std::stringstream ss(str);
-    sexp::reader_t reader(ss);
+    sexp::reader_t reader(str.data(), str.size());
 
     for (; not reader.is_end(); reader.read())
     if (reader.is_root())
@@ -51,6 +51,7 @@ public:
     logical_function_t(const sexp::stack_t &s);
 
     inline bool is_operator(logical_operator_t opr) const;
+    inline logical_operator_t get_operator() const { return m_operator; }
     inline const std::vector<logical_function_t>& branches() const;
     inline const logical_function_t& branch(int i) const;
     inline const literal_t& literal() const;
@@ -91,6 +92,7 @@ public:
     void print(std::string *p_out_str, bool f_colored = false) const;
 
     void add_branch(const logical_function_t &lf);
+    inline void set_param(const std::string &param) { m_param = param; }
 
 private:
     void get_all_literals_sub(
@@ -3,6 +3,7 @@
 #include <ctime>
 #include <thread>
 #include <algorithm>
+#include <sstream>
 
 #include "./phillip.h"
 
@@ -17,7 +18,7 @@ const std::string phillip_main_t::VERSION = "phil.3.17";
 
 phillip_main_t::phillip_main_t()
 : m_lhs_enumerator(NULL), m_ilp_convertor(NULL), m_ilp_solver(NULL),
-  m_input(NULL), m_lhs(NULL), m_ilp(NULL),
+  m_input(NULL), m_lhs(NULL), m_ilp(NULL), m_do_buffer_outputs(false),
   m_time_for_enumerate(0), m_time_for_convert(0), m_time_for_convert_gold(0),
   m_time_for_solve(0), m_time_for_solve_gold(0),
   m_time_for_learn(0), m_time_for_infer(0)
@@ -48,6 +49,7 @@ phillip_main_t* phillip_main_t::duplicate() const
     out->m_timeout_lhs = m_timeout_lhs;
     out->m_timeout_ilp = m_timeout_ilp;
     out->m_timeout_sol = m_timeout_sol;
+    out->m_timeout_all = m_timeout_all;
 
     return out;
 }
@@ -74,10 +76,120 @@ std::ofstream* _open_file(const std::string &path, std::ios::openmode mode)
 
 int phillip_main_t::infer(const lf::input_t &input)
 {
-    // Search for possible choice.
-    std::vector<std::pair<term_t, std::vector<term_t>>> choice;
+    std::vector<lf::input_t> inputs;
 
     m_sol_all.clear();
+    m_choice_workers.clear();
+    apply_choices(input, &inputs);
+
+    int thread_num = std::min<int>(param_int("choice_thread_num", 1), inputs.size());
+    if (thread_num > 1)
+    {
+        infer_choices_in_parallel(inputs, thread_num);
+        return 0;
+    }
+
+    for (auto ipt = inputs.begin(); ipt != inputs.end(); ++ipt)
+    {
+        begin_inference(*ipt);
+        execute_enumerator();
+        execute_convertor();
+        execute_solver();
+        end_inference();
+    }
+
+    return 0;
+}
+
+
+void phillip_main_t::infer_choices_in_parallel(
+    const std::vector<lf::input_t> &inputs, int thread_num)
+{
+    size_t num_dup = inputs.size() - 1;
+    std::vector<std::exception_ptr> errors(inputs.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    // EACH INPUT HAS ITS OWN DUPLICATE, SINCE ITS SOLUTIONS REFER TO THE ILP PROBLEM.
+    for (size_t i = 0; i < num_dup; ++i)
+    {
+        m_choice_workers.emplace_back(duplicate());
+        m_choice_workers.back()->set_output_buffering(true);
+    }
+
+    auto run = [&](phillip_main_t *ph, size_t i)
+    {
+        try
+        {
+            ph->begin_inference(inputs.at(i));
+            ph->execute_enumerator();
+            ph->execute_convertor();
+            ph->execute_solver();
+            ph->end_inference();
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    };
+    auto run_duplicates = [&]()
+    {
+        for (size_t i = next++; i < num_dup; i = next++)
+            run(m_choice_workers.at(i).get(), i);
+    };
+
+    for (int k = 1; k < thread_num; ++k)
+        threads.emplace_back(run_duplicates);
+
+    // OUTPUTS OF THE LAST INPUT ARE KEPT UNTIL THOSE OF THE OTHERS ARE WRITTEN.
+    bool do_buffer_outputs = m_do_buffer_outputs;
+    hash_map<std::string, std::string> buffered, outputs_last;
+
+    buffered.swap(m_buffered_outputs);
+    m_do_buffer_outputs = true;
+    run(this, num_dup);
+    outputs_last.swap(m_buffered_outputs);
+    m_buffered_outputs.swap(buffered);
+    m_do_buffer_outputs = do_buffer_outputs;
+
+    run_duplicates();
+    for (auto &th : threads)
+        th.join();
+
+    auto write_outputs = [this](const hash_map<std::string, std::string> &outputs)
+    {
+        for (auto it = outputs.begin(); it != outputs.end(); ++it)
+            write_output(it->first, [&](std::ostream *os) { (*os) << it->second; });
+    };
+
+    m_sol_all.clear();
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        phillip_main_t *ph = (i < num_dup) ? m_choice_workers.at(i).get() : this;
+        hash_map<std::string, std::string> outputs;
+
+        if (ph != this)
+            ph->take_buffered_outputs(&outputs);
+        write_outputs((ph != this) ? outputs : outputs_last);
+
+        // AS IN SERIAL INFERENCE, AN ERROR STOPS INFERENCE OF THE REST.
+        if (errors.at(i))
+            std::rethrow_exception(errors.at(i));
+
+        for (auto sol = ph->m_sol.begin(); sol != ph->m_sol.end(); ++sol)
+            m_sol_all.push_back(*sol);
+
+        if (ph != this)
+            merge_metrics(*ph);
+    }
+}
+
+
+void phillip_main_t::apply_choices(
+    const lf::input_t &input, std::vector<lf::input_t> *out)
+{
+    // Search for possible choice.
+    std::vector<std::pair<term_t, std::vector<term_t>>> choice;
 
     for(auto l: input.obs.get_all_literals()) {
         if(l->predicate == ":choice") {
@@ -127,32 +239,39 @@ int phillip_main_t::infer(const lf::input_t &input)
 
         util::print_console_fmt("Binding applied: %s", uni.to_string().c_str());
 
-        reset_for_inference();
-        set_input(dup_input);
+        out->push_back(dup_input);
+    }
+}
 
-        auto begin = std::chrono::system_clock::now();
 
-        execute_enumerator();
-        execute_convertor();
-        execute_solver();
+void phillip_main_t::begin_inference(const lf::input_t &input)
+{
+    reset_for_inference();
+    set_input(input);
+    m_metrics.clear();
+    m_time_begin = std::chrono::system_clock::now();
+}
 
-        m_time_for_infer = util::duration_time(begin);
 
-        for(auto j=0; j<m_sol.size(); j++)
-            m_sol_all.push_back(m_sol[j]);
+void phillip_main_t::end_inference()
+{
+    m_time_for_infer = util::duration_time(m_time_begin);
 
-        std::ofstream *fo(NULL);
-        if ((fo = _open_file(param("path_out"), std::ios::out | std::ios::app)) != NULL)
-        {
-            for (auto sol = m_sol.begin(); sol != m_sol.end(); ++sol)
-                sol->print_graph(fo);
+    for(auto j=0; j<m_sol.size(); j++)
+        m_sol_all.push_back(m_sol[j]);
 
-            delete fo;
-        }
+    write_output(param("path_out"), [this](std::ostream *os)
+    {
+        for (auto sol = m_sol.begin(); sol != m_sol.end(); ++sol)
+            sol->print_graph(os);
+    });
 
-    }
+    m_metrics.add("inputs");
+    m_metrics.add_sample("time.all", m_time_for_infer);
+    m_metrics_total.merge(m_metrics);
 
-    return 0;
+    write_output(param("path_metrics_out"), [this](std::ostream *os)
+    { m_metrics.print_json(os, "input", m_input->name); });
 }
 
 
@@ -238,25 +357,25 @@ void phillip_main_t::execute_enumerator(
 
     if ((*out_lhs) != NULL) delete m_lhs;
 
+    // UNKNOWN VARIABLES ARE NUMBERED FOR EACH INPUT ON THE THREAD OF ENUMERATION.
+    term_t::reset_unknown_hash_count();
+
+    util::metrics_t::scope_t scope(metrics_to_record());
     auto begin = std::chrono::system_clock::now();
     (*out_lhs) = m_lhs_enumerator->execute();
     (*out_time) = util::duration_time(begin);
 
+    m_metrics.add("pg.nodes", (*out_lhs)->nodes().size());
+    m_metrics.add("pg.edges", (*out_lhs)->edges().size());
+    m_metrics.add("pg.hypernodes", (*out_lhs)->hypernodes().size());
+    m_metrics.add_sample("time.lhs", (*out_time));
+
     IF_VERBOSE_2(
         m_lhs->has_timed_out() ?
         "Interrupted generating latent-hypotheses-set." :
         "Completed generating latent-hypotheses-set.");
 
-    if (not path_out_xml.empty())
-    {
-        std::ios::openmode mode = std::ios::out | std::ios::app;
-        std::ofstream *fo = _open_file(path_out_xml, mode);
-        if (fo != NULL)
-        {
-            m_lhs->print(fo);
-            delete fo;
-        }
-    }
+    write_output(path_out_xml, [this](std::ostream *os) { m_lhs->print(os); });
 }
 
 
@@ -266,25 +385,22 @@ void phillip_main_t::execute_convertor(
 {
     IF_VERBOSE_2("Converting LHS into linear-programming-problems...");
 
+    util::metrics_t::scope_t scope(metrics_to_record());
     auto begin = std::chrono::system_clock::now();
     (*out_ilp) = m_ilp_convertor->execute();
     (*out_time) = util::duration_time(begin);
 
+    m_metrics.add("ilp.variables", (*out_ilp)->variables().size());
+    m_metrics.add("ilp.constraints", (*out_ilp)->constraints().size());
+    m_metrics.add("ilp.lazy_constraints", (*out_ilp)->get_lazy_constraints().size());
+    m_metrics.add_sample("time.ilp", (*out_time));
+
     IF_VERBOSE_2(
         m_ilp->has_timed_out() ?
         "Interrupted convertion into linear-programming-problems." :
         "Completed convertion into linear-programming-problems.");
 
-    if (not path_out_xml.empty())
-    {
-        std::ios::openmode mode = std::ios::out | std::ios::app;
-        std::ofstream *fo = _open_file(path_out_xml, mode);
-        if (fo != NULL)
-        {
-            m_ilp->print(fo);
-            delete fo;
-        }
-    }
+    write_output(path_out_xml, [this](std::ostream *os) { m_ilp->print(os); });
 }
 
 
@@ -295,20 +411,55 @@ void phillip_main_t::execute_solver(
 {
     IF_VERBOSE_2("Solving...");
 
+    util::metrics_t::scope_t scope(metrics_to_record());
     auto begin = std::chrono::system_clock::now();
     m_ilp_solver->execute(out_sols);
     (*out_time) = util::duration_time(begin);
 
+    m_metrics.add_sample("time.sol", (*out_time));
+
     IF_VERBOSE_2("Completed inference.");
 
-    if (not path_out_xml.empty())
+    write_output(path_out_xml, [this](std::ostream *os)
+    {
+        for (auto sol = m_sol.begin(); sol != m_sol.end(); ++sol)
+            sol->print(os);
+    });
+}
+
+
+void phillip_main_t::write_output(
+    const std::string &path, const std::function<void(std::ostream*)> &writer)
+{
+    if (path.empty()) return;
+
+    if (m_do_buffer_outputs)
+    {
+        std::ostringstream oss;
+        writer(&oss);
+        m_buffered_outputs[path] += oss.str();
+    }
+    else
+    {
+        std::ofstream *fo = _open_file(path, std::ios::out | std::ios::app);
+        if (fo != NULL)
+        {
+            writer(fo);
+            delete fo;
+        }
+    }
+}
+
+
+void phillip_main_t::write_buffered_outputs(
+    const hash_map<std::string, std::string> &outputs)
+{
+    for (auto it = outputs.begin(); it != outputs.end(); ++it)
     {
-        std::ios::openmode mode = std::ios::out | std::ios::app;
-        std::ofstream *fo = _open_file(path_out_xml, mode);
+        std::ofstream *fo = _open_file(it->first, std::ios::out | std::ios::app);
         if (fo != NULL)
         {
-            for (auto sol = m_sol.begin(); sol != m_sol.end(); ++sol)
-                sol->print(fo);
+            (*fo) << it->second;
             delete fo;
         }
     }
@@ -458,11 +609,43 @@ void phillip_main_t::write_header() const
     f_write("path_sol_out");
     f_write("path_out");
     write(&std::cout);
+
+    // THE FILE OF METRICS HAS NO HEADER, BUT IS CLEARED AS WELL.
+    delete _open_file(param("path_metrics_out"), (std::ios::out | std::ios::trunc));
 }
 
 
 void phillip_main_t::write_footer() const
 {
+    auto write_workers = [this](std::ostream *os)
+    {
+        if (m_worker_stats.empty()) return;
+
+        worker_stat_t sum = { 0, 0.0f, 0.0f, 0.0f, 0.0f };
+        auto write_stat = [os](const std::string &name, const worker_stat_t &s)
+        {
+            (*os)
+                << "<" << name << " observations=\"" << s.num_observations
+                << "\" lhs=\"" << s.time_lhs
+                << "\" ilp=\"" << s.time_ilp
+                << "\" sol=\"" << s.time_sol
+                << "\" all=\"" << s.time_infer
+                << "\"></" << name << ">" << std::endl;
+        };
+
+        (*os) << "<workers num=\"" << m_worker_stats.size() << "\">" << std::endl;
+        for (auto it = m_worker_stats.begin(); it != m_worker_stats.end(); ++it)
+        {
+            write_stat("worker", (*it));
+            sum.num_observations += it->num_observations;
+            sum.time_lhs += it->time_lhs;
+            sum.time_ilp += it->time_ilp;
+            sum.time_sol += it->time_sol;
+            sum.time_infer += it->time_infer;
+        }
+        write_stat("total", sum);
+        (*os) << "</workers>" << std::endl;
+    };
     auto write = [this](std::ostream *os)
     {
         (*os) << "</phillip>" << std::endl;
@@ -472,6 +655,8 @@ void phillip_main_t::write_footer() const
         std::ofstream *fo(NULL);
         if ((fo = _open_file(param(key), (std::ios::out | std::ios::app))) != NULL)
         {
+            if (key == "path_out")
+                write_workers(fo);
             write(fo);
             delete fo;
         }
@@ -481,8 +666,20 @@ void phillip_main_t::write_footer() const
     f_write("path_ilp_out");
     f_write("path_sol_out");
     f_write("path_out");
+    write_workers(&std::cout);
     write(&std::cout);
 }
 
 
+void phillip_main_t::write_total_metrics() const
+{
+    std::ofstream *fo(NULL);
+    if ((fo = _open_file(param("path_metrics_out"), std::ios::out | std::ios::app)) != NULL)
+    {
+        m_metrics_total.print_json(fo, "run", "");
+        delete fo;
+    }
+}
+
+
 }
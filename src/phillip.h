@@ -36,6 +36,14 @@ public:
 
     static const std::string VERSION;
 
+    /** Statistics of a worker in parallel inference,
+     *  which are written in the footer. */
+    struct worker_stat_t
+    {
+        int num_observations;
+        duration_time_t time_lhs, time_ilp, time_sol, time_infer;
+    };
+
     phillip_main_t();
     ~phillip_main_t();
 
@@ -50,6 +58,18 @@ public:
     /** Do learning on given observation. */
     int learn(const lf::input_t &input);
 
+    /** Makes an input for each combination of instantiations of :choice
+     *  in given input, each of which is inferred independently. */
+    static void apply_choices(const lf::input_t &input, std::vector<lf::input_t> *out);
+
+    /** Stages of inference on an input given by apply_choices(), which infer() runs in order.
+     *  Stages for different inputs can run on different instances at the same time. */
+    void begin_inference(const lf::input_t &input);
+    inline void execute_enumerator();
+    inline void execute_convertor();
+    inline void execute_solver();
+    void end_inference();
+
     inline const lhs_enumerator_t* lhs_enumerator() const;
     inline lhs_enumerator_t* lhs_enumerator();
     inline const ilp_converter_t* ilp_convertor() const;
@@ -79,6 +99,10 @@ public:
     inline const ilp::ilp_problem_t* get_ilp_problem() const;
     inline const std::vector<ilp::ilp_solution_t>& get_solutions() const;
 
+    /** Discards solutions kept over inputs since the last infer(),
+     *  which refer to ILP problems deleted on the next input. */
+    inline void clear_all_solutions() { m_sol_all.clear(); }
+
     inline const util::timeout_t& timeout_lhs() const { return m_timeout_lhs; }
     inline const util::timeout_t& timeout_ilp() const { return m_timeout_ilp; }
     inline const util::timeout_t& timeout_sol() const { return m_timeout_sol; }
@@ -98,6 +122,13 @@ public:
     inline float get_time_for_sol()  const;
     inline float get_time_for_infer() const;
 
+    /** Returns statistics of the caches in the knowledge-base,
+     *  which are shared through the whole run. */
+    inline unsigned long long get_num_distance_cache_hits() const;
+    inline unsigned long long get_num_distance_cache_misses() const;
+    inline unsigned long long get_num_axiom_cache_hits() const;
+    inline unsigned long long get_num_axiom_cache_misses() const;
+
     inline void add_target(const std::string &name);
     inline void clear_targets();
     inline bool is_target(const std::string &name) const;
@@ -106,6 +137,27 @@ public:
     inline bool is_excluded(const std::string &name) const;
     inline bool check_validity() const;
 
+    /** If true, outputs which infer() appends to files are kept in memory,
+     *  so that the caller can write them in the order of observations. */
+    inline void set_output_buffering(bool do_buffer) { m_do_buffer_outputs = do_buffer; }
+
+    /** Moves outputs kept in memory to out, whose keys are file paths. */
+    inline void take_buffered_outputs(hash_map<std::string, std::string> *out);
+
+    /** Appends outputs given by take_buffered_outputs() to the files. */
+    static void write_buffered_outputs(const hash_map<std::string, std::string> &outputs);
+
+    inline void add_worker_stat(const worker_stat_t &s) { m_worker_stats.push_back(s); }
+
+    /** Returns metrics of the last input, which are reset by begin_inference(). */
+    inline const util::metrics_t& metrics() const { return m_metrics; }
+
+    /** Returns metrics aggregated over inputs inferred through the run. */
+    inline const util::metrics_t& total_metrics() const { return m_metrics_total; }
+
+    /** Adds metrics aggregated on a duplicate to those of this. */
+    inline void merge_metrics(const phillip_main_t &ph) { m_metrics_total.merge(ph.m_metrics_total); }
+
     void load_tuned_parameters();
     void load_dynamic_weight_parameters();
 
@@ -114,14 +166,17 @@ public:
     void write_header() const;
     void write_footer() const;
 
+    /** Appends the metrics aggregated through the run to the file of metrics. */
+    void write_total_metrics() const;
+
 protected:
+    /** Returns metrics which components record details into,
+     *  or NULL if metrics are not written out. */
+    inline util::metrics_t* metrics_to_record();
+
     inline void reset_for_inference();
     inline void set_input(const lf::input_t&);
 
-    inline void execute_enumerator();
-    inline void execute_convertor();
-    inline void execute_solver();
-
     void execute_enumerator(
         pg::proof_graph_t **out_lhs, duration_time_t *out_time,
         const std::string &path_out_xml);
@@ -133,6 +188,16 @@ protected:
         duration_time_t *out_clock,
         const std::string &path_out_xml);
 
+    /** Infers inputs given by apply_choices() on thread_num threads.
+     *  The last input is inferred on this instance and the others on duplicates,
+     *  whose outputs are written in the order of inputs. */
+    void infer_choices_in_parallel(const std::vector<lf::input_t> &inputs, int thread_num);
+
+    /** Appends what writer prints to the file of path,
+     *  or to the buffer of it if outputs are buffered. */
+    void write_output(
+        const std::string &path, const std::function<void(std::ostream*)> &writer);
+
 private:
     static int ms_verboseness;
 
@@ -158,7 +223,18 @@ private:
     std::vector<ilp::ilp_solution_t> m_sol_all;
     std::vector<ilp::ilp_solution_t> m_sol_gold;
 
+    /** Duplicates which inferred inputs of the last observation in parallel.
+     *  They are kept alive since m_sol_all refers to their ILP problems. */
+    std::vector<std::unique_ptr<phillip_main_t> > m_choice_workers;
+
+    bool m_do_buffer_outputs;
+    hash_map<std::string, std::string> m_buffered_outputs;
+    std::vector<worker_stat_t> m_worker_stats;
+
+    util::metrics_t m_metrics, m_metrics_total;
+
     // ---- FOR MEASURE TIME
+    std::chrono::system_clock::time_point m_time_begin;
     duration_time_t
         m_time_for_enumerate,
         m_time_for_convert, m_time_for_convert_gold,
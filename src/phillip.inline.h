@@ -151,6 +151,12 @@ inline const hash_map<std::string, std::string>& phillip_main_t::params() const
 { return m_params; }
 
 
+inline util::metrics_t* phillip_main_t::metrics_to_record()
+{
+    return param("path_metrics_out").empty() ? NULL : &m_metrics;
+}
+
+
 inline const std::string& phillip_main_t::param(const std::string &key) const
 {
     static const std::string empty_str("");
@@ -217,6 +223,30 @@ inline float phillip_main_t::get_time_for_infer() const
 }
 
 
+inline unsigned long long phillip_main_t::get_num_distance_cache_hits() const
+{
+    return kb::kb()->distance_cache().num_hits();
+}
+
+
+inline unsigned long long phillip_main_t::get_num_distance_cache_misses() const
+{
+    return kb::kb()->distance_cache().num_misses();
+}
+
+
+inline unsigned long long phillip_main_t::get_num_axiom_cache_hits() const
+{
+    return kb::kb()->axiom_cache().num_hits();
+}
+
+
+inline unsigned long long phillip_main_t::get_num_axiom_cache_misses() const
+{
+    return kb::kb()->axiom_cache().num_misses();
+}
+
+
 inline void phillip_main_t::add_target(const std::string &name)
 {
     m_target_obs_names.insert(name);
@@ -277,6 +307,14 @@ inline bool phillip_main_t::check_validity() const
 }
 
 
+inline void phillip_main_t::take_buffered_outputs(
+    hash_map<std::string, std::string> *out)
+{
+    out->clear();
+    out->swap(m_buffered_outputs);
+}
+
+
 inline void phillip_main_t::reset_for_inference()
 {
     if (m_input != NULL) delete m_input;
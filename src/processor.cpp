@@ -1,6 +1,10 @@
 /* -*- coding: utf-8 -*- */
 
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 #include "./processor.h"
 #include "./phillip.h"
@@ -33,10 +37,28 @@ namespace proc
 
 
 void parse_obs_t::process(const sexp::reader_t *reader)
+{
+    if (m_inputs == NULL and m_queue == NULL) return;
+
+    lf::input_t data;
+    parse(reader, &data);
+
+    if (data.name.empty()) return;
+
+    if (m_inputs != NULL)
+        m_inputs->push_back(data);
+
+    // THE CONSUMER HAS CLOSED THE QUEUE, SO THE REST OF INPUTS IS NOT PARSED.
+    else if (not m_queue->push(std::move(data)))
+        throw phillip_exception_t("The queue of observations has been closed.");
+}
+
+
+void parse_obs_t::parse(const sexp::reader_t *reader, lf::input_t *out)
 {
     const sexp::stack_t& stack(*reader->get_stack());
 
-    if (not stack.is_functor("O") or m_inputs == NULL)
+    if (not stack.is_functor("O"))
         return;
 
     /* SHOULD BE ROOT. */
@@ -65,7 +87,275 @@ void parse_obs_t::process(const sexp::reader_t *reader)
         util::print_console("Requirement loaded.");
     }
 
-    m_inputs->push_back(data);
+    *out = data;
+}
+
+
+const char corpus_t::MAGIC[8] = { 'P', 'H', 'I', 'L', 'O', 'B', 'S', '1' };
+
+
+corpus_t::writer_t::writer_t(const std::string &filename)
+    : m_filename(filename)
+{
+    m_fout.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (not m_fout)
+        throw phillip_exception_t("Cannot open file: " + filename);
+
+    m_fout.write(MAGIC, sizeof(MAGIC));
+}
+
+
+corpus_t::writer_t::~writer_t()
+{
+    if (m_fout.is_open())
+        close();
+}
+
+
+template <class T> inline void corpus_t::writer_t::write(const T &x)
+{
+    m_fout.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+
+void corpus_t::writer_t::write_string(const std::string &str)
+{
+    write<std::uint32_t>(str.size());
+    m_fout.write(str.data(), str.size());
+}
+
+
+void corpus_t::writer_t::write_symbol(const std::string &str)
+{
+    auto found = m_symbol_to_id.find(str);
+    if (found != m_symbol_to_id.end())
+        write<std::uint32_t>(found->second);
+    else
+    {
+        std::uint32_t id = m_symbols.size();
+        m_symbol_to_id[str] = id;
+        m_symbols.push_back(str);
+        write<std::uint32_t>(id);
+    }
+}
+
+
+void corpus_t::writer_t::write_function(const lf::logical_function_t &f)
+{
+    write<std::uint8_t>(f.get_operator());
+
+    if (f.is_operator(lf::OPR_LITERAL))
+    {
+        const literal_t &lit = f.literal();
+        write_symbol(lit.predicate.string());
+        write<std::uint8_t>(lit.truth ? 1 : 0);
+        write<std::uint8_t>(lit.terms.size());
+        for (const auto &t : lit.terms)
+            write_symbol(t.string());
+    }
+    else
+    {
+        write<std::uint32_t>(f.branches().size());
+        for (const auto &b : f.branches())
+            write_function(b);
+    }
+
+    write_symbol(f.param());
+}
+
+
+void corpus_t::writer_t::put(const lf::input_t &ipt)
+{
+    m_offsets.push_back(m_fout.tellp());
+    m_names.push_back(ipt.name);
+
+    write_string(ipt.name);
+    write_function(ipt.obs);
+    write_function(ipt.req);
+    write_function(ipt.label);
+}
+
+
+void corpus_t::writer_t::close()
+{
+    std::uint64_t pos_symbols = m_fout.tellp();
+    write<std::uint32_t>(m_symbols.size());
+    for (const auto &s : m_symbols)
+        write_string(s);
+
+    std::uint64_t pos_index = m_fout.tellp();
+    write<std::uint64_t>(m_offsets.size());
+    for (size_t i = 0; i < m_offsets.size(); ++i)
+    {
+        write<std::uint64_t>(m_offsets.at(i));
+        write_string(m_names.at(i));
+    }
+
+    write<std::uint64_t>(pos_symbols);
+    write<std::uint64_t>(pos_index);
+
+    m_fout.close();
+    if (m_fout.fail())
+        throw phillip_exception_t("Failed to write file: " + m_filename);
+}
+
+
+/** A cursor on the mapped file of corpus_t. */
+class corpus_t::decoder_t
+{
+public:
+    decoder_t(const util::mapped_file_t &file, size_t pos)
+        : m_data(file.data()), m_size(file.size()), m_pos(pos) {}
+
+    template <class T> T read()
+    {
+        if (m_pos + sizeof(T) > m_size)
+            throw phillip_exception_t("Corpus file is broken.");
+
+        T x;
+        std::memcpy(&x, m_data + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return x;
+    }
+
+    std::string read_string()
+    {
+        std::uint32_t len = read<std::uint32_t>();
+        if (m_pos + len > m_size)
+            throw phillip_exception_t("Corpus file is broken.");
+
+        std::string out(m_data + m_pos, len);
+        m_pos += len;
+        return out;
+    }
+
+    void read_function(
+        const std::vector<term_t> &symbols, lf::logical_function_t *out)
+    {
+        auto symbol = [&]() -> const term_t& {
+            return symbols.at(read<std::uint32_t>()); };
+
+        lf::logical_operator_t opr =
+            static_cast<lf::logical_operator_t>(read<std::uint8_t>());
+
+        if (opr == lf::OPR_LITERAL)
+        {
+            literal_t::term_array_t terms;
+            predicate_t pred = symbol();
+            bool truth = (read<std::uint8_t>() != 0);
+            size_t n = read<std::uint8_t>();
+
+            for (size_t i = 0; i < n; ++i)
+                terms.push_back(symbol());
+
+            *out = lf::logical_function_t(literal_t(pred, terms, truth));
+        }
+        else
+        {
+            *out = lf::logical_function_t(opr);
+            size_t n = read<std::uint32_t>();
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                lf::logical_function_t branch;
+                read_function(symbols, &branch);
+                out->add_branch(branch);
+            }
+        }
+
+        out->set_param(symbol().string());
+    }
+
+    size_t pos() const { return m_pos; }
+
+private:
+    const char *m_data;
+    size_t m_size, m_pos;
+};
+
+
+bool corpus_t::is_corpus(const std::string &filename)
+{
+    char header[sizeof(MAGIC)];
+    std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+
+    if (not fin.read(header, sizeof(header)))
+        return false;
+    return std::equal(header, header + sizeof(header), MAGIC);
+}
+
+
+corpus_t::corpus_t(const std::string &filename)
+{
+    if (not m_file.open(filename))
+        throw phillip_exception_t("Cannot open file: " + filename);
+
+    size_t footer = sizeof(MAGIC) + 2 * sizeof(std::uint64_t);
+    if (m_file.size() < footer or
+        not std::equal(MAGIC, MAGIC + sizeof(MAGIC), m_file.data()))
+        throw phillip_exception_t("Invalid corpus file: " + filename);
+
+    decoder_t tail(m_file, m_file.size() - 2 * sizeof(std::uint64_t));
+    std::uint64_t pos_symbols = tail.read<std::uint64_t>();
+    std::uint64_t pos_index = tail.read<std::uint64_t>();
+
+    // SYMBOLS ARE INTERNED ONLY ONCE ON LOADING.
+    decoder_t symbols(m_file, pos_symbols);
+    m_symbols.resize(symbols.read<std::uint32_t>());
+    for (auto &s : m_symbols)
+    {
+        std::string str = symbols.read_string();
+        if (not str.empty())
+            s = term_t(str);
+    }
+
+    decoder_t index(m_file, pos_index);
+    size_t num = index.read<std::uint64_t>();
+    m_offsets.reserve(num);
+    m_names.reserve(num);
+
+    for (size_t i = 0; i < num; ++i)
+    {
+        m_offsets.push_back(index.read<std::uint64_t>());
+        m_names.push_back(index.read_string());
+    }
+}
+
+
+void corpus_t::get(size_t i, lf::input_t *out) const
+{
+    decoder_t dec(m_file, m_offsets.at(i));
+
+    out->name = dec.read_string();
+    dec.read_function(m_symbols, &out->obs);
+    dec.read_function(m_symbols, &out->req);
+    dec.read_function(m_symbols, &out->label);
+}
+
+
+void compile_obs_t::prepare()
+{
+    m_writer.reset(new corpus_t::writer_t(m_filename));
+}
+
+
+void compile_obs_t::process(const sexp::reader_t *reader)
+{
+    lf::input_t data;
+    parse_obs_t::parse(reader, &data);
+
+    if (not data.name.empty())
+    {
+        IF_VERBOSE_FULL("Added observation: " + data.name);
+        m_writer->put(data);
+    }
+}
+
+
+void compile_obs_t::quit()
+{
+    m_writer->close();
+    m_writer.reset();
 }
 
 
@@ -153,7 +443,7 @@ void compile_kb_t::process( const sexp::reader_t *reader )
         lf::logical_function_t func(*stack->children[idx_as]);
         if (phillip_main_t::verbose() == FULL_VERBOSE)
         {
-            const std::vector<term_t> &terms = func.literal().terms;
+            const literal_t::term_array_t &terms = func.literal().terms;
             std::string disp;
             for (auto it = terms.begin(); it != terms.end(); ++it)
                 disp += (it != terms.begin() ? ", " : "") + it->string();
@@ -206,70 +496,210 @@ void processor_t::process( std::vector<std::string> inputs )
         for( auto it=m_components.begin(); it!=m_components.end(); ++it )
             (*it)->prepare();
 
+    std::vector<std::unique_ptr<input_t> > files;
+    std::vector<chunk_t> chunks;
+
     for( auto it=inputs.begin(); it!=inputs.end(); ++it )
     {
-        std::istream *p_is( &std::cin );
-        std::ifstream file;
-        size_t file_size(0);
-        const std::string &input_path( *it );
-        std::string filename;
+        files.emplace_back( new input_t() );
+        input_t &f( *files.back() );
+        f.path = (*it);
 
-        if( input_path != "-" )
+        if( f.path != "-" )
         {
-            file.open( input_path.c_str() );
-            p_is = &file;
+            if (not f.file.open(f.path))
+                throw phillip_exception_t("File not found: " + f.path);
 
-            if (file.fail())
-                throw phillip_exception_t("File not found: " + input_path);
-
-            file_size = util::get_file_size(*p_is);
-            filename  = input_path.substr( input_path.rfind('/')+1 );
+            f.data = f.file.data();
+            f.size = f.file.size();
+            f.name = f.path.substr( f.path.rfind('/')+1 );
         }
         else
-            filename = "stdin";
+        {
+            f.buffer.assign(
+                std::istreambuf_iterator<char>(std::cin),
+                std::istreambuf_iterator<char>());
+            f.data = f.buffer.data();
+            f.size = f.buffer.size();
+            f.name = "stdin";
+        }
+
+        auto splitted = (m_thread_num > 1) ?
+            sexp::reader_t::split(f.data, f.size, CHUNK_SIZE) :
+            std::vector<std::pair<size_t, size_t> >(1, std::make_pair(0, 1));
+
+        for (size_t i = 0; i < splitted.size(); ++i)
+        {
+            size_t end =
+                (i + 1 < splitted.size()) ? splitted[i + 1].first : f.size;
+            chunk_t c = {
+                files.size() - 1, splitted[i].first,
+                end - splitted[i].first, splitted[i].second };
+            chunks.push_back(c);
+        }
+    }
+
+    if( m_thread_num > 1 and chunks.size() > 1 )
+        process_in_parallel( files, chunks );
+    else
+    {
+        for( auto it=files.begin(); it!=files.end(); ++it )
+        {
+            sexp::reader_t reader( (*it)->data, (*it)->size, (*it)->name );
+            process_reader( &reader, it->get(), 0 );
+        }
+    }
+
+    if( --m_recursion == 0 )
+        for( auto it=m_components.begin(); it!=m_components.end(); ++it )
+            (*it)->quit();
+}
 
-        sexp::reader_t reader( *p_is, filename );
-        hash_set<long> notified;
 
-        for( ; not reader.is_end(); reader.read() )
+void processor_t::process_in_parallel(
+    std::vector<std::unique_ptr<input_t> > &inputs,
+    const std::vector<chunk_t> &chunks)
+{
+    int num_cpu = std::thread::hardware_concurrency();
+    int num_thread = std::min<int>(
+        chunks.size(),
+        (num_cpu > 0) ? std::min(m_thread_num, num_cpu) : m_thread_num);
+    size_t window = 2 * num_thread;
+
+    std::vector<std::unique_ptr<sexp::reader_t> > readers(chunks.size());
+    std::vector<std::exception_ptr> errors(chunks.size());
+    std::vector<char> is_parsed(chunks.size(), 0);
+    size_t num_issued(0), num_processed(0);
+    bool do_abort(false);
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    // PARSED CHUNKS ARE KEPT ON MEMORY UNTIL BEING PROCESSED,
+    // SO WORKERS DO NOT GO AHEAD MORE THAN window CHUNKS.
+    auto parse = [&]()
+    {
+        while (true)
         {
-            if( file_size != 0 )
+            size_t i;
             {
-                size_t read_bytes(reader.get_read_bytes());
-                int progress( 100 * read_bytes / file_size );
-                if( notified.count(progress) == 0 )
-                {
-                    notified.insert(progress);
-                    std::cerr << util::time_stamp()
-                              << input_path << ":" << read_bytes
-                              << "/" << file_size
-                              << " bytes processed (" << progress << "%)."
-                              << std::endl;
-                }
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() {
+                    return do_abort or num_issued >= chunks.size() or
+                        num_issued < num_processed + window; });
+                if (do_abort or num_issued >= chunks.size()) return;
+                i = num_issued++;
             }
 
-            for( auto it=m_components.begin(); it!=m_components.end(); ++it )
-                (*it)->process( &reader );
+            const chunk_t &c = chunks.at(i);
+            const input_t &f = *inputs.at(c.input);
+            std::unique_ptr<sexp::reader_t> r;
+            std::exception_ptr e;
+
+            try
+            {
+                r.reset(new sexp::reader_t(
+                    f.data + c.offset, c.size, f.name, true, c.line_num));
+            }
+            catch (...)
+            {
+                e = std::current_exception();
+            }
 
-            include( &reader );
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                readers[i] = std::move(r);
+                errors[i] = e;
+                is_parsed[i] = 1;
+            }
+            cond.notify_all();
         }
+    };
 
-        if( input_path != "-" ) file.close();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < num_thread; ++i)
+        workers.emplace_back(parse);
 
-        if( reader.get_queue().size() != 1 )
+    auto join = [&]()
+    {
         {
-            std::string out = util::format(
-                "Syntax error: too few parentheses. Around here, or line %d"
-                " (typically the expression followed by this): %s",
-                reader.get_line_num(),
-                reader.get_stack()->to_string().c_str() );
-            throw phillip_exception_t(out);
+            std::lock_guard<std::mutex> lock(mutex);
+            do_abort = true;
         }
+        cond.notify_all();
+        for (auto &t : workers) t.join();
+    };
+
+    try
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            std::unique_ptr<sexp::reader_t> r;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() { return is_parsed[i] != 0; });
+                if (errors[i])
+                    std::rethrow_exception(errors[i]);
+                r = std::move(readers[i]);
+            }
+
+            process_reader(
+                r.get(), inputs.at(chunks[i].input).get(), chunks[i].offset);
+            r.reset();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                num_processed = i + 1;
+            }
+            cond.notify_all();
+        }
+    }
+    catch (...)
+    {
+        join();
+        throw;
     }
 
-    if( --m_recursion == 0 )
+    join();
+}
+
+
+void processor_t::process_reader(
+    sexp::reader_t *reader, input_t *input, size_t offset)
+{
+    size_t file_size = (input->path != "-") ? input->size : 0;
+
+    for( ; not reader->is_end(); reader->read() )
+    {
+        if( file_size != 0 )
+        {
+            size_t read_bytes(offset + reader->get_read_bytes());
+            int progress( 100 * read_bytes / file_size );
+            if( input->notified.count(progress) == 0 )
+            {
+                input->notified.insert(progress);
+                std::cerr << util::time_stamp()
+                          << input->path << ":" << read_bytes
+                          << "/" << file_size
+                          << " bytes processed (" << progress << "%)."
+                          << std::endl;
+            }
+        }
+
         for( auto it=m_components.begin(); it!=m_components.end(); ++it )
-            (*it)->quit();
+            (*it)->process( reader );
+
+        include( reader );
+    }
+
+    if( not reader->is_balanced() )
+    {
+        std::string out = util::format(
+            "Syntax error: too few parentheses. Around here, or line %d"
+            " (typically the expression followed by this): %s",
+            reader->get_line_num(),
+            reader->get_stack()->to_string().c_str() );
+        throw phillip_exception_t(out);
+    }
 }
 
 
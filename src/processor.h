@@ -4,6 +4,10 @@
 #define HENRY_PROCESSOR_H
 
 
+#include <memory>
+#include <fstream>
+#include <cstdint>
+
 #include "./s_expression.h"
 #include "./logical_function.h"
 
@@ -28,13 +32,97 @@ public:
 class parse_obs_t : public component_t
 {
 public:
-    parse_obs_t( std::vector<lf::input_t> *ipt ) : m_inputs(ipt) {}
+    parse_obs_t( std::vector<lf::input_t> *ipt )
+        : m_inputs(ipt), m_queue(NULL) {}
+
+    /** Passes each observation to the queue as soon as it is parsed,
+     *  so that it can be solved while the rest of inputs are parsed.
+     *  process() throws once the queue has been closed. */
+    parse_obs_t( util::blocking_queue_t<lf::input_t> *queue )
+        : m_inputs(NULL), m_queue(queue) {}
+
     virtual void prepare() {}
     virtual void process( const sexp::reader_t* );
     virtual void quit() {}
 
+    /** Parses an observation from the current stack of the reader.
+     *  out is not modified if the stack is not an observation. */
+    static void parse( const sexp::reader_t*, lf::input_t *out );
+
 private:
     std::vector<lf::input_t> *m_inputs;
+    util::blocking_queue_t<lf::input_t> *m_queue;
+};
+
+
+/** A class of pre-compiled observations.
+ *  The file consists of records of observations, a table of symbols
+ *  which the records refer to, and an index of the records.
+ *  The file is memory-mapped and each observation is decoded on demand. */
+class corpus_t
+{
+public:
+    /** A class to write observations into a file of corpus_t. */
+    class writer_t
+    {
+    public:
+        writer_t(const std::string &filename);
+        ~writer_t();
+
+        void put(const lf::input_t &ipt);
+
+        /** Writes the symbol table and the index and closes the file. */
+        void close();
+
+    private:
+        void write_function(const lf::logical_function_t &f);
+        void write_symbol(const std::string &str);
+        template <class T> inline void write(const T &x);
+        void write_string(const std::string &str);
+
+        std::string m_filename;
+        std::ofstream m_fout;
+        hash_map<std::string, std::uint32_t> m_symbol_to_id;
+        std::vector<std::string> m_symbols;
+        std::vector<std::uint64_t> m_offsets;
+        std::vector<std::string> m_names;
+    };
+
+    /** Returns whether the file is a corpus, which is judged by its header. */
+    static bool is_corpus(const std::string &filename);
+
+    corpus_t(const std::string &filename);
+
+    inline size_t size() const { return m_offsets.size(); }
+    inline const std::string& name(size_t i) const { return m_names.at(i); }
+
+    /** Decodes the i-th observation. */
+    void get(size_t i, lf::input_t *out) const;
+
+private:
+    static const char MAGIC[8];
+
+    class decoder_t;
+
+    util::mapped_file_t m_file;
+    std::vector<term_t> m_symbols; /**< Symbols interned on loading. */
+    std::vector<std::uint64_t> m_offsets;
+    std::vector<std::string> m_names;
+};
+
+
+/** A class of component for compiling observations into corpus_t. */
+class compile_obs_t : public component_t
+{
+public:
+    compile_obs_t( const std::string &filename ) : m_filename(filename) {}
+    virtual void prepare();
+    virtual void process( const sexp::reader_t* );
+    virtual void quit();
+
+private:
+    std::string m_filename;
+    std::unique_ptr<corpus_t::writer_t> m_writer;
 };
 
 
@@ -48,11 +136,18 @@ public:
 };
 
 
-/** A class to process input. */
+/** A class to process input.
+ *  With more than one thread, inputs are parsed in parallel
+ *  and then given to components in the order of the inputs. */
 class processor_t
 {
 public:
-    processor_t() : m_recursion(0) {};
+    /** Large inputs are split into chunks of about this size
+     *  to be parsed in parallel. */
+    static const size_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+    processor_t(int thread_num = 1)
+        : m_recursion(0), m_thread_num(thread_num) {};
     ~processor_t();
 
     /** Process inputs.
@@ -63,10 +158,37 @@ public:
     
 private:
     enum processing_state_e { STATE_INIT, STATE_PREPARED, STATE_QUITED };
-    
+
+    /** An input file, which is memory-mapped. */
+    struct input_t
+    {
+        std::string path, name;
+        util::mapped_file_t file;
+        std::string buffer; /**< Content of standard input. */
+        const char *data;
+        size_t size;
+        hash_set<long> notified;
+    };
+
+    /** A part of an input which can be parsed independently. */
+    struct chunk_t
+    {
+        size_t input, offset, size, line_num;
+    };
+
+    /** Parses chunks on worker threads and processes them in order. */
+    void process_in_parallel(
+        std::vector<std::unique_ptr<input_t> > &inputs,
+        const std::vector<chunk_t> &chunks);
+
+    /** Gives every expression of the reader to components. */
+    void process_reader(
+        sexp::reader_t *reader, input_t *input, size_t offset);
+
     void include( const sexp::reader_t* );
 
     int m_recursion;
+    int m_thread_num;
     std::list<component_t*> m_components;
 };
 
@@ -18,35 +18,42 @@ namespace pg
 
 
 
-node_t::node_t(
-    const proof_graph_t *graph,
-    const literal_t &lit, node_type_e type, node_idx_t idx,
-    depth_t depth, const hash_set<node_idx_t> &parents)
-    : m_type(type), m_literal(lit), m_index(idx),
-    m_depth(depth), m_arity_id(kb::INVALID_ARITY_ID),
-    m_master_hypernode_idx(-1), m_parents(parents), m_ancestors(parents)
+node_t::ancestry_t::ancestry_t(
+    const proof_graph_t *graph, const hash_set<node_idx_t> &parents)
 {
-    for (auto p : m_parents)
-    {
-        const hash_set<node_idx_t> &ancs = graph->node(p).ancestors();
-        m_ancestors.insert(ancs.begin(), ancs.end());
-    }
+    // ANCESTRIES SHARED BY SEVERAL PARENTS ARE MERGED ONLY ONCE.
+    hash_set<const ancestry_t*> merged;
 
-    for (auto idx : m_parents)
+    for (auto p : parents)
     {
-        const node_t &n = graph->node(idx);
+        const node_t &n = graph->node(p);
         const std::vector<node_idx_t> &bros = graph->hypernode(n.master_hypernode());
-        m_relatives.insert(bros.begin(), bros.end());
+
+        this->parents.insert(p);
+        ancestors.insert(p);
+
+        if (merged.insert(n.ancestry().get()).second)
+            ancestors.merge(n.ancestors());
 
         for (auto br : bros)
         {
-            const hash_set<node_idx_t> &ancs = graph->node(br).ancestors();
-            m_ancestors.insert(ancs.begin(), ancs.end());
+            relatives.insert(br);
+            if (merged.insert(graph->node(br).ancestry().get()).second)
+                ancestors.merge(graph->node(br).ancestors());
         }
     }
+}
 
+
+node_t::node_t(
+    const literal_t &lit, node_type_e type, node_idx_t idx,
+    depth_t depth, const std::shared_ptr<const ancestry_t> &ancestry)
+    : m_type(type), m_literal(lit), m_index(idx),
+    m_depth(depth), m_arity_id(kb::INVALID_ARITY_ID),
+    m_master_hypernode_idx(-1), m_ancestry(ancestry)
+{
     if (not m_literal.is_equality())
-        m_arity_id = kb::kb()->search_arity_id(m_literal.get_arity());
+        m_arity_id = m_literal.get_arity_id();
 }
 
 
@@ -186,22 +193,29 @@ void proof_graph_t::chain_candidate_generator_t::init(node_idx_t idx)
 
     if (m_pivot >= 0)
     {
-        std::list<kb::arity_pattern_t> patterns;
         kb::arity_id_t id_pivot = m_graph->node(m_pivot).arity_id();
-
-        kb::kb()->search_arity_patterns(id_pivot, &patterns);
-        m_patterns.insert(patterns.begin(), patterns.end());
+        auto patterns = kb::kb()->search_arity_patterns(id_pivot);
+        m_patterns.assign(patterns.begin(), patterns.end());
 
         hash_map<kb::arity_id_t, float> soft_unifiable_arities;
 
         kb::kb()->category_table()->gets(id_pivot, &soft_unifiable_arities);
 
+        bool do_merge(false);
         for (auto p : soft_unifiable_arities)
         if (p.second >= 0.0 and
             p.second < m_graph->threshold_distance_for_soft_unifying())
         {
-            kb::kb()->search_arity_patterns(p.first, &patterns);
-            m_patterns.insert(patterns.begin(), patterns.end());
+            patterns = kb::kb()->search_arity_patterns(p.first);
+            m_patterns.insert(m_patterns.end(), patterns.begin(), patterns.end());
+            do_merge = true;
+        }
+
+        if (do_merge)
+        {
+            std::sort(m_patterns.begin(), m_patterns.end());
+            m_patterns.erase(
+                std::unique(m_patterns.begin(), m_patterns.end()), m_patterns.end());
         }
     }
 
@@ -228,29 +242,31 @@ void proof_graph_t::chain_candidate_generator_t::next()
 void proof_graph_t::chain_candidate_generator_t::enumerate()
 {
     m_targets.clear();
-    m_axioms.clear();
+    m_axioms = kb::axiom_direction_span_t();
 
     if (end()) return;
 
+    const kb::arity_pattern_t &pattern = kb::kb()->get_arity_pattern(*m_pt_iter);
+
     hash_map<kb::arity_id_t, hash_set<node_idx_t>> a2ns;
     std::list<std::list<node_idx_t> > node_arrays;
 
     // CONSTRUCTS a2ns
-    for (auto a : kb::arities(*m_pt_iter))
+    for (auto a : kb::arities(pattern))
     if (a2ns.count(a) == 0)
     {
         auto found = m_graph->search_nodes_with_arity(a);
-        if (found != NULL)
-            a2ns.insert(std::make_pair(a, *found));
+        if (not found.empty())
+            a2ns.insert(std::make_pair(a, hash_set<node_idx_t>(found.begin(), found.end())));
     }
 
     // EXPANDS a2ns WITH SOFT-UNIFIABLE NODES
-    for (auto i : kb::soft_unifiable_literal_indices(*m_pt_iter))
+    for (auto i : kb::soft_unifiable_literal_indices(pattern))
     {
-        kb::arity_id_t a = kb::arities(*m_pt_iter).at(i);
+        kb::arity_id_t a = kb::arities(pattern).at(i);
         hash_set<node_idx_t> ns;
 
-        m_graph->enumerate_nodes_softly_unifiable(kb::kb()->search_arity(a), &ns);
+        m_graph->enumerate_nodes_softly_unifiable(a, &ns);
         if (not ns.empty())
             a2ns[a].insert(ns.begin(), ns.end());
     }
@@ -258,22 +274,22 @@ void proof_graph_t::chain_candidate_generator_t::enumerate()
     // IF THERE IS A SLOT WHICH CANNOT BE FILLED, THEN ABORT.
     {
         hash_set<kb::arity_id_t> arity_set(
-            kb::arities(*m_pt_iter).begin(),
-            kb::arities(*m_pt_iter).end());
+            kb::arities(pattern).begin(),
+            kb::arities(pattern).end());
         if (a2ns.size() < arity_set.size()) return;
     }
 
     // CONSTRUCTS hard_term_satisfiers,
     // WHICH IS LISTS OF NODE-PAIR WHICH CAN SATISFY HARD-TERM CONSTRAINTS.
     hash_map<index_t, hash_map<index_t, std::pair<term_idx_t, term_idx_t>>> hard_terms;
-    for (auto p : kb::hard_terms(*m_pt_iter))
+    for (auto p : kb::hard_terms(pattern))
         hard_terms[p.second.first][p.first.first] =
             std::make_pair(p.second.second, p.first.second);
 
     hash_set<index_t> slots_pivot;
-    for (index_t i = 0; i < kb::arities(*m_pt_iter).size(); ++i)
+    for (index_t i = 0; i < kb::arities(pattern).size(); ++i)
     {
-        kb::arity_id_t id1 = kb::arities(*m_pt_iter).at(i);
+        kb::arity_id_t id1 = kb::arities(pattern).at(i);
         kb::arity_id_t id2 = m_graph->node(m_pivot).arity_id();
 
         if (id1 == id2)
@@ -315,7 +331,7 @@ void proof_graph_t::chain_candidate_generator_t::enumerate()
 
             if (not do_violate_hard_term(nodes, i))
             {
-                if (i < kb::arities(*m_pt_iter).size() - 1)
+                if (i < kb::arities(pattern).size() - 1)
                     routine_recursive(nodes, i + 1, i_pivot);
                 else
                     m_targets.push_back(*nodes);
@@ -324,7 +340,7 @@ void proof_graph_t::chain_candidate_generator_t::enumerate()
         else
         {
             const hash_set<node_idx_t> &ns =
-                a2ns.at(kb::arities(*m_pt_iter).at(i));
+                a2ns.at(kb::arities(pattern).at(i));
 
             for (auto n : ns)
             {
@@ -332,7 +348,7 @@ void proof_graph_t::chain_candidate_generator_t::enumerate()
 
                 if (not do_violate_hard_term(nodes, i))
                 {
-                    if (i < kb::arities(*m_pt_iter).size() - 1)
+                    if (i < kb::arities(pattern).size() - 1)
                         routine_recursive(nodes, i + 1, i_pivot);
                     else
                         m_targets.push_back(*nodes);
@@ -341,13 +357,13 @@ void proof_graph_t::chain_candidate_generator_t::enumerate()
         }
     };
 
-    std::vector<node_idx_t> nodes(kb::arities(*m_pt_iter).size(), -1);
+    std::vector<node_idx_t> nodes(kb::arities(pattern).size(), -1);
 
     for (auto i_pivot : slots_pivot)
         routine_recursive(&nodes, 0, i_pivot);
 
     if (not m_targets.empty())
-        kb::kb()->search_axioms_with_arity_pattern(*m_pt_iter, &m_axioms);
+        m_axioms = kb::kb()->search_axioms_with_arity_pattern(*m_pt_iter);
 }
 
 
@@ -362,68 +378,12 @@ void proof_graph_t::loop_detector_t::construct()
 }
 
 
-void proof_graph_t::unifiable_variable_clusters_set_t::add(
-    term_t t1, term_t t2 )
-{
-    m_variables.insert(t1);
-    m_variables.insert(t2);
-
-    hash_map<term_t, index_t>::iterator iter_c1 = m_map_v2c.find(t1);
-    hash_map<term_t, index_t>::iterator iter_c2 = m_map_v2c.find(t2);
-    bool has_found_t1(iter_c1 != m_map_v2c.end());
-    bool has_found_t2(iter_c2 != m_map_v2c.end());
-
-    if (not has_found_t1  and not has_found_t2)
-    {
-        m_idx_new_cluster++;
-        m_clusters[m_idx_new_cluster].insert(t1);
-        m_clusters[m_idx_new_cluster].insert(t2);
-        m_map_v2c[t1] = m_idx_new_cluster;
-        m_map_v2c[t2] = m_idx_new_cluster;
-    }
-    else if (has_found_t1 and has_found_t2)
-    {
-        // MERGE CLUSTERS OF t1 AND t2
-        if (iter_c1->second != iter_c2->second)
-        {
-            hash_set<term_t>& c1 = m_clusters[iter_c1->second];
-            hash_set<term_t>& c2 = m_clusters[iter_c2->second];
-
-            for (auto it = c2.begin(); it != c2.end(); ++it)
-                m_map_v2c[*it] = iter_c1->second;
-
-            c1.insert(c2.begin(), c2.end());
-            c2.clear();
-        }
-    }
-    else if (has_found_t1 and not has_found_t2)
-    {
-        m_clusters[iter_c1->second].insert(t2);
-        m_map_v2c[t2] = iter_c1->second;
-    }
-    else if (not has_found_t1 and has_found_t2)
-    {
-        m_clusters[iter_c2->second].insert(t1);
-        m_map_v2c[t1] = iter_c2->second;
-    }
-}
-
-
 void proof_graph_t::unifiable_variable_clusters_set_t::merge(
     const unifiable_variable_clusters_set_t &vc)
 {
-    int padding(0);
-    for (auto it = m_clusters.begin(); it != m_clusters.end(); ++it)
-        padding = (padding > it->first) ? it->first : padding;
-
-    m_variables.insert(vc.m_variables.begin(), vc.m_variables.end());
-
-    for (auto it = vc.m_clusters.begin(); it != vc.m_clusters.end(); ++it)
-        m_clusters[it->first + padding].insert(
-        it->second.begin(), it->second.end());
-
-    for (auto it = vc.m_map_v2c.begin(); it != vc.m_map_v2c.end(); ++it)
-        m_map_v2c[it->first] = (it->second + padding);
+    for (const auto &cluster : vc.clusters())
+    for (const auto &t : cluster)
+        m_terms.unite(cluster.front(), t);
 }
 
 
@@ -444,20 +404,6 @@ proof_graph_t::proof_graph_t(phillip_main_t *main, const std::string &name)
 }
 
 
-std::list< const hash_set<term_t>* >
-    proof_graph_t::enumerate_variable_clusters() const
-{
-    std::list< const hash_set<term_t>* > out;
-    const hash_map<index_t, hash_set<term_t> >
-        &clusters = m_vc_unifiable.clusters();
-
-    for (auto it = clusters.begin(); it != clusters.end(); ++it)
-        out.push_back(&it->second);
-
-    return out;
-}
-
-
 hash_set<edge_idx_t> proof_graph_t::enumerate_dependent_edges(node_idx_t idx) const
 {
     hash_set<edge_idx_t> out;
@@ -676,12 +622,15 @@ std::string proof_graph_t::edge_to_string( edge_idx_t i ) const
 
 
 void proof_graph_t::enumerate_nodes_softly_unifiable(
-const arity_t &arity, hash_set<node_idx_t> *out) const
+kb::arity_id_t arity_id, hash_set<node_idx_t> *out) const
 {
-    const hash_set<node_idx_t> *ns1 = search_nodes_with_arity(arity);
-    if (ns1 != NULL)
-        out->insert(ns1->begin(), ns1->end());
+    if (arity_id == kb::INVALID_ARITY_ID) return;
 
+    node_span_t ns1 = search_nodes_with_arity(arity_id);
+    out->insert(ns1.begin(), ns1.end());
+
+    // THE CATEGORY TABLE IS KEYED BY STRINGS OF ARITIES.
+    const arity_t &arity = kb::kb()->search_arity(arity_id);
     if (kb::kb()->category_table()->do_target(arity))
     {
         for (auto p1 : m_maps.predicate_to_nodes)
@@ -704,12 +653,10 @@ hash_set<node_idx_t>
     proof_graph_t::enumerate_nodes_with_literal( const literal_t &lit ) const
 {
     hash_set<node_idx_t> out;
-    const hash_set<node_idx_t> *pa_list =
+    node_span_t pa_list =
         search_nodes_with_predicate( lit.predicate, lit.terms.size() );
 
-    if (pa_list == NULL) return out;
-
-    for (auto it = pa_list->begin(); it != pa_list->end(); ++it)
+    for (auto it = pa_list.begin(); it != pa_list.end(); ++it)
     {
         if (m_nodes.at(*it).literal() == lit)
             out.insert(*it);
@@ -724,12 +671,10 @@ hash_set<edge_idx_t> proof_graph_t::enumerate_edges_with_node(node_idx_t idx) co
     hash_set<edge_idx_t> out;
 
     auto edges_head = search_edges_with_node_in_head(idx);
-    if (edges_head != NULL)
-        out.insert(edges_head->begin(), edges_head->end());
+    out.insert(edges_head.begin(), edges_head.end());
 
     auto edges_tail = search_edges_with_node_in_tail(idx);
-    if (edges_tail != NULL)
-        out.insert(edges_tail->begin(), edges_tail->end());
+    out.insert(edges_tail.begin(), edges_tail.end());
 
     return out;
 }
@@ -737,15 +682,10 @@ hash_set<edge_idx_t> proof_graph_t::enumerate_edges_with_node(node_idx_t idx) co
 
 edge_idx_t proof_graph_t::find_parental_edge(hypernode_idx_t idx) const
 {
-    const hash_set<edge_idx_t> *_edges = search_edges_with_hypernode(idx);
-
-    if (_edges != NULL)
+    for (auto e : search_edges_with_hypernode(idx))
     {
-        for (auto e = _edges->begin(); e != _edges->end(); ++e)
-        {
-            const edge_t &ed = edge(*e);
-            if (ed.head() == idx) return *e;
-        }
+        const edge_t &ed = edge(e);
+        if (ed.head() == idx) return e;
     }
 
     return -1;
@@ -754,10 +694,9 @@ edge_idx_t proof_graph_t::find_parental_edge(hypernode_idx_t idx) const
 
 void proof_graph_t::enumerate_parental_edges(hypernode_idx_t idx, hash_set<edge_idx_t> *out) const
 {
-    const hash_set<edge_idx_t> *_edges = search_edges_with_hypernode(idx);
-    if( _edges == NULL ) return;
+    edge_span_t _edges = search_edges_with_hypernode(idx);
 
-    for (auto it = _edges->begin(); it != _edges->end(); ++it)
+    for (auto it = _edges.begin(); it != _edges.end(); ++it)
     {
         if (edge(*it).head() == idx)
             out->insert(*it);
@@ -768,10 +707,9 @@ void proof_graph_t::enumerate_parental_edges(hypernode_idx_t idx, hash_set<edge_
 void proof_graph_t::enumerate_children_edges(
     hypernode_idx_t idx, hash_set<edge_idx_t> *out) const
 {
-    const hash_set<edge_idx_t> *_edges = search_edges_with_hypernode(idx);
-    if( _edges == NULL ) return;
+    edge_span_t _edges = search_edges_with_hypernode(idx);
 
-    for (auto it = _edges->begin(); it != _edges->end(); ++it)
+    for (auto it = _edges.begin(); it != _edges.end(); ++it)
     {
         if (edge(*it).tail() == idx)
             out->insert(*it);
@@ -782,10 +720,9 @@ void proof_graph_t::enumerate_children_edges(
 void proof_graph_t::enumerate_children_hypernodes(
     hypernode_idx_t idx, hash_set<hypernode_idx_t> *out) const
 {
-    const hash_set<edge_idx_t> *_edges = search_edges_with_hypernode(idx);
-    if (_edges == NULL) return;
+    edge_span_t _edges = search_edges_with_hypernode(idx);
 
-    for (auto it = _edges->begin(); it != _edges->end(); ++it)
+    for (auto it = _edges.begin(); it != _edges.end(); ++it)
     {
         const edge_t &e = edge(*it);
         if (e.tail() == idx and e.head() >= 0)
@@ -802,10 +739,9 @@ void proof_graph_t::enumerate_descendant_nodes(
 
     f = [this, &f](node_idx_t idx, hash_set<node_idx_t> *out, hash_set<hypernode_idx_t> *checked)
     {
-        const hash_set<hypernode_idx_t> *hns = this->search_hypernodes_with_node(idx);
+        hypernode_span_t hns = this->search_hypernodes_with_node(idx);
 
-        if (hns != NULL)
-        for (auto hn = hns->begin(); hn != hns->end(); ++hn)
+        for (auto hn = hns.begin(); hn != hns.end(); ++hn)
         {
             hash_set<hypernode_idx_t> children;
             this->enumerate_children_hypernodes(*hn, &children);
@@ -830,10 +766,9 @@ void proof_graph_t::enumerate_descendant_nodes(
 void proof_graph_t::enumerate_parental_hypernodes(
     hypernode_idx_t idx, hash_set<hypernode_idx_t> *out) const
 {
-    const hash_set<edge_idx_t> *_edges = search_edges_with_hypernode(idx);
-    if (_edges == NULL) return;
+    edge_span_t _edges = search_edges_with_hypernode(idx);
 
-    for (auto it = _edges->begin(); it != _edges->end(); ++it)
+    for (auto it = _edges.begin(); it != _edges.end(); ++it)
     {
         const edge_t &e = edge(*it);
         if (e.head() == idx)
@@ -849,8 +784,7 @@ void proof_graph_t::enumerate_overlapping_hypernodes(
     for (auto n = ns.begin(); n != ns.end(); ++n)
     {
         auto hns = search_hypernodes_with_node(*n);
-        if (hns != NULL)
-            out->insert(hns->begin(), hns->end());
+        out->insert(hns.begin(), hns.end());
     }
     out->insert(idx);
 }
@@ -859,14 +793,10 @@ void proof_graph_t::enumerate_overlapping_hypernodes(
 hypernode_idx_t proof_graph_t::find_hypernode_with_ordered_nodes(
     const std::vector<node_idx_t> &indices ) const
 {
-    const hash_set<hypernode_idx_t> *hypernodes
-        = search_hypernodes_with_node(indices.at(0));
-    if (hypernodes != NULL)
-    {
-        for (auto hn = hypernodes->begin(); hn != hypernodes->end(); ++hn)
-        if (indices == hypernode(*hn))
-            return *hn;
-    }
+    for (auto hn : search_hypernodes_with_node(indices.at(0)))
+    if (indices == hypernode(hn))
+        return hn;
+
     return -1;
 }
 
@@ -913,8 +843,8 @@ edge_idx_t proof_graph_t::find_unifying_edge(node_idx_t i, node_idx_t j) const
         if (hn < 0) return -1;
     }
 
-    const hash_set<edge_idx_t> *es = search_edges_with_hypernode(hn);
-    for (auto it = es->begin(); it != es->end(); ++it)
+    edge_span_t es = search_edges_with_hypernode(hn);
+    for (auto it = es.begin(); it != es.end(); ++it)
     {
         const edge_t &e = edge(*it);
         if (e.type() == EDGE_UNIFICATION and e.tail() == hn)
@@ -928,7 +858,7 @@ edge_idx_t proof_graph_t::find_unifying_edge(node_idx_t i, node_idx_t j) const
 bool proof_graph_t::axiom_has_applied(
     hypernode_idx_t hn, const lf::axiom_t &ax, bool is_backward ) const
 {
-    const hash_map< axiom_id_t, hash_set<hypernode_idx_t> >
+    const hash_map< axiom_id_t, util::flat_set_t<hypernode_idx_t> >
         &map = is_backward ?
         m_maps.axiom_to_hypernodes_backward :
         m_maps.axiom_to_hypernodes_forward;
@@ -996,12 +926,12 @@ void proof_graph_t::print_axioms(std::ostream *os) const
     (*os) << "<axioms num=\"" << list_axioms.size() << "\">" << std::endl;
     for (auto ax = list_axioms.begin(); ax != list_axioms.end(); ++ax)
     {
-        lf::axiom_t axiom = kb::knowledge_base_t::instance()->get_axiom(*ax);
+        auto axiom = kb::knowledge_base_t::instance()->get_axiom(*ax);
         (*os)
             << "<axiom "
-            << "id=\"" << axiom.id
-            << "\" name=\"" << axiom.name
-            << "\">" << axiom.func.to_string()
+            << "id=\"" << axiom->id
+            << "\" name=\"" << axiom->name
+            << "\">" << axiom->func.to_string()
             << "</axiom>" << std::endl;
     }
     (*os) << "</axioms>" << std::endl;
@@ -1063,12 +993,13 @@ void proof_graph_t::print_edges(std::ostream *os) const
 void proof_graph_t::print_subs(std::ostream *os) const
 {
     auto subs = m_vc_unifiable.clusters();
+    int id(0);
     (*os) << "<substitutions>" << std::endl;
 
     for (auto it = subs.begin(); it != subs.end(); ++it)
     {
-        (*os) << "<cluster id=\"" << it->first << "\">" << std::endl;
-        for (auto t = it->second.begin(); t != it->second.end(); ++t)
+        (*os) << "<cluster id=\"" << (++id) << "\">" << std::endl;
+        for (auto t = it->begin(); t != it->end(); ++t)
             (*os) << "<term>" << t->string() << "</term>" << std::endl;
         (*os) << "</cluster>" << std::endl;
     }
@@ -1079,26 +1010,21 @@ void proof_graph_t::print_subs(std::ostream *os) const
 
 void proof_graph_t::print_mutual_exclusive_nodes(std::ostream *os) const
 {
-    const hash_map<node_idx_t, hash_map<node_idx_t, unifier_t> >
+    const util::triangular_matrix_t<node_idx_t, unifier_t>
         &muexs = m_mutual_exclusive_nodes;
-    int num(0);
-
-    for (auto it = muexs.begin(); it != muexs.end(); ++it)
-        num += it->second.size();
 
     (*os) << "<mutual_exclusive_nodes num=\""
-          << num << "\">" << std::endl;
+          << muexs.size() << "\">" << std::endl;
 
-    for (auto it1 = muexs.begin(); it1 != muexs.end(); ++it1)
-    for (auto it2 = it1->second.begin(); it2 != it1->second.end(); ++it2)
+    for (auto it = muexs.begin(); it != muexs.end(); ++it)
     {
-        const node_t &n1 = node(it1->first);
-        const node_t &n2 = node(it2->first);
+        const node_t &n1 = node(it->first);
+        const node_t &n2 = node(it->second);
 
         (*os)
             << "<xor node1=\"" << n1.index()
             << "\" node2=\"" << n2.index()
-            << "\" subs=\"" << it2->second.to_string() << "\">"
+            << "\" subs=\"" << it->value.to_string() << "\">"
             << n1.literal().to_string() << " _|_ "
             << n2.literal().to_string() << "</xor>" << std::endl;
     }
@@ -1131,7 +1057,20 @@ node_idx_t proof_graph_t::add_node(
     const literal_t &lit, node_type_e type, int depth,
     const hash_set<node_idx_t> &parents)
 {
-    node_t add(this, lit, type, m_nodes.size(), depth, parents);
+    // THE EMPTY ANCESTRY IS SHARED AMONG ALL GRAPHS.
+    static const std::shared_ptr<const node_t::ancestry_t> empty(
+        std::make_shared<const node_t::ancestry_t>());
+
+    return add_node(lit, type, depth, parents.empty() ?
+        empty : std::make_shared<const node_t::ancestry_t>(this, parents));
+}
+
+
+node_idx_t proof_graph_t::add_node(
+    const literal_t &lit, node_type_e type, int depth,
+    const std::shared_ptr<const node_t::ancestry_t> &ancestry)
+{
+    node_t add(lit, type, m_nodes.size(), depth, ancestry);
     int n = static_cast<int>(lit.terms.size());
     node_idx_t out = m_nodes.size();
 
@@ -1187,15 +1126,15 @@ edge_idx_t proof_graph_t::add_edge(const edge_t &edge)
 {
     edge_idx_t idx = m_edges.size();
 
-    m_maps.hypernode_to_edge[edge.head()].insert(idx);
-    m_maps.hypernode_to_edge[edge.tail()].insert(idx);
+    m_maps.hypernode_to_edge.insert(edge.head(), idx);
+    m_maps.hypernode_to_edge.insert(edge.tail(), idx);
 
     if (edge.head() >= 0)
     for (auto n_idx : hypernode(edge.head()))
-        m_maps.head_node_to_edges[n_idx].insert(idx);
+        m_maps.head_node_to_edges.insert(n_idx, idx);
 
     for (auto n_idx : hypernode(edge.tail()))
-        m_maps.tail_node_to_edges[n_idx].insert(idx);
+        m_maps.tail_node_to_edges.insert(n_idx, idx);
 
     m_edges.push_back(edge);
     return idx;
@@ -1392,10 +1331,7 @@ hypernode_idx_t proof_graph_t::chain(
             if (axiom.func.is_operator(lf::OPR_PARAPHRASE))
             for (auto idx : from)
             {
-                auto _edges = search_edges_with_node_in_head(idx);
-                if (_edges == NULL) continue;
-
-                for (auto e_idx : (*_edges))
+                for (auto e_idx : search_edges_with_node_in_head(idx))
                 if (edge(e_idx).axiom_id() == axiom.id)
                     return false;
             }
@@ -1464,7 +1400,7 @@ hypernode_idx_t proof_graph_t::chain(
         {
             enumerate_dependent_edges(*it_n, &dep_edges);
 
-            const hash_set<node_idx_t> &rels = node(*it_n).relatives();
+            const util::sparse_bitset_t &rels = node(*it_n).relatives();
             evidences.insert(rels.begin(), rels.end());
         }
 
@@ -1483,7 +1419,7 @@ hypernode_idx_t proof_graph_t::chain(
         for (auto it_n = evidences.begin(); it_n != evidences.end(); ++it_n)
         if (node(*it_n).is_equality_node())
         {
-            const std::vector<term_t> &terms = node(*it_n).literal().terms;
+            const literal_t::term_array_t &terms = node(*it_n).literal().terms;
             eqs.insert(std::make_pair(terms.at(0), terms.at(1)));
         }
 
@@ -1554,16 +1490,12 @@ hypernode_idx_t proof_graph_t::chain(
     hypernode_idx_t idx_hn_from = add_hypernode(from);
     std::vector<node_idx_t> hn_to(added.size(), -1);
 
-    hash_set<node_idx_t> parents(from.begin(), from.end());
+    auto ancestry = std::make_shared<const node_t::ancestry_t>(
+        this, hash_set<node_idx_t>(from.begin(), from.end()));
     for (size_t i = 0; i < added.size(); ++i)
     {
-        hash_set<node_idx_t> _ev;
-        for (size_t j = 0; j < added.size(); ++j)
-        if (j != i)
-            _ev.insert(hn_to.at(j));
-
         int d = added[i].is_equality() ? -1 : depth + 1;
-        hn_to[i] = add_node(added[i], NODE_HYPOTHESIS, d, parents);
+        hn_to[i] = add_node(added[i], NODE_HYPOTHESIS, d, ancestry);
     }
     hypernode_idx_t idx_hn_to = add_hypernode(hn_to);
 
@@ -1609,7 +1541,7 @@ hypernode_idx_t proof_graph_t::chain(
         print_for_debug(axiom, is_backward, idx_hn_from, idx_hn_to);
 
     /* ADD AXIOM HISTORY */
-    hash_map<axiom_id_t, hash_set<hypernode_idx_t> > &ax2hn = is_backward ?
+    hash_map<axiom_id_t, util::flat_set_t<hypernode_idx_t> > &ax2hn = is_backward ?
         m_maps.axiom_to_hypernodes_backward : m_maps.axiom_to_hypernodes_forward;
     ax2hn[axiom.id].insert(idx_hn_from);
 
@@ -1659,13 +1591,13 @@ std::list<std::pair<arity_t, arity_t> > proof_graph_t::get_gaps_on_edge(edge_idx
 
     if (e.is_chain_edge())
     {
-        lf::axiom_t ax = kb::knowledge_base_t::instance()->get_axiom(e.axiom_id());
+        auto ax = kb::knowledge_base_t::instance()->get_axiom(e.axiom_id());
         std::vector<const lf::logical_function_t*> branches_tail;
 
         if (e.type() == EDGE_IMPLICATION)
-            ax.func.branch(0).enumerate_literal_branches(&branches_tail);
+            ax->func.branch(0).enumerate_literal_branches(&branches_tail);
         else if (e.type() == EDGE_HYPOTHESIZE)
-            ax.func.branch(1).enumerate_literal_branches(&branches_tail);
+            ax->func.branch(1).enumerate_literal_branches(&branches_tail);
 
         for (index_t i = 0; i < branches_tail.size(); ++i)
         {
@@ -1690,13 +1622,12 @@ std::list<std::pair<arity_t, arity_t> > proof_graph_t::get_gaps_on_edge(edge_idx
 std::list<std::tuple<node_idx_t, node_idx_t, unifier_t> >
 proof_graph_t::enumerate_mutual_exclusive_nodes() const
 {
-    const hash_map<node_idx_t, hash_map<node_idx_t, unifier_t> >
+    const util::triangular_matrix_t<node_idx_t, unifier_t>
         &muexs = m_mutual_exclusive_nodes;
     std::list<std::tuple<node_idx_t, node_idx_t, unifier_t> > out;
 
-    for (auto it1 = muexs.begin(); it1 != muexs.end(); ++it1)
-    for (auto it2 = it1->second.begin(); it2 != it1->second.end(); ++it2)
-        out.push_back(std::make_tuple(it1->first, it2->first, it2->second));
+    for (auto it = muexs.begin(); it != muexs.end(); ++it)
+        out.push_back(std::make_tuple(it->first, it->second, it->value));
 
     return out;
 }
@@ -1748,7 +1679,7 @@ void proof_graph_t::_generate_mutual_exclusions(
         node_idx_t
             n1((target >= idx2) ? idx2 : target),
             n2((target >= idx2) ? target : idx2);
-        m_mutual_exclusive_nodes[n1][n2] = uni;
+        m_mutual_exclusive_nodes.assign(n1, n2, uni);
     }
 }
 
@@ -1825,7 +1756,14 @@ void proof_graph_t::_generate_unification_assumptions(node_idx_t target)
         std::list<node_idx_t> unifiables;
         unifier_t unifier;
 
-        enumerate_nodes_softly_unifiable(lit.get_arity(), &candidates);
+        if (node(target).arity_id() != kb::INVALID_ARITY_ID)
+            enumerate_nodes_softly_unifiable(node(target).arity_id(), &candidates);
+        else
+        {
+            // THE ARITY IS UNKNOWN TO THE KB, SO LOOK FOR THE SAME PREDICATE.
+            node_span_t ns = search_nodes_with_predicate(lit.predicate, lit.terms.size());
+            candidates.insert(ns.begin(), ns.end());
+        }
 
         for (auto n : candidates)
         {
@@ -1893,10 +1831,10 @@ void proof_graph_t::_chain_for_unification(node_idx_t i, node_idx_t j)
 {
     auto add_nodes_of_transitive_unification = [this](term_t t)
     {
-        const hash_set<term_t> *terms = m_vc_unifiable.find_cluster(t);
-        assert(terms != NULL);
+        const std::vector<term_t> terms = m_vc_unifiable.find_cluster(t);
+        assert(not terms.empty());
 
-        for (auto it = terms->begin(); it != terms->end(); ++it)
+        for (auto it = terms.begin(); it != terms.end(); ++it)
         {
             if (t == (*it)) continue;
             if (t.is_constant() and it->is_constant()) continue;
@@ -1930,7 +1868,8 @@ void proof_graph_t::_chain_for_unification(node_idx_t i, node_idx_t j)
 
     /* CREATE UNIFICATION-NODES & UPDATE VARIABLES. */
     const std::set<literal_t> &subs = uni.substitutions();
-    hash_set<node_idx_t> parents(unified_nodes.begin(), unified_nodes.end());
+    auto ancestry = std::make_shared<const node_t::ancestry_t>(
+        this, hash_set<node_idx_t>(unified_nodes.begin(), unified_nodes.end()));
 
     for (auto sub = subs.begin(); sub != subs.end(); ++sub)
     {
@@ -1941,7 +1880,7 @@ void proof_graph_t::_chain_for_unification(node_idx_t i, node_idx_t j)
         if (sub_node_idx < 0)
         {
             if (t1 > t2) std::swap(t1, t2);
-            sub_node_idx = add_node(*sub, NODE_HYPOTHESIS, -1, parents);
+            sub_node_idx = add_node(*sub, NODE_HYPOTHESIS, -1, ancestry);
 
             m_maps.terms_to_sub_node.insert(t1, t2, sub_node_idx);
             m_vc_unifiable.add(t1, t2);
@@ -1994,15 +1933,22 @@ bool proof_graph_t::check_unifiability(
 }
 
 
-std::mutex g_mutex_hasher;
+void proof_graph_t::unordered_hypernode_table_t::rehash(size_t capacity)
+{
+    slot_t empty = { 0, -1 };
+    std::vector<slot_t> slots(capacity, empty);
+    size_t mask = capacity - 1;
 
+    for (const auto &s : m_slots)
+    if (s.group >= 0)
+    {
+        size_t i = s.hash & mask;
+        while (slots[i].group >= 0)
+            i = (i + 1) & mask;
+        slots[i] = s;
+    }
 
-size_t proof_graph_t::get_hash_of_nodes(std::list<node_idx_t> nodes)
-{
-    static std::hash<std::string> hasher;
-    std::lock_guard<std::mutex> lock(g_mutex_hasher);
-    nodes.sort();
-    return hasher(util::join(nodes.begin(), nodes.end(), ","));
+    m_slots.swap(slots);
 }
 
 
@@ -2015,57 +1961,49 @@ void proof_graph_t::post_process()
         {
             do_break = true;
 
-            for (auto it1 = m_temporal.postponed_unifications.begin();
-                it1 != m_temporal.postponed_unifications.end();)
+            // ERASING AN ENTRY MOVES THE LAST ONE TO ITS PLACE,
+            // SO ENTRIES ARE VISITED FROM THE BACK.
+            for (size_t i = m_temporal.postponed_unifications.size(); i > 0; --i)
             {
-                for (auto it2 = it1->second.begin(); it2 != it1->second.end();)
+                auto it = m_temporal.postponed_unifications.begin() + (i - 1);
+                const node_idx_t n1(it->first), n2(it->second);
+                const kb::unification_postponement_t *pp =
+                    kb::knowledge_base_t::instance()
+                    ->find_unification_postponement(node(n1).arity());
+                assert(pp != NULL);
+
+                if (not pp->do_postpone(this, n1, n2))
                 {
-                    const node_idx_t n1(it1->first), n2(*it2);
-                    const kb::unification_postponement_t *pp =
-                        kb::knowledge_base_t::instance()
-                        ->find_unification_postponement(node(n1).arity());
-                    assert(pp != NULL);
-
-                    if (not pp->do_postpone(this, n1, n2))
-                    {
-                        _chain_for_unification(n1, n2);
-                        do_break = false;
-                        it2 = it1->second.erase(it2);
-                    }
-                    else
-                        ++it2;
+                    m_temporal.postponed_unifications.erase(n1, n2);
+                    _chain_for_unification(n1, n2);
+                    do_break = false;
                 }
-
-                if (it1->second.empty())
-                    it1 = m_temporal.postponed_unifications.erase(it1);
-                else
-                    ++it1;
             }
         }
     }
 
     IF_VERBOSE_3("Generating mutual exclusions among transitive equalities...");
     {
-        for (auto terms : m_vc_unifiable.clusters())
+        for (const auto &terms : m_vc_unifiable.clusters())
         {
             std::set<std::pair<term_t, term_t> > muex_terms;
 
-            for (auto t1 : terms.second)
+            for (auto t1 : terms)
             if (t1.is_constant())
             {
-                for (auto t2 : terms.second)
+                for (auto t2 : terms)
                 if (t2.is_constant())
                     muex_terms.insert(util::make_sorted_pair(t1, t2));
             }
 
             for (auto ts : muex_terms)
-            for (auto t : terms.second)
+            for (auto t : terms)
             if (t != ts.first and t != ts.second)
             {
                 std::pair<node_idx_t, node_idx_t> ns = util::make_sorted_pair(
                     find_sub_node(ts.first, t), find_sub_node(ts.second, t));
                 if (ns.first >= 0 and ns.second >= 0 and ns.first != ns.second)
-                    m_mutual_exclusive_nodes[ns.first][ns.second] = unifier_t();
+                    m_mutual_exclusive_nodes.assign(ns.first, ns.second, unifier_t());
             }
         }
     }
@@ -2122,11 +2060,12 @@ hypernode_idx_t proof_graph_t::add_hypernode(
         m_hypernodes.push_back(indices);
         idx = m_hypernodes.size() - 1;
         for( auto it=indices.begin(); it!=indices.end(); ++it )
-            m_maps.node_to_hypernode[*it].insert(idx);
+            m_maps.node_to_hypernode.insert(*it, idx);
 
-        size_t h = get_hash_of_nodes(
-            std::list<node_idx_t>(indices.begin(), indices.end()));
-        m_maps.unordered_nodes_to_hypernode[h].insert(idx);
+        m_maps.unordered_nodes_to_hypernode.insert(
+            get_hash_of_nodes(indices.begin(), indices.end()), idx,
+            [this, &indices](hypernode_idx_t hn)
+        { return _has_same_unordered_nodes(hn, indices.begin(), indices.end()); });
     }
 
     return idx;
@@ -2137,12 +2076,10 @@ void proof_graph_t::_enumerate_mutual_exclusion_for_counter_nodes(
     const literal_t &target,
     std::list<std::tuple<node_idx_t, unifier_t> > *out) const
 {
-    const hash_set<node_idx_t>* indices =
+    node_span_t indices =
         search_nodes_with_predicate(target.predicate, target.terms.size());
 
-    if (indices == NULL) return;
-
-    for (auto it = indices->begin(); it != indices->end(); ++it)
+    for (auto it = indices.begin(); it != indices.end(); ++it)
     {
         const literal_t &l2 = node(*it).literal();
 
@@ -2213,17 +2150,16 @@ void proof_graph_t::_generate_mutual_exclusion_for_edges(
         [this](node_idx_t from, std::list< std::list<edge_idx_t> > *out)
     {
         const kb::knowledge_base_t *kb = kb::knowledge_base_t::instance();
-        const hash_set<hypernode_idx_t> *hns = this->search_hypernodes_with_node(from);
-        if (hns == NULL) return;
+        hypernode_span_t hns = this->search_hypernodes_with_node(from);
+        if (hns.empty()) return;
 
         // ENUMERATE EDGES CONNECTED WITH GIVEN NODE
         std::list<edge_idx_t> targets;
-        for (auto it = hns->begin(); it != hns->end(); ++it)
+        for (auto it = hns.begin(); it != hns.end(); ++it)
         {
-            const hash_set<edge_idx_t> *_edges = this->search_edges_with_hypernode(*it);
-            if (_edges == NULL) continue;
+            edge_span_t _edges = this->search_edges_with_hypernode(*it);
 
-            for (auto it_e = _edges->begin(); it_e != _edges->end(); ++it_e)
+            for (auto it_e = _edges.begin(); it_e != _edges.end(); ++it_e)
             {
                 const edge_t &e = edge(*it_e);
                 if (e.tail() == (*it) and e.axiom_id() >= 0)
@@ -2266,13 +2202,13 @@ void proof_graph_t::_generate_mutual_exclusion_for_edges(
         [this](hypernode_idx_t from, std::list< std::list<edge_idx_t> > *out)
     {
         const kb::knowledge_base_t *kb = kb::knowledge_base_t::instance();
-        const hash_set<edge_idx_t> *edges = this->search_edges_with_hypernode(from);
-        if (edges == NULL) return;
+        edge_span_t edges = this->search_edges_with_hypernode(from);
+        if (edges.empty()) return;
 
         std::set<util::comparable_list<edge_idx_t> > exclusions;
 
         // CREATE MAP OF EXCLUSIVENESS
-        for (auto it1 = edges->begin(); it1 != edges->end(); ++it1)
+        for (auto it1 = edges.begin(); it1 != edges.end(); ++it1)
         {
             const edge_t &e1 = edge(*it1);
             if (e1.tail() != from or e1.axiom_id() < 0) continue;
@@ -2281,7 +2217,7 @@ void proof_graph_t::_generate_mutual_exclusion_for_edges(
             if (grp.empty()) continue;
 
             util::comparable_list<edge_idx_t> exc;
-            for (auto it2 = edges->begin(); it2 != it1; ++it2)
+            for (auto it2 = edges.begin(); it2 != it1; ++it2)
             {
                 const edge_t &e2 = edge(*it2);
                 if (e2.tail() == from and e2.axiom_id() >= 0)
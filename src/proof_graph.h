@@ -52,15 +52,29 @@ enum node_type_e
 class node_t
 {
 public:
-    /** @param lit     The literal assigned to this.
-     *  @param type    The node type of this.
-     *  @param idx     The index of this in proof_graph_t::m_nodes.
-     *  @param depth   Distance from observations in the proof-graph.
-     *  @param parents Indices of nodes being parents of this node. */
+    /** Parents, ancestors and relatives of a node.
+     *  Since they depend only on the parents,
+     *  nodes made from the same parents share an instance. */
+    struct ancestry_t
+    {
+        /** Makes the empty ancestry of a node without parents,
+         *  which does not depend on any graph. */
+        ancestry_t() {}
+
+        /** @param parents Indices of nodes being parents of the node. */
+        ancestry_t(const proof_graph_t *graph, const hash_set<node_idx_t> &parents);
+
+        util::sparse_bitset_t parents, ancestors, relatives;
+    };
+
+    /** @param lit      The literal assigned to this.
+     *  @param type     The node type of this.
+     *  @param idx      The index of this in proof_graph_t::m_nodes.
+     *  @param depth    Distance from observations in the proof-graph.
+     *  @param ancestry Parents of this node and nodes related to them. */
     node_t(
-        const proof_graph_t *graph,
         const literal_t &lit, node_type_e type, node_idx_t idx,
-        depth_t depth, const hash_set<node_idx_t> &parents);
+        depth_t depth, const std::shared_ptr<const ancestry_t> &ancestry);
 
     inline node_type_e type() const { return m_type; }
     inline const literal_t& literal() const { return m_literal; }
@@ -75,13 +89,15 @@ public:
      *  Unification-nodes have depth of -1. */
     inline depth_t depth() const { return m_depth; }
 
-    inline const hash_set<pg::node_idx_t>& parents() const;
+    inline const util::sparse_bitset_t& parents() const;
 
     /** Returns nodes between this and observations which this explains. */
-    inline const hash_set<pg::node_idx_t>& ancestors() const;
+    inline const util::sparse_bitset_t& ancestors() const;
 
     /** Returns nodes which must be hypothesized to hypothesize this. */
-    inline const hash_set<pg::node_idx_t>& relatives() const;
+    inline const util::sparse_bitset_t& relatives() const;
+
+    inline const std::shared_ptr<const ancestry_t>& ancestry() const { return m_ancestry; }
 
     /** Returns the index of hypernode
      *  which was instantiated for instantiation of this node.
@@ -111,9 +127,7 @@ private:
     depth_t m_depth;
     kb::arity_id_t m_arity_id;
 
-    hash_set<node_idx_t> m_parents;
-    hash_set<node_idx_t> m_ancestors;
-    hash_set<node_idx_t> m_relatives;
+    std::shared_ptr<const ancestry_t> m_ancestry;
 };
 
 
@@ -248,7 +262,7 @@ public:
         bool empty() const { return m_axioms.empty(); }
 
         const std::list<std::vector<node_idx_t> >& targets() const { return m_targets; }
-        const std::list<std::pair<axiom_id_t, bool> >& axioms() const { return m_axioms; }
+        const kb::axiom_direction_span_t& axioms() const { return m_axioms; }
 
     private:
         void enumerate();
@@ -256,11 +270,12 @@ public:
         const proof_graph_t *m_graph;
         node_idx_t m_pivot;
 
-        std::set<kb::arity_pattern_t> m_patterns;
-        std::set<kb::arity_pattern_t>::const_iterator m_pt_iter;
+        /** Sorted ids of arity-patterns related with the pivot. */
+        std::vector<kb::pattern_id_t> m_patterns;
+        std::vector<kb::pattern_id_t>::const_iterator m_pt_iter;
 
         std::list<std::vector<node_idx_t> > m_targets;
-        std::list<std::pair<axiom_id_t, bool> > m_axioms;
+        kb::axiom_direction_span_t m_axioms;
     };
 
     /** A class to detect potential loops in a proof-graph. */
@@ -334,40 +349,34 @@ public:
      *  If not found, return NULL. */
     inline const unifier_t* search_mutual_exclusion_of_node(node_idx_t n1, node_idx_t n2) const;
 
-    /** Return pointer of set of nodes whose literal has given term.
-     *  If any node was found, return NULL. */
-    inline const hash_set<node_idx_t>* search_nodes_with_term(term_t term) const;
+    /** Return nodes whose literal has given term in ascending order.
+     *  The span is valid until a node is added. */
+    inline node_span_t search_nodes_with_term(term_t term) const;
 
-    /** Return pointer of set of nodes whose literal has given predicate.
-     *  If any node was found, return NULL. */
-    inline const hash_set<node_idx_t>* search_nodes_with_predicate(predicate_t predicate, int arity) const;
+    /** Return nodes whose literal has given predicate in ascending order. */
+    inline node_span_t search_nodes_with_predicate(predicate_t predicate, int arity) const;
 
-    /** Return pointer of set of nodes whose literal has given predicate.
-     *  If any node was found, return NULL. */
-    inline const hash_set<node_idx_t>* search_nodes_with_arity(const arity_t &arity) const;
-    inline const hash_set<node_idx_t>* search_nodes_with_arity(kb::arity_id_t arity) const;
+    /** Return nodes whose literal has given predicate in ascending order. */
+    inline node_span_t search_nodes_with_arity(const arity_t &arity) const;
+    inline node_span_t search_nodes_with_arity(kb::arity_id_t arity) const;
 
-    /** Return pointer of set of nodes whose depth is equal to given value.
-     *  If any node was found, return NULL. */
-    inline const hash_set<node_idx_t>* search_nodes_with_depth(depth_t depth) const;
+    /** Return nodes whose depth is equal to given value in ascending order. */
+    inline node_span_t search_nodes_with_depth(depth_t depth) const;
 
     /** Return a set of nodes which is unifiable with a literal of given arity.
      *  The threshold of category-table is given
      *  through the parameter "threshold_soft_unify". */
     void enumerate_nodes_softly_unifiable(
-        const arity_t &arity, hash_set<node_idx_t> *out) const;
+        kb::arity_id_t arity, hash_set<node_idx_t> *out) const;
 
     /** Return set of nodes whose literal is equal to given literal. */
     hash_set<node_idx_t> enumerate_nodes_with_literal(const literal_t &lit) const;
 
-    /** Return the indices of edges connected with given hypernode.
-    *  If any edge was not found, return NULL. */
-    inline const hash_set<edge_idx_t>*
-        search_edges_with_hypernode(hypernode_idx_t idx) const;
-    inline const hash_set<edge_idx_t>*
-        search_edges_with_node_in_tail(node_idx_t idx) const;
-    inline const hash_set<edge_idx_t>*
-        search_edges_with_node_in_head(node_idx_t idx) const;
+    /** Return the indices of edges connected with given hypernode in ascending order.
+     *  The span is valid until an edge is added. */
+    inline edge_span_t search_edges_with_hypernode(hypernode_idx_t idx) const;
+    inline edge_span_t search_edges_with_node_in_tail(node_idx_t idx) const;
+    inline edge_span_t search_edges_with_node_in_head(node_idx_t idx) const;
 
     /** Return the indices of edges which are related with given node. */
     hash_set<edge_idx_t> enumerate_edges_with_node(node_idx_t idx) const;
@@ -393,13 +402,12 @@ public:
 
     void enumerate_overlapping_hypernodes(hypernode_idx_t idx, hash_set<hypernode_idx_t> *out) const;
 
-    /** Return pointer of set of indices of hypernode which has the given node as its element.
-     *  If any set was found, return NULL. */
-    inline const hash_set<hypernode_idx_t>* search_hypernodes_with_node(node_idx_t i) const;
+    /** Return indices of hypernodes which have the given node as its element
+     *  in ascending order. The span is valid until a hypernode is added. */
+    inline hypernode_span_t search_hypernodes_with_node(node_idx_t i) const;
 
-    /** Return the index of first one of hypernodes whose elements are same as given indices.
-     *  If any hypernode was not found, return -1.  */
-    template<class It> const hash_set<hypernode_idx_t>*
+    /** Return indices of hypernodes whose elements are same as given indices. */
+    template<class It> hypernode_span_t
         find_hypernode_with_unordered_nodes(It begin, It end) const;
 
     /** Return the index of hypernode whose elements are same as given indices.
@@ -416,8 +424,9 @@ public:
     /** Returns index of the unifying edge which unifies node i & j. */
     edge_idx_t find_unifying_edge(node_idx_t i, node_idx_t j) const;
 
-    inline const hash_set<term_t>* find_variable_cluster(term_t t) const;
-    std::list< const hash_set<term_t>* > enumerate_variable_clusters() const;
+    /** Returns terms unifiable with t, or an empty vector. */
+    inline std::vector<term_t> find_variable_cluster(term_t t) const;
+    inline std::list< std::vector<term_t> > enumerate_variable_clusters() const;
 
     /** Returns a list of chains which are needed to hypothesize given node. */
     hash_set<edge_idx_t> enumerate_dependent_edges(node_idx_t) const;
@@ -467,31 +476,20 @@ protected:
     class unifiable_variable_clusters_set_t
     {
     public:
-        unifiable_variable_clusters_set_t() : m_idx_new_cluster(0) {}
-
         /** Add unifiability of terms t1 & t2. */
-        void add(term_t t1, term_t t2);
+        inline void add(term_t t1, term_t t2);
 
         void merge(const unifiable_variable_clusters_set_t &vc);
 
-        inline const hash_map<index_t, hash_set<term_t> >& clusters() const;
-        inline const hash_set<term_t>* find_cluster(term_t t) const;
+        /** Returns all clusters in order of their first-added terms. */
+        inline std::list< std::vector<term_t> > clusters() const;
+        inline std::vector<term_t> find_cluster(term_t t) const;
 
         /** Check whether terms t1 & t2 are unifiable. */
         inline bool is_in_same_cluster(term_t t1, term_t t2) const;
 
     private:
-        int m_idx_new_cluster;
-        /** List of clusters.
-         *  We use hash-map for erasure with keeping indices. */
-        hash_map<index_t, hash_set<term_t> > m_clusters;
-
-        /** Mapping from name of a variable
-         *  to the index of cluster which the variable joins. */
-        hash_map<term_t, index_t> m_map_v2c;
-
-        /** All variables included in this cluster-set. */
-        hash_set<term_t> m_variables;
+        util::union_find_t<term_t> m_terms;
     };
 
     /** Get whether it is possible to unify literals p1 and p2.
@@ -502,8 +500,13 @@ protected:
         const literal_t &p1, const literal_t &p2,
         bool do_ignore_truthment, unifier_t *out = NULL);
 
-    /** Return hash of node indices' list. */
-    static size_t get_hash_of_nodes(std::list<node_idx_t> nodes);
+    /** Returns a hash of node indices which does not depend on their order. */
+    template <class It> static size_t get_hash_of_nodes(It begin, It end);
+
+    /** Returns whether given hypernode consists of the same nodes
+     *  as [begin, end), ignoring their order. */
+    template <class It> bool _has_same_unordered_nodes(
+        hypernode_idx_t idx, It begin, It end) const;
 
     /** Adds a new node and updates maps.
      *  Here, mutual-exclusion and unification-assumptions for the new node
@@ -516,6 +519,11 @@ protected:
         const literal_t &lit, node_type_e type, int depth,
         const hash_set<node_idx_t> &parents);
 
+    /** Adds a new node whose ancestry is shared with other nodes. */
+    node_idx_t add_node(
+        const literal_t &lit, node_type_e type, int depth,
+        const std::shared_ptr<const node_t::ancestry_t> &ancestry);
+
     /** Adds a new edge.
      *  @return The index of added new edge. */
     edge_idx_t add_edge(const edge_t &edge);
@@ -628,7 +636,32 @@ protected:
     hash_map<edge_idx_t, std::list< std::pair<term_t, term_t> > > m_subs_of_conditions_for_chain;
     hash_map<edge_idx_t, std::list< std::pair<term_t, term_t> > > m_neqs_of_conditions_for_chain;
 
-    std::hash<std::string> m_hasher_for_nodes;
+    /** An open-addressing table to get hypernodes from unordered nodes.
+     *  Hypernodes which consist of the same nodes in any order
+     *  make a group, and each slot maps the hash of the nodes to a group. */
+    class unordered_hypernode_table_t
+    {
+    public:
+        /** Returns the group of hypernodes whose hash is equal to given one
+         *  and for whose first member is_same returns true. */
+        template <class F> hypernode_span_t find(size_t hash, F is_same) const;
+
+        /** Adds idx to the group found as find() does or to a new group. */
+        template <class F> void insert(size_t hash, hypernode_idx_t idx, F is_same);
+
+    private:
+        struct slot_t
+        {
+            size_t hash;
+            index_t group; /**< Index of the group, or -1 if empty. */
+        };
+
+        template <class F> index_t find_group(size_t hash, F is_same) const;
+        void rehash(size_t capacity);
+
+        std::vector<slot_t> m_slots;
+        std::vector< util::flat_set_t<hypernode_idx_t> > m_groups;
+    };
 
     struct temporal_variables_t
     {
@@ -661,10 +694,10 @@ protected:
         util::triangular_matrix_t<term_t, node_idx_t> terms_to_negsub_node;
 
         /** Map from depth to indices of nodes assigned the depth. */
-        hash_map<depth_t, hash_set<node_idx_t> > depth_to_nodes;
+        hash_map<depth_t, util::flat_set_t<node_idx_t> > depth_to_nodes;
 
         /** Map from axiom-id to hypernodes which have been applied the axiom. */
-        hash_map< axiom_id_t, hash_set<hypernode_idx_t> >
+        hash_map< axiom_id_t, util::flat_set_t<hypernode_idx_t> >
             axiom_to_hypernodes_forward, axiom_to_hypernodes_backward;
 
         /** Map to get node from predicate.
@@ -672,25 +705,25 @@ protected:
          *   - KEY1  : Predicate of the literal.
          *   - KEY2  : Num of terms of the literal.
          *   - VALUE : Indices of nodes which have the corresponding literal. */
-        hash_map<predicate_t, hash_map<int, hash_set<node_idx_t> > >
+        hash_map<predicate_t, hash_map<int, util::flat_set_t<node_idx_t> > >
             predicate_to_nodes;
 
         /** Map to get hypernodes which include given node. */
-        hash_map<node_idx_t, hash_set<hypernode_idx_t> > node_to_hypernode;
+        util::flat_multimap_t<hypernode_idx_t> node_to_hypernode;
 
-        /** Map to get hypernodes from hash of unordered-nodes. */
-        hash_map<size_t, hash_set<hypernode_idx_t> > unordered_nodes_to_hypernode;
+        /** Table to get hypernodes from unordered-nodes. */
+        unordered_hypernode_table_t unordered_nodes_to_hypernode;
 
         /** Map to get edges connecting given node. */
-        hash_map<hypernode_idx_t, hash_set<edge_idx_t> > hypernode_to_edge;
+        util::flat_multimap_t<edge_idx_t> hypernode_to_edge;
 
-        hash_map<node_idx_t, hash_set<edge_idx_t> > tail_node_to_edges, head_node_to_edges;
+        util::flat_multimap_t<edge_idx_t> tail_node_to_edges, head_node_to_edges;
 
         /** Map to get nodes which have given term. */
-        hash_map<term_t, hash_set<node_idx_t> > term_to_nodes;
+        hash_map<term_t, util::flat_set_t<node_idx_t> > term_to_nodes;
 
-        hash_map<kb::arity_id_t, hash_set<node_idx_t> > arity_to_nodes;
-        hash_map<kb::arity_id_t, hash_set<node_idx_t> > arity_wc_to_nodes;
+        hash_map<kb::arity_id_t, util::flat_set_t<node_idx_t> > arity_to_nodes;
+        hash_map<kb::arity_id_t, util::flat_set_t<node_idx_t> > arity_wc_to_nodes;
     } m_maps;
 };
 
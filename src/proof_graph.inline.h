@@ -15,21 +15,21 @@ namespace pg
 
 
 
-inline const hash_set<pg::node_idx_t>& node_t::parents() const
+inline const util::sparse_bitset_t& node_t::parents() const
 {
-    return m_parents;
+    return m_ancestry->parents;
 }
 
 
-inline const hash_set<pg::node_idx_t>& node_t::ancestors() const
+inline const util::sparse_bitset_t& node_t::ancestors() const
 {
-    return m_ancestors;
+    return m_ancestry->ancestors;
 }
 
 
-inline const hash_set<pg::node_idx_t>& node_t::relatives() const
+inline const util::sparse_bitset_t& node_t::relatives() const
 {
-    return m_relatives;
+    return m_ancestry->relatives;
 }
 
 
@@ -47,13 +47,13 @@ inline hypernode_idx_t node_t::master_hypernode() const
 
 inline bool node_t::is_equality_node() const
 {
-    return (m_literal.predicate == "=" and m_literal.truth);
+    return (m_literal.is_equality() and m_literal.truth);
 }
 
 
 inline bool node_t::is_non_equality_node() const
 {
-    return (m_literal.predicate == "=" and not m_literal.truth);
+    return (m_literal.is_equality() and not m_literal.truth);
 }
 
 
@@ -140,29 +140,25 @@ inline bool unifier_t::empty() const
 }
 
 
-inline const hash_map<index_t, hash_set<term_t> >&
+inline void proof_graph_t::unifiable_variable_clusters_set_t::add(
+    term_t t1, term_t t2 )
+{ m_terms.unite(t1, t2); }
+
+
+inline std::list< std::vector<term_t> >
 proof_graph_t::unifiable_variable_clusters_set_t::clusters() const
-{ return m_clusters; }
+{ return m_terms.sets(); }
 
 
-inline const hash_set<term_t>* proof_graph_t
+inline std::vector<term_t> proof_graph_t
     ::unifiable_variable_clusters_set_t::find_cluster(term_t t) const
-{
-    auto it = m_map_v2c.find(t);
-    return (it != m_map_v2c.end()) ? &m_clusters.at(it->second) : NULL;
-}
+{ return m_terms.members(t); }
 
 
 inline bool
 proof_graph_t::unifiable_variable_clusters_set_t::is_in_same_cluster(
     term_t t1, term_t t2 ) const
-{
-    auto i_v1 = m_map_v2c.find(t1);
-    if( i_v1 == m_map_v2c.end() ) return false;
-    auto i_v2 = m_map_v2c.find(t2);
-    if( i_v2 == m_map_v2c.end() ) return false;
-    return ( i_v1->second == i_v2->second );
-}
+{ return m_terms.is_in_same_set(t1, t2); }
 
 
 inline node_idx_t proof_graph_t::
@@ -248,28 +244,27 @@ inline const unifier_t* proof_graph_t::search_mutual_exclusion_of_node(
 }
 
 
-inline const hash_set<node_idx_t>*
-proof_graph_t::search_nodes_with_term( term_t term ) const
+inline node_span_t proof_graph_t::search_nodes_with_term( term_t term ) const
 {
     auto iter_tm = m_maps.term_to_nodes.find( term );
-    return ( iter_tm != m_maps.term_to_nodes.end() ) ? &iter_tm->second : NULL;
+    return ( iter_tm != m_maps.term_to_nodes.end() ) ? iter_tm->second.span() : node_span_t();
 }
 
 
-inline const hash_set<node_idx_t>* proof_graph_t::search_nodes_with_predicate(
+inline node_span_t proof_graph_t::search_nodes_with_predicate(
     predicate_t predicate, int arity ) const
 {
     auto iter_nm = m_maps.predicate_to_nodes.find( predicate );
-    if( iter_nm == m_maps.predicate_to_nodes.end() ) return NULL;
+    if( iter_nm == m_maps.predicate_to_nodes.end() ) return node_span_t();
 
     auto iter_an = iter_nm->second.find( arity );
-    if( iter_an == iter_nm->second.end() ) return NULL;
+    if( iter_an == iter_nm->second.end() ) return node_span_t();
 
-    return &iter_an->second;
+    return iter_an->second.span();
 }
 
 
-inline const hash_set<node_idx_t>*
+inline node_span_t
 proof_graph_t::search_nodes_with_arity(const arity_t &arity) const
 {
     int idx(arity.rfind('/')), num;
@@ -280,61 +275,152 @@ proof_graph_t::search_nodes_with_arity(const arity_t &arity) const
 }
 
 
-inline const hash_set<node_idx_t>*
+inline node_span_t
 proof_graph_t::search_nodes_with_arity(const kb::arity_id_t arity) const
 {
     auto found = m_maps.arity_to_nodes.find(arity);
-    return (found != m_maps.arity_to_nodes.end()) ? &found->second : NULL;
+    return (found != m_maps.arity_to_nodes.end()) ? found->second.span() : node_span_t();
 }
 
 
-inline const hash_set<node_idx_t>*
+inline node_span_t
 proof_graph_t::search_nodes_with_depth(depth_t depth) const
 {
     auto it = m_maps.depth_to_nodes.find( depth );
-    return (it == m_maps.depth_to_nodes.end()) ? NULL : &it->second;
+    return (it == m_maps.depth_to_nodes.end()) ? node_span_t() : it->second.span();
 }
 
 
-inline const hash_set<edge_idx_t>*
+inline edge_span_t
     proof_graph_t::search_edges_with_hypernode( hypernode_idx_t idx ) const
 {
-    auto it = m_maps.hypernode_to_edge.find(idx);
-    return (it == m_maps.hypernode_to_edge.end()) ? NULL : &it->second;
+    return m_maps.hypernode_to_edge.find(idx);
 }
 
 
-inline const hash_set<edge_idx_t>*
+inline edge_span_t
 proof_graph_t::search_edges_with_node_in_head(node_idx_t idx) const
 {
-    auto found = m_maps.head_node_to_edges.find(idx);
-    return (found == m_maps.head_node_to_edges.end()) ? NULL : &found->second;
+    return m_maps.head_node_to_edges.find(idx);
 }
 
 
-inline const hash_set<edge_idx_t>*
+inline edge_span_t
 proof_graph_t::search_edges_with_node_in_tail(node_idx_t idx) const
 {
-    auto found = m_maps.tail_node_to_edges.find(idx);
-    return (found == m_maps.tail_node_to_edges.end()) ? NULL : &found->second;
+    return m_maps.tail_node_to_edges.find(idx);
 }
 
 
-inline const hash_set<hypernode_idx_t>*
+inline hypernode_span_t
 proof_graph_t::search_hypernodes_with_node( node_idx_t node_idx ) const
 {
-    auto it = m_maps.node_to_hypernode.find( node_idx );
-    return (it == m_maps.node_to_hypernode.end()) ? NULL : &it->second;
+    return m_maps.node_to_hypernode.find( node_idx );
 }
 
 
-template<class It> const hash_set<hypernode_idx_t>*
+template<class It> hypernode_span_t
 proof_graph_t::find_hypernode_with_unordered_nodes(It begin, It end) const
 {
-    size_t hash = get_hash_of_nodes(std::list<node_idx_t>(begin, end));
-    auto find = m_maps.unordered_nodes_to_hypernode.find(hash);
-    return (find != m_maps.unordered_nodes_to_hypernode.end()) ?
-        &(find->second) : NULL;
+    return m_maps.unordered_nodes_to_hypernode.find(
+        get_hash_of_nodes(begin, end),
+        [this, begin, end](hypernode_idx_t hn)
+    { return _has_same_unordered_nodes(hn, begin, end); });
+}
+
+
+template <class It> size_t proof_graph_t::get_hash_of_nodes(It begin, It end)
+{
+    // THE SUM OF MIXED INDICES DOES NOT DEPEND ON THE ORDER OF NODES.
+    uint64_t hash(0);
+    for (It it = begin; it != end; ++it)
+    {
+        uint64_t x = static_cast<uint64_t>(*it) + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        hash += x ^ (x >> 31);
+    }
+    return static_cast<size_t>(hash);
+}
+
+
+template <class It> bool proof_graph_t::_has_same_unordered_nodes(
+    hypernode_idx_t idx, It begin, It end) const
+{
+    static const size_t SMALL_SIZE = 16;
+    const std::vector<node_idx_t> &hn = hypernode(idx);
+    size_t n = static_cast<size_t>(std::distance(begin, end));
+
+    if (hn.size() != n) return false;
+
+    if (n <= SMALL_SIZE)
+    {
+        // COMPARE SORTED COPIES ON THE STACK.
+        node_idx_t x[SMALL_SIZE], y[SMALL_SIZE];
+        std::copy(hn.begin(), hn.end(), x);
+        std::copy(begin, end, y);
+        std::sort(x, x + n);
+        std::sort(y, y + n);
+        return std::equal(x, x + n, y);
+    }
+    else
+    {
+        std::vector<node_idx_t> x(hn), y(begin, end);
+        std::sort(x.begin(), x.end());
+        std::sort(y.begin(), y.end());
+        return x == y;
+    }
+}
+
+
+template <class F> hypernode_span_t
+proof_graph_t::unordered_hypernode_table_t::find(size_t hash, F is_same) const
+{
+    index_t g = find_group(hash, is_same);
+    return (g >= 0) ? m_groups.at(g).span() : hypernode_span_t();
+}
+
+
+template <class F> void proof_graph_t::unordered_hypernode_table_t::insert(
+    size_t hash, hypernode_idx_t idx, F is_same)
+{
+    index_t g = find_group(hash, is_same);
+
+    if (g < 0)
+    {
+        // KEEP THE LOAD FACTOR NOT MORE THAN 1/2.
+        if ((m_groups.size() + 1) * 2 > m_slots.size())
+            rehash(std::max<size_t>(16, m_slots.size() * 2));
+
+        size_t mask = m_slots.size() - 1;
+        size_t i = hash & mask;
+        while (m_slots[i].group >= 0)
+            i = (i + 1) & mask;
+
+        g = static_cast<index_t>(m_groups.size());
+        m_slots[i].hash = hash;
+        m_slots[i].group = g;
+        m_groups.push_back(util::flat_set_t<hypernode_idx_t>());
+    }
+
+    m_groups[g].insert(idx);
+}
+
+
+template <class F> index_t
+proof_graph_t::unordered_hypernode_table_t::find_group(size_t hash, F is_same) const
+{
+    if (m_slots.empty()) return -1;
+
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = hash & mask; m_slots[i].group >= 0; i = (i + 1) & mask)
+    {
+        const slot_t &s = m_slots[i];
+        if (s.hash == hash and is_same(*m_groups[s.group].begin()))
+            return s.group;
+    }
+
+    return -1;
 }
 
 
@@ -346,13 +432,20 @@ inline hypernode_idx_t
 }
 
 
-inline const hash_set<term_t>*
+inline std::vector<term_t>
 proof_graph_t::find_variable_cluster( term_t t ) const
 {
     return m_vc_unifiable.find_cluster(t);
 }
 
 
+inline std::list< std::vector<term_t> >
+proof_graph_t::enumerate_variable_clusters() const
+{
+    return m_vc_unifiable.clusters();
+}
+
+
 template <class IterNodesArray>
 bool proof_graph_t::check_nodes_coexistability(IterNodesArray begin, IterNodesArray end) const
 {
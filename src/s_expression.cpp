@@ -2,6 +2,7 @@
 
 
 #include <iostream>
+#include <algorithm>
 #include "./s_expression.h"
 
 namespace phil
@@ -25,7 +26,7 @@ void stack_t::print( std::string *p_out_str ) const
     switch( type )
     {
     case STRING_STACK:
-        (*p_out_str) += str;
+        p_out_str->append( str.data(), str.size() );
         break;
         
     case TUPLE_STACK:
@@ -47,20 +48,195 @@ void stack_t::print( std::string *p_out_str ) const
 }
 
 
-/** Thanks for https://gist.github.com/240957. */
+arena_t::arena_t(size_t chunk_size)
+    : m_chunk_size(chunk_size), m_current(0), m_offset(0)
+{}
+
+
+arena_t::~arena_t()
+{
+    for (auto it = m_chunks.begin(); it != m_chunks.end(); ++it)
+        delete[] it->first;
+}
+
+
+void arena_t::reset()
+{
+    m_current = 0;
+    m_offset = 0;
+}
+
+
+void* arena_t::allocate_bytes(size_t size, size_t align)
+{
+    while (m_current < m_chunks.size())
+    {
+        size_t offset = (m_offset + align - 1) / align * align;
+        if (offset + size <= m_chunks[m_current].second)
+        {
+            m_offset = offset + size;
+            return m_chunks[m_current].first + offset;
+        }
+        ++m_current;
+        m_offset = 0;
+    }
+
+    /* NO CHUNK HAS ENOUGH SPACE, SO ADD A NEW ONE. */
+    size_t n = std::max(m_chunk_size, size);
+    m_chunks.push_back(std::make_pair(new char[n], n));
+    m_current = m_chunks.size() - 1;
+    m_offset = size;
+    return m_chunks.back().first;
+}
+
+
+reader_t::reader_t(
+    const char *data, size_t size, const std::string &name,
+    bool do_preload, size_t line_num)
+    : m_begin(data), m_end(data + size), m_pos(data), m_name(name),
+      m_depth(0), m_is_in_token(false),
+      m_stack_current(NULL), m_line_num(line_num), m_is_end(false), m_is_balanced(true),
+      m_is_preloaded(false), m_event_idx(0)
+{
+    clear_stack();
+
+    if (do_preload)
+    {
+        /* STACKS ARE KEPT WHILE PRELOADING, SINCE THE ARENA IS NOT RESET. */
+        m_is_preloaded = true;
+        for (parse(); not m_is_end; parse())
+        {
+            event_t e = { m_stack_current, m_depth, m_line_num, size_t(m_pos - m_begin) };
+            m_events.push_back(e);
+        }
+
+        m_is_end = m_events.empty();
+        if (not m_is_end)
+        {
+            m_stack_current = m_events.front().stack;
+            m_depth = m_events.front().depth;
+            m_line_num = m_events.front().line_num;
+        }
+    }
+    else
+        parse();
+}
+
+
+std::vector<std::pair<size_t, size_t> > reader_t::split(
+    const char *data, size_t size, size_t chunk_size)
+{
+    std::vector<std::pair<size_t, size_t> > out(1, std::make_pair(0, 1));
+    if (size <= chunk_size) return out;
+
+    /* QUOTE CHANGES THE NESTING OF LISTS, SO SUCH INPUT IS NOT SPLIT. */
+    static const std::string QUOTE("quote");
+    if (std::search(data, data + size, QUOTE.begin(), QUOTE.end()) != data + size)
+        return out;
+
+    /* FOLLOWS THE STATES OF parse() WITHOUT BUILDING STACKS. */
+    size_t depth(0), line_num(1);
+    bool in_string(false), in_token(false), comment_flag(false);
+    char last_c(0);
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        char c = data[i];
+        if ('\n' == c) ++line_num;
+
+        if (not in_string and last_c != '\\' and c == ';')
+        {
+            comment_flag = true;
+            continue;
+        }
+        else if (comment_flag)
+        {
+            if ('\n' == c) comment_flag = false;
+            continue;
+        }
+
+        if (in_string)
+        {
+            if (c == '"') in_string = false;
+            else if (c == '\\') ++i;
+        }
+        else if (in_token)
+        {
+            if (is_sexp_separator(c))
+            {
+                /* READ THE SEPARATOR AGAIN AS A PART OF THE LIST. */
+                in_token = false;
+                --i;
+                if ('\n' == c) --line_num;
+            }
+            else if (c == '\\') ++i;
+        }
+        else if (c == '(')
+        {
+            if (depth++ == 0 and i - out.back().first >= chunk_size)
+                out.push_back(std::make_pair(i, line_num));
+        }
+        else if (c == ')')
+        {
+            /* LET THE READER REPORT THE SYNTAX ERROR. */
+            if (depth-- == 0)
+                return std::vector<std::pair<size_t, size_t> >(1, std::make_pair(0, 1));
+
+            /* parse() RETURNS HERE, WHICH RESETS ITS LOCAL STATES. */
+            last_c = 0;
+            continue;
+        }
+        else if (c == '"') in_string = true;
+        else if (not is_sexp_separator(c)) in_token = true;
+
+        last_c = c;
+    }
+
+    return out;
+}
+
+
 reader_t& reader_t::read()
+{
+    if (not m_is_preloaded)
+    {
+        parse();
+        return *this;
+    }
+
+    if (++m_event_idx < m_events.size())
+    {
+        const event_t &e = m_events.at(m_event_idx);
+        m_stack_current = e.stack;
+        m_depth = e.depth;
+        m_line_num = e.line_num;
+    }
+    else
+    {
+        m_event_idx = m_events.size() - 1;
+        m_depth = 1;
+        m_is_end = true;
+    }
+
+    return *this;
+}
+
+
+/** Thanks for https://gist.github.com/240957. */
+void reader_t::parse()
 {
     bool comment_flag = false;
     char last_c       = 0;
-  
-    while( m_stream.good() )
+
+    while( m_pos < m_end )
     {
-        char c = m_stream.get();
+        const char *p = m_pos++;
+        char c = *p;
 
-        m_read_bytes = m_stream.tellg();
         if( '\n' == c ) m_line_num++;
-    
-        stack_t::stack_type_e type = m_stack.back()->type;
+
+        stack_t::stack_type_e type =
+            m_is_in_token ? m_token_type : stack_t::LIST_STACK;
         if( type != stack_t::STRING_STACK and last_c != '\\' and c == ';' )
         {
             comment_flag = true;
@@ -79,40 +255,39 @@ reader_t& reader_t::read()
             if( c == '(' )
             {
                 /* IF IT WERE TOP STACK, THEN CLEAR. */
-                if( m_stack.size() == 1 ) clear_stack();
-                m_stack.push_back( new_stack( stack_t(stack_t::LIST_STACK) ) );
+                if( m_depth == 1 ) clear_stack();
+                push_frame( new_stack(stack_t::LIST_STACK) );
             }
             else if( c == ')' )
             {
-                if(m_stack.size() < 2)
+                if( m_depth < 2 )
                 {
+                    const std::vector<stack_t*> &top = m_frames[0].children;
+                    m_root.children = array_view_t<stack_t*>(top.data(), top.size());
                     std::cerr << "Syntax error at " << m_line_num
                               << ": too many parentheses." << std::endl
-                              << m_stack.back()->to_string() << std::endl;
-                    throw;
+                              << m_root.to_string() << std::endl;
+                    throw std::runtime_error(
+                        "Syntax error at " + std::to_string(m_line_num)
+                        + ": too many parentheses.");
                 }
-                m_stack[ m_stack.size()-2 ]
-                    ->children.push_back( m_stack.back() );
-                m_stack.pop_back();
-                if( m_stack.back()->children[0]->type == stack_t::TUPLE_STACK and
-                    m_stack.back()->children[0]->children[0]->str == "quote" )
-                {
-                    m_stack[ m_stack.size()-2 ]
-                        ->children.push_back( m_stack.back() );
-                    m_stack.pop_back();
-                }
-                m_stack_current = m_stack.back()->children.back();
-                return *this;
+                pop_frame();
+                pop_quote();
+                m_stack_current = m_frames[m_depth - 1].children.back();
+                return;
             }
             else if( c == '"' )
-                m_stack.push_back( new_stack( stack_t(stack_t::STRING_STACK) ) );
+            {
+                m_token_type = stack_t::STRING_STACK;
+                begin_token( m_pos );
+            }
             else if( is_sexp_separator(c) )
                 break;
             else
             {
-                stack_t s(
-                    stack_t::TUPLE_STACK, std::string(1, c), m_stack_list );
-                m_stack.push_back( new_stack(s) );
+                m_token_type = stack_t::TUPLE_STACK;
+                begin_token( p );
+                append_token( p );
             }
             break;
         }
@@ -120,51 +295,114 @@ reader_t& reader_t::read()
         {
             if( c == '"' )
             {
-                m_stack[ m_stack.size()-2 ]
-                    ->children.push_back( m_stack.back() );
-                m_stack.pop_back();
-                if( m_stack.back()->children[0]->type == stack_t::TUPLE_STACK and
-                    m_stack.back()->children[0]->children[0]->str == "quote" )
-                {
-                    m_stack[ m_stack.size()-2 ]
-                        ->children.push_back( m_stack.back() );
-                    m_stack.pop_back();
-                }
+                stack_t *s = new_stack( stack_t::STRING_STACK );
+                s->str = end_token();
+                m_frames[m_depth - 1].children.push_back( s );
+                pop_quote();
             }
-            else if( c == '\\' ) m_stack.back()->str += m_stream.get();
-            else if( c != ';'  ) m_stack.back()->str += c;
+            else if( c == '\\' )
+            {
+                if( m_pos < m_end ) append_token( m_pos++ );
+            }
+            else if( c != ';' ) append_token( p );
             break;
         }
         case stack_t::TUPLE_STACK:
         {
             if( is_sexp_separator(c) )
             {
-                stack_t *p_atom = m_stack.back();
-                m_stack.pop_back();
-                m_stack.back()->children.push_back(p_atom);
-                if( m_stack.back()->children[0]->type == stack_t::TUPLE_STACK and
-                    m_stack.back()->children[0]->children[0]->str == "quote" )
-                {
-                    m_stack[ m_stack.size()-2 ]
-                        ->children.push_back( m_stack.back() );
-                    m_stack.pop_back();
-                }
-                m_stream.unget();
+                stack_t *s = new_stack( stack_t::STRING_STACK );
+                s->str = end_token();
+
+                stack_t *t = new_stack( stack_t::TUPLE_STACK );
+                stack_t **child = m_arena.allocate<stack_t*>();
+                (*child) = s;
+                t->children = array_view_t<stack_t*>( child, 1 );
+
+                m_frames[m_depth - 1].children.push_back( t );
+                pop_quote();
+
+                /* READ THE SEPARATOR AGAIN AS A PART OF THE LIST. */
+                --m_pos;
+                if( '\n' == c ) m_line_num--;
             }
             else if( c == '\\' )
-                m_stack.back()->children[0]->str += m_stream.get();
+            {
+                if( m_pos < m_end ) append_token( m_pos++ );
+            }
             else
-                m_stack.back()->children[0]->str += c;
+                append_token( p );
             break;
         }
         }
         last_c = c;
     }
+
+    /* THE DEPTH IS LOST BY clear_stack(), SO IT IS RECORDED HERE. */
+    m_is_end = true;
+    m_is_balanced = m_is_balanced and (m_depth == 1);
     clear_stack();
-    return *this;
 }
 
 
+void reader_t::clear_stack()
+{
+    if (not m_is_preloaded)
+        m_arena.reset();
+    m_root.children = array_view_t<stack_t*>();
+    m_is_in_token = false;
+    m_depth = 0;
+    push_frame( &m_root );
+}
+
+
+void reader_t::push_frame( stack_t *stack )
+{
+    if( m_frames.size() == m_depth )
+        m_frames.push_back( frame_t() );
+
+    frame_t &f = m_frames[m_depth++];
+    f.stack = stack;
+    f.children.clear();
+}
+
+
+void reader_t::pop_frame()
+{
+    const frame_t &f = m_frames[m_depth - 1];
+    size_t n = f.children.size();
+    stack_t **children = m_arena.allocate<stack_t*>( n );
+
+    std::copy( f.children.begin(), f.children.end(), children );
+    f.stack->children = array_view_t<stack_t*>( children, n );
+
+    --m_depth;
+    m_frames[m_depth - 1].children.push_back( f.stack );
+}
+
+
+void reader_t::pop_quote()
+{
+    if( m_depth < 2 ) return;
+
+    const std::vector<stack_t*> &children = m_frames[m_depth - 1].children;
+    if( children[0]->type == stack_t::TUPLE_STACK and
+        children[0]->children[0]->str == "quote" )
+        pop_frame();
+}
+
+
+string_view_t reader_t::end_token()
+{
+    m_is_in_token = false;
+
+    if( not m_is_token_copied )
+        return string_view_t( m_token_begin, m_token_size );
+
+    char *str = m_arena.allocate<char>( m_token_buf.size() );
+    std::copy( m_token_buf.begin(), m_token_buf.end(), str );
+    return string_view_t( str, m_token_buf.size() );
+}
 }
 
 }
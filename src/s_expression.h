@@ -1,9 +1,11 @@
 #pragma once
 
-#include <fstream>
 #include <string>
-#include <list>
-#include <deque>
+#include <vector>
+#include <utility>
+#include <new>
+#include <stdexcept>
+#include <cstring>
 #include <ciso646>
 
 
@@ -14,70 +16,227 @@ namespace sexp
 {
 
 
-/** A class of stack of s-expression. */
+/** A non-owning reference to a string,
+ *  which points into the input buffer or an arena. */
+class string_view_t
+{
+public:
+    inline string_view_t() : m_data(""), m_size(0) {}
+    inline string_view_t(const char *data, size_t size)
+        : m_data(data), m_size(size) {}
+
+    inline const char* data() const { return m_data; }
+    inline size_t size() const { return m_size; }
+    inline bool empty() const { return m_size == 0; }
+
+    inline char operator[](size_t i) const { return m_data[i]; }
+    inline char at(size_t i) const;
+
+    inline const char* begin() const { return m_data; }
+    inline const char* end() const { return m_data + m_size; }
+
+    inline bool operator==(const string_view_t &s) const;
+    inline bool operator==(const std::string &s) const;
+    inline bool operator==(const char *s) const;
+    inline bool operator!=(const std::string &s) const { return not(*this == s); }
+
+    inline std::string to_string() const { return std::string(m_data, m_size); }
+    inline operator std::string() const { return to_string(); }
+
+private:
+    const char *m_data;
+    size_t m_size;
+};
+
+
+/** A read-only array of elements allocated in an arena. */
+template <class T> class array_view_t
+{
+public:
+    typedef const T* const_iterator;
+
+    inline array_view_t() : m_data(NULL), m_size(0) {}
+    inline array_view_t(const T *data, size_t size)
+        : m_data(data), m_size(size) {}
+
+    inline size_t size() const { return m_size; }
+    inline bool empty() const { return m_size == 0; }
+
+    inline const T& operator[](size_t i) const { return m_data[i]; }
+    inline const T& at(size_t i) const;
+    inline const T& front() const { return m_data[0]; }
+    inline const T& back() const { return m_data[m_size - 1]; }
+
+    inline const_iterator begin() const { return m_data; }
+    inline const_iterator end() const { return m_data + m_size; }
+
+private:
+    const T *m_data;
+    size_t m_size;
+};
+
+
+/** A memory pool whose whole content is released at once.
+ *  Chunks are kept on reset() and reused for later allocations. */
+class arena_t
+{
+public:
+    arena_t(size_t chunk_size = 64 * 1024);
+    ~arena_t();
+
+    /** Returns uninitialized memory for n instances of T.
+     *  T must be trivially destructible. */
+    template <class T> inline T* allocate(size_t n = 1);
+
+    /** Releases all allocated memory at once. */
+    void reset();
+
+private:
+    arena_t(const arena_t&);
+    arena_t& operator=(const arena_t&);
+
+    void* allocate_bytes(size_t size, size_t align);
+
+    std::vector<std::pair<char*, size_t> > m_chunks;
+    size_t m_chunk_size;
+    size_t m_current; /**< Index of the chunk in use. */
+    size_t m_offset;  /**< Used bytes in the chunk in use. */
+};
+
+
+/** A class of stack of s-expression.
+ *  Instances are allocated in the arena of reader_t,
+ *  so they are valid until the reader starts the next root expression. */
 class stack_t
-{    
+{
 public:
     enum stack_type_e { LIST_STACK, STRING_STACK, TUPLE_STACK };
-    
+
     stack_type_e type;
-    std::deque<stack_t*> children;
-    std::string str; /**< Content of string-stack instance. */
-  
+    array_view_t<stack_t*> children;
+    string_view_t str; /**< Content of string-stack instance. */
+
     inline stack_t() : type(LIST_STACK) {}
     inline stack_t(stack_type_e t) : type(t) {}
-    inline stack_t(
-        stack_type_e t, const std::string &e, std::list<stack_t> &stack_list);
 
     int find_functor(const std::string &func_name) const;
-    
+
     inline bool is_functor(const std::string &func_name = "") const;
     inline bool is_parameter() const;
-    
+
     inline std::string get_string() const; /** Get str of this or children. */
     inline std::string to_string() const;  /**< Get string-expression this. */
-    
+
     void print( std::string *p_out_str ) const;
+
+private:
+    /** Returns the string-stack which get_string() refers to, or NULL. */
+    inline const stack_t* get_string_stack() const;
 };
 
 
-/** reader of s-expression. */
+/** reader of s-expression.
+ *  The reader parses given buffer without copying it,
+ *  so the buffer must outlive the reader and stacks given by it. */
 class reader_t
-{  
+{
 public:
-    inline reader_t( std::istream &_stream, const std::string &name="" );
-    inline ~reader_t() { clear_stack(); }
-    
+    /** @param do_preload If true, parses the whole buffer on construction
+     *                    and keeps every stack, so that read() only visits them.
+     *  @param line_num   The line number at the beginning of the buffer. */
+    reader_t(
+        const char *data, size_t size, const std::string &name = "",
+        bool do_preload = false, size_t line_num = 1);
+
+    /** Splits data into chunks of about chunk_size bytes at the beginning
+     *  of root expressions, so that each chunk can be read independently.
+     *  Returns pairs of the offset and the line number of each chunk. */
+    static std::vector<std::pair<size_t, size_t> > split(
+        const char *data, size_t size, size_t chunk_size);
+
     /** Read and parse s-expression.  */
     reader_t& read();
-    
-    inline const std::deque<stack_t*> &get_queue() const;
-    inline const std::list<stack_t>   &get_list()  const;
+
     inline const stack_t* get_stack() const { return m_stack_current; }
     inline size_t get_read_bytes() const;
     inline size_t get_line_num() const { return m_line_num; }
+    inline size_t get_depth() const { return m_depth; }
 
     inline const std::string& name() const { return m_name; }
-      
-    inline bool is_end()  const { return m_stream.eof(); }
-    inline bool is_root() const { return m_stack.size() == 1; }
-    
-    inline void clear_stack();
-    inline void clear_latest_stack(int n);
-        
+
+    inline bool is_end()  const { return m_is_end; }
+    inline bool is_root() const { return m_depth == 1; }
+
+    /** Returns false if any list was left unclosed at the end of the buffer.
+     *  It is meaningful only after is_end() becomes true. */
+    inline bool is_balanced() const { return m_is_balanced; }
+
+    void clear_stack();
+
 private:
+    /** A list-stack which is not closed yet. */
+    struct frame_t
+    {
+        stack_t *stack;
+        std::vector<stack_t*> children;
+    };
+
+    /** A state of the reader when read() returned, recorded on preloading. */
+    struct event_t
+    {
+        stack_t *stack;
+        size_t depth, line_num, read_bytes;
+    };
+
+    /** Parses the buffer until the next list closes. */
+    void parse();
+
     inline static bool is_sexp_separator( char c );
 
-    /** Add a new stack and return the pointer of the added stack. */
-    inline stack_t* new_stack( const stack_t &ss );
-    
-    std::istream         &m_stream;
-    std::deque<stack_t*>  m_stack;
-    std::list<stack_t>    m_stack_list;
+    /** Adds a new stack to the arena and returns the pointer of it. */
+    inline stack_t* new_stack( stack_t::stack_type_e type );
+
+    void push_frame( stack_t *stack );
+
+    /** Fixes children of the top frame and adds it to its parent. */
+    void pop_frame();
+
+    /** Pops the top frame too if it is an argument of quote. */
+    void pop_quote();
+
+    /** Starts an empty token at p. */
+    inline void begin_token( const char *p );
+    inline void append_token( const char *p );
+
+    /** Returns the current token, which is copied to the arena if needed. */
+    string_view_t end_token();
+
+    const char *m_begin, *m_end, *m_pos;
     std::string m_name;
+
+    arena_t m_arena;
+    stack_t m_root;
+    std::vector<frame_t> m_frames;
+    size_t m_depth;
+
+    /** The token being read.
+     *  It refers to the buffer directly unless it is not contiguous there,
+     *  as with escaped characters, in which case it is built in m_token_buf. */
+    const char *m_token_begin;
+    size_t m_token_size;
+    bool m_is_token_copied;
+    std::string m_token_buf;
+    stack_t::stack_type_e m_token_type;
+    bool m_is_in_token;
+
     stack_t *m_stack_current;
     size_t   m_line_num;
-    size_t   m_read_bytes;
+    bool     m_is_end;
+    bool     m_is_balanced;
+
+    bool m_is_preloaded;
+    std::vector<event_t> m_events;
+    size_t m_event_idx;
 };
 
 
@@ -7,17 +7,43 @@ namespace sexp
 {
 
 
-inline stack_t::stack_t(
-    stack_type_e _type, const std::string& e, std::list<stack_t> &stack_list )
-    : type(_type)
+inline char string_view_t::at(size_t i) const
 {
-    if( type == TUPLE_STACK )
-    {
-        stack_list.push_back( stack_t( STRING_STACK, e, stack_list ) );
-        children.push_back( &(stack_list.back()) );
-    }
-    else
-        str = e;
+    if (i >= m_size)
+        throw std::out_of_range("sexp::string_view_t::at");
+    return m_data[i];
+}
+
+
+inline bool string_view_t::operator==(const string_view_t &s) const
+{
+    return m_size == s.m_size and std::memcmp(m_data, s.m_data, m_size) == 0;
+}
+
+
+inline bool string_view_t::operator==(const std::string &s) const
+{
+    return m_size == s.size() and std::memcmp(m_data, s.data(), m_size) == 0;
+}
+
+
+inline bool string_view_t::operator==(const char *s) const
+{
+    return (*this) == string_view_t(s, std::strlen(s));
+}
+
+
+template <class T> inline const T& array_view_t<T>::at(size_t i) const
+{
+    if (i >= m_size)
+        throw std::out_of_range("sexp::array_view_t::at");
+    return m_data[i];
+}
+
+
+template <class T> inline T* arena_t::allocate(size_t n)
+{
+    return static_cast<T*>(allocate_bytes(sizeof(T) * n, alignof(T)));
 }
 
 
@@ -39,62 +65,64 @@ inline bool stack_t::is_functor( const std::string &func_name ) const
 
 inline bool stack_t::is_parameter() const
 {
-    std::string str = get_string();
-    if( str.empty() ) return false;
-    else              return ( get_string().at(0) == ':' );
+    const stack_t *s = get_string_stack();
+    return (s != NULL) and (not s->str.empty()) and (s->str[0] == ':');
 }
 
 
 inline std::string stack_t::get_string() const
 {
-    if( type == STRING_STACK )
-        return str;
-    else if( children.size() == 1 and children[0]->type == STRING_STACK )
-        return children[0]->str;
-    else
-        return "";
+    const stack_t *s = get_string_stack();
+    return (s != NULL) ? s->str.to_string() : "";
 }
 
 
-inline reader_t::reader_t( std::istream &_stream, const std::string &name )
-    : m_line_num(1), m_read_bytes(0), m_stream(_stream), m_name(name)
+inline const stack_t* stack_t::get_string_stack() const
 {
-    m_stack.push_back( new_stack( stack_t(stack_t::LIST_STACK) ) );
-    read();
-};
-
-
-inline const std::deque<stack_t*>& reader_t::get_queue() const
-{ return m_stack; }
-
-
-inline const std::list<stack_t>& reader_t::get_list() const
-{ return m_stack_list; }
+    if( type == STRING_STACK )
+        return this;
+    else if( children.size() == 1 and children[0]->type == STRING_STACK )
+        return children[0];
+    else
+        return NULL;
+}
 
 
 inline size_t reader_t::get_read_bytes() const
-{ return m_read_bytes; }
+{
+    return m_is_preloaded ?
+        m_events.at(m_event_idx).read_bytes : (m_pos - m_begin);
+}
 
 
-inline void reader_t::clear_stack()
+inline stack_t* reader_t::new_stack( stack_t::stack_type_e type )
 {
-    m_stack_list.clear();
-    m_stack.clear();
-    m_stack.push_back( new_stack( stack_t(stack_t::LIST_STACK) ) );
+    return new (m_arena.allocate<stack_t>()) stack_t(type);
 }
 
 
-inline void reader_t::clear_latest_stack(int n)
+inline void reader_t::begin_token( const char *p )
 {
-    for( int i=0; i<n; ++i )
-        m_stack_list.pop_back();
+    m_token_begin = p;
+    m_token_size = 0;
+    m_is_token_copied = false;
+    m_is_in_token = true;
 }
 
 
-inline stack_t* reader_t::new_stack( const stack_t &ss )
+inline void reader_t::append_token( const char *p )
 {
-    m_stack_list.push_back(ss);
-    return &(m_stack_list.back());
+    if( not m_is_token_copied and m_token_begin + m_token_size == p )
+        ++m_token_size;
+    else
+    {
+        if( not m_is_token_copied )
+        {
+            m_token_buf.assign( m_token_begin, m_token_size );
+            m_is_token_copied = true;
+        }
+        m_token_buf += (*p);
+    }
 }
 
 
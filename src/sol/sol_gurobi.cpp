@@ -165,7 +165,10 @@ void gurobi_t::solve(
       while (true)
       {
           if (do_cpi)
+          {
               util::print_console_fmt("begin: Cutting-Plane-Inference #%d", (num_loop++));
+              util::metrics_t::count("sol.cpi_iterations");
+          }
 
           GRBEXECUTE(model.optimize());
 
@@ -210,6 +213,7 @@ void gurobi_t::solve(
                       // ADD VIOLATED CONSTRAINTS
                       for (auto it = filtered.begin(); it != filtered.end(); ++it)
                           add_constraint(prob, &model, *it, vars);
+                      util::metrics_t::count("sol.lazy_constraints_added", filtered.size());
                       model.update();
                       do_violate_lazy_constraint = true;
                   }
@@ -308,9 +312,9 @@ void gurobi_t::solve(
           if(pg->node(i).type() != pg::NODE_HYPOTHESIS) continue;
 
           if(fKbestPredFuzzyMatch) {
-            if(-1 == pg->node(i).literal().predicate.find(kbest_pred)) continue;
+            if(-1 == pg->node(i).literal().predicate.string().find(kbest_pred)) continue;
           } else {
-            if(kbest_pred != pg->node(i).literal().predicate) continue;
+            if(pg->node(i).literal().predicate != kbest_pred) continue;
           }
 
           strLiterals += pg->node(i).to_string() + " ";
@@ -320,10 +324,10 @@ void gurobi_t::solve(
             if(kbest_ignore_args.end() != kbest_ignore_args.find(1+j)) continue;
             if(pg->node(i).literal().terms[j].is_constant()) continue;
 
-            const hash_set<pg::node_idx_t> *pNodes = pg->search_nodes_with_term(pg->node(i).literal().terms[j]);
+            pg::node_span_t pNodes = pg->search_nodes_with_term(pg->node(i).literal().terms[j]);
 
             // pNodes: related (possibly non-equality) literals.
-            for(auto eq = pNodes->begin(); eq != pNodes->end(); ++eq) {
+            for(auto eq = pNodes.begin(); eq != pNodes.end(); ++eq) {
               if(prob->node_is_active(last_sol, *eq) && (pg->node(*eq).is_equality_node() || pg->node(*eq).is_transitive_equality_node())) {
 
                 // Sometimes it concerns only unification with constants.